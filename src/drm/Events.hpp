@@ -0,0 +1,105 @@
+#pragma once
+#include <array>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <unistd.h>
+#include <xf86drm.h>
+
+namespace glplay::drm {
+
+	/*
+	 * Decodes the DRM events in a buffer read from the DRM FD, in place,
+	 * and hands each to the matching member of 'handler':
+	 *
+	 *   flipComplete(crtcId, sequence, time, userData)  atomic/page-flip completions
+	 *   vblank(crtcId, sequence, time, userData)        drmWaitVBlank events
+	 *   crtcSequence(userData, sequence, nsec)          drmCrtcQueueSequence events
+	 *
+	 * The buffer must be aligned for struct drm_event_vblank; the kernel
+	 * pads every event to a multiple of 8 bytes, so each one stays
+	 * aligned. Returns the number of events dispatched.
+	 */
+	template<typename Handler>
+	inline auto dispatch_events(const char *data, size_t len, Handler &handler) -> size_t {
+		size_t offset = 0;
+		size_t count = 0;
+
+		while (offset + sizeof(struct drm_event) <= len) {
+			const auto *event = reinterpret_cast<const struct drm_event *>(data + offset);
+			if (event->length < sizeof(*event) || offset + event->length > len) {
+				break;
+			}
+
+			switch (event->type) {
+			case DRM_EVENT_FLIP_COMPLETE:
+			case DRM_EVENT_VBLANK: {
+				const auto *vblank = reinterpret_cast<const struct drm_event_vblank *>(event);
+				struct timespec time = {
+					.tv_sec = static_cast<time_t>(vblank->tv_sec),
+					.tv_nsec = static_cast<long>(vblank->tv_usec) * 1000,
+				};
+				if (event->type == DRM_EVENT_FLIP_COMPLETE) {
+					handler.flipComplete(vblank->crtc_id, vblank->sequence, time, vblank->user_data);
+				} else {
+					handler.vblank(vblank->crtc_id, vblank->sequence, time, vblank->user_data);
+				}
+				count++;
+				break;
+			}
+			case DRM_EVENT_CRTC_SEQUENCE: {
+				const auto *sequence = reinterpret_cast<const struct drm_event_crtc_sequence *>(event);
+				handler.crtcSequence(sequence->user_data, sequence->sequence, sequence->time_ns);
+				count++;
+				break;
+			}
+			default:
+				break;
+			}
+			offset += event->length;
+		}
+		return count;
+	}
+
+	/*
+	 * Reads every pending DRM event in one go, rather than the 1KiB a
+	 * drmHandleEvent call reads, and dispatches them without going through
+	 * drmEventContext's C callbacks and their void pointer.
+	 *
+	 * The kernel only hands out whole events, and as many as fit, so one
+	 * read of a large buffer drains the queue after poll reports the FD
+	 * readable.
+	 */
+	class EventReader {
+		public:
+			/* Room for 512 vblank-sized events. */
+			static const size_t BUFFER_SIZE = 16384;
+
+			/*
+			 * Reads and dispatches the pending events; returns how
+			 * many there were, or -errno.
+			 */
+			template<typename Handler>
+			auto drain(int fd, Handler &handler) -> ssize_t {
+				auto len = read(fd, buffer.data(), buffer.size());
+				if (len < 0) {
+					return -errno;
+				}
+				return static_cast<ssize_t>(dispatch_events(buffer.data(), static_cast<size_t>(len), handler));
+			}
+
+			/* For reading into ourselves, e.g. from an io_uring submission. */
+			[[nodiscard]] auto data() -> char * { return buffer.data(); }
+			[[nodiscard]] auto size() const -> size_t { return buffer.size(); }
+
+			/* Dispatches the events we were read into. */
+			template<typename Handler>
+			auto dispatch(size_t len, Handler &handler) -> size_t {
+				return dispatch_events(buffer.data(), len, handler);
+			}
+
+		private:
+			alignas(struct drm_event_vblank) std::array<char, BUFFER_SIZE> buffer{};
+	};
+}
@@ -60,6 +60,7 @@ namespace glplay::drm {
 	},
 	{ .name = "CRTC_ID", },
 	{ .name = "non-desktop", },
+	{ .name = "vrr_capable", },
 };
 
 
@@ -67,6 +68,7 @@ namespace glplay::drm {
 	  { .name = "MODE_ID", },
 	  { .name = "ACTIVE", },
 	  { .name = "OUT_FENCE_PTR", },
+	  { .name = "VRR_ENABLED", },
   };
 
   static const std::vector<drm_property_info> plane_props {
@@ -116,6 +118,7 @@ enum wdrm_crtc_property {
 	WDRM_CRTC_MODE_ID = 0,
 	WDRM_CRTC_ACTIVE,
 	WDRM_CRTC_OUT_FENCE_PTR,
+	WDRM_CRTC_VRR_ENABLED,
 	WDRM_CRTC_COUNT
 };
 
@@ -127,6 +130,7 @@ enum wdrm_connector_property {
 	WDRM_CONNECTOR_DPMS,
 	WDRM_CONNECTOR_CRTC_ID,
 	WDRM_CONNECTOR_NON_DESKTOP,
+	WDRM_CONNECTOR_VRR_CAPABLE,
 	WDRM_CONNECTOR_COUNT
 };
 
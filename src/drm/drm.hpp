@@ -17,6 +17,7 @@
 #include "Encoder.hpp"
 #include "PlaneResources.hpp"
 #include "Resources.hpp"
+#include "Events.hpp"
 
 namespace glplay::drm {
 
@@ -70,6 +70,8 @@ namespace glplay::egl {
         error("GL_OES_EGL_sync not supported\n");
         eglDestroyContext(egl_dpy, ctx);
       }
+
+      gpu_timers = gl_extension_supported(exts_with_display, "GL_EXT_disjoint_timer_query");
     } else {
       const GLubyte *ext;
       bool found_image = false;
@@ -84,6 +86,8 @@ namespace glplay::egl {
           found_image = true;
         } else if (strcmp(reinterpret_cast<const char *>(ext), "GL_OES_EGL_sync") == 0) {
           found_sync = true;
+        } else if (strcmp(reinterpret_cast<const char *>(ext), "GL_ARB_timer_query") == 0) {
+          gpu_timers = true;
         }
       }
 
@@ -98,6 +102,9 @@ namespace glplay::egl {
       }
     }
 
+    gpu_timers = gpu_timers && GpuTimer::loadEntryPoints(gl_core);
+    debug("%susing GPU timer queries\n", (gpu_timers) ? "" : "not ");
+
     printf("using GL setup: \n"
 		"   renderer '%s'\n"
 		"   vendor '%s'\n"
@@ -129,17 +136,21 @@ namespace glplay::egl {
     col_uniform = glGetUniformLocation(gl_prog, "u_col");
     glUseProgram(gl_prog);
 
-    glGenBuffers(1, &vbo);
-    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    initializeVertexState(vbo, vao);
+  }
+
+  void EGLDevice::initializeVertexState(GLuint &vertexBuffer, GLuint &vertexArray) const {
+    glGenBuffers(1, &vertexBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
     glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * 8, nullptr, GL_DYNAMIC_DRAW);
     glBindBuffer(GL_ARRAY_BUFFER, 0);
 
     // TODO: Do this properly.
 #ifdef GLES3
-    glGenVertexArrays(1, &vao);
-    glBindVertexArray(vao);
+    glGenVertexArrays(1, &vertexArray);
+    glBindVertexArray(vertexArray);
 
-    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
 
     glVertexAttribPointer(pos_attr, 2, GL_FLOAT, GL_FALSE, 0, (char*)nullptr);
     glEnableVertexAttribArray(0);
@@ -149,6 +160,58 @@ namespace glplay::egl {
 #endif
   }
 
+  auto EGLDevice::deviceRenderContext() const -> RenderContext {
+    RenderContext rctx;
+    rctx.ctx = ctx;
+    rctx.vbo = vbo;
+    rctx.vao = vao;
+    return rctx;
+  }
+
+  auto EGLDevice::createSharedContext() -> RenderContext {
+    RenderContext rctx;
+
+    /*
+    * Sharing with the device context gives us the buffers' textures and
+    * our shader program; everything else is created on first bind.
+    */
+    rctx.ctx = initializeContext(egl_dpy, cfg, gl_core, ctx);
+    if (rctx.ctx == EGL_NO_CONTEXT) {
+      throw std::runtime_error("Failed to create shared egl context");
+    }
+    rctx.shared = true;
+    return rctx;
+  }
+
+  void EGLDevice::bindRenderContext(RenderContext &rctx) {
+    EGLBoolean ret = eglMakeCurrent(egl_dpy, EGL_NO_SURFACE, EGL_NO_SURFACE, rctx.ctx);
+    assert(ret);
+
+    if (rctx.shared && rctx.vbo == 0) {
+      /* The current program is per-context state, even if shared. */
+      glUseProgram(gl_prog);
+      initializeVertexState(rctx.vbo, rctx.vao);
+    }
+  }
+
+  void EGLDevice::destroySharedContext(RenderContext &rctx) {
+    assert(rctx.shared);
+
+    if (eglGetCurrentContext() == rctx.ctx) {
+      for (auto &entry : rctx.framebuffers) {
+        glDeleteFramebuffers(1, &entry.second);
+      }
+#ifdef GLES3
+      glDeleteVertexArrays(1, &rctx.vao);
+#endif
+      glDeleteBuffers(1, &rctx.vbo);
+      eglMakeCurrent(egl_dpy, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    }
+    rctx.framebuffers.clear();
+    eglDestroyContext(egl_dpy, rctx.ctx);
+    rctx.ctx = EGL_NO_CONTEXT;
+  }
+
   auto EGLDevice::initializeDisplay(gbm::GBMDevice &gbmDevice) -> EGLDisplay {
     EGLDisplay egl_display = nullptr;
     // Get supported extensions without considering a display
@@ -218,7 +281,7 @@ namespace glplay::egl {
 
   }
 
-  auto EGLDevice::initializeContext(EGLDisplay display, EGLConfig config, bool glCore) -> EGLContext {
+  auto EGLDevice::initializeContext(EGLDisplay display, EGLConfig config, bool glCore, EGLContext share) -> EGLContext {
     const char *exts = eglQueryString(display, EGL_EXTENSIONS);
     EGLBoolean err = 0;
     EGLContext ret = nullptr;
@@ -254,7 +317,7 @@ namespace glplay::egl {
       attribs[nattribs++] = EGL_CONTEXT_PRIORITY_HIGH_IMG;
 
       ret = eglCreateContext(display, config,
-                EGL_NO_CONTEXT, attribs);
+                share, attribs);
       if (ret != nullptr) {
         return ret;
       }
@@ -266,7 +329,7 @@ namespace glplay::egl {
     }
 
     ret = eglCreateContext(display, config,
-              EGL_NO_CONTEXT, attribs);
+              share, attribs);
     if (ret != nullptr) {
       return ret;
     }
@@ -277,7 +340,7 @@ namespace glplay::egl {
         *attrib_version = 2;
         /* As a last-ditch attempt, try an ES2 context. */
         ret = eglCreateContext(display, config,
-            EGL_NO_CONTEXT, attribs);
+            share, attribs);
         if (ret != nullptr) {
           return ret;
         }
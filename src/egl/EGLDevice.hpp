@@ -20,6 +20,8 @@
 #include "../../third-party/gsl/gsl"
 #include "../nix/nix.hpp"
 #include "utils.hpp"
+#include "RenderContext.hpp"
+#include "GpuTimer.hpp"
 
 #ifndef EGL_KHR_platform_gbm
 #define EGL_KHR_platform_gbm 1
@@ -91,6 +93,20 @@ namespace glplay::egl {
       GLuint gl_prog;
       GLuint pos_attr;
       bool explicit_fencing;
+      /* Whether GpuTimer can time frames on this device's contexts. */
+      bool gpu_timers = false;
+
+      /* The device context and its objects, as used by the main thread. */
+      auto deviceRenderContext() const -> RenderContext;
+      /* A new context sharing objects with ctx, for use on another thread. */
+      auto createSharedContext() -> RenderContext;
+      /*
+      * Makes the context current on the calling thread, creating its
+      * per-context objects the first time a shared context is bound.
+      */
+      void bindRenderContext(RenderContext &rctx);
+      /* Releases a shared context; must be called on the thread using it. */
+      void destroySharedContext(RenderContext &rctx);
 
     private:
       bool fb_modifiers;
@@ -101,7 +117,8 @@ namespace glplay::egl {
 
       static auto initializeDisplay(gbm::GBMDevice &gbmDevice) -> EGLDisplay;
       static auto initializeConfig(EGLDisplay display) -> EGLConfig;
-      static auto initializeContext(EGLDisplay display, EGLConfig config, bool glCore) -> EGLContext;
+      static auto initializeContext(EGLDisplay display, EGLConfig config, bool glCore, EGLContext share = EGL_NO_CONTEXT) -> EGLContext;
       static auto initializeShader(GLuint program, const char *source, GLenum shader_type) -> GLuint;
+      void initializeVertexState(GLuint &vertexBuffer, GLuint &vertexArray) const;
 	};
 }
\ No newline at end of file
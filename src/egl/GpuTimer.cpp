@@ -0,0 +1,216 @@
+#include "GpuTimer.hpp"
+
+#include <cstdio>
+#include <ctime>
+#include <utility>
+
+#include <EGL/egl.h>
+#include <GLES2/gl2ext.h>
+
+#include "../nix/log.hpp"
+
+namespace glplay::egl {
+
+  namespace {
+
+    /*
+    * Both extensions have the same entry points, but GL_ARB_timer_query's
+    * are core desktop GL, without the suffix.
+    */
+    PFNGLQUERYCOUNTEREXTPROC queryCounter = nullptr;
+    PFNGLGETQUERYOBJECTUI64VEXTPROC getQueryObjectui64v = nullptr;
+    /* Whether timestamps can be taken, not just elapsed time. */
+    bool haveTimestamps = false;
+    /* Only GLES tells us when the GPU's clock may have jumped. */
+    bool checkDisjoint = false;
+
+    /* Results pile up here if nobody takes them; don't let them grow forever. */
+    const size_t MAX_RESULTS = 64;
+
+    auto monotonicNsec() -> int64_t {
+      struct timespec now{};
+      clock_gettime(CLOCK_MONOTONIC, &now);
+      return (now.tv_sec * 1000000000LL) + now.tv_nsec;
+    }
+
+  }
+
+  auto GpuTimer::loadEntryPoints(bool glCore) -> bool {
+    if (getQueryObjectui64v != nullptr) {
+      return true;
+    }
+
+    queryCounter = reinterpret_cast<PFNGLQUERYCOUNTEREXTPROC>(
+      eglGetProcAddress(glCore ? "glQueryCounter" : "glQueryCounterEXT"));
+    getQueryObjectui64v = reinterpret_cast<PFNGLGETQUERYOBJECTUI64VEXTPROC>(
+      eglGetProcAddress(glCore ? "glGetQueryObjectui64v" : "glGetQueryObjectui64vEXT"));
+    if (getQueryObjectui64v == nullptr) {
+      return false;
+    }
+
+    /* Implementations may give timestamps no bits at all. */
+    GLint bits = 0;
+    if (queryCounter != nullptr) {
+      glGetQueryiv(GL_TIMESTAMP_EXT, GL_QUERY_COUNTER_BITS_EXT, &bits);
+    }
+    haveTimestamps = bits > 0;
+    checkDisjoint = !glCore;
+    debug("GPU timer queries: %s\n", haveTimestamps ? "timestamps" : "elapsed time only");
+    return true;
+  }
+
+  void GpuTimer::begin(int64_t tag) {
+    if (!enabled || !useCurrentContext()) {
+      return;
+    }
+    if (!created) {
+      for (auto &slot : slots) {
+        glGenQueries(static_cast<GLsizei>(slot.queries.size()), slot.queries.data());
+      }
+      created = true;
+    }
+
+    auto &slot = slots.at(next);
+    if (slot.pending) {
+      collect();
+    }
+    if (slot.pending) {
+      skipped++;
+      return;
+    }
+
+    slot.tag = tag;
+    if (haveTimestamps) {
+      queryCounter(slot.queries[0], GL_TIMESTAMP_EXT);
+    } else {
+      glBeginQuery(GL_TIME_ELAPSED_EXT, slot.queries[0]);
+    }
+    running = true;
+  }
+
+  void GpuTimer::end() {
+    if (!running) {
+      return;
+    }
+
+    auto &slot = slots.at(next);
+    if (haveTimestamps) {
+      queryCounter(slot.queries[1], GL_TIMESTAMP_EXT);
+    } else {
+      glEndQuery(GL_TIME_ELAPSED_EXT);
+    }
+    slot.pending = true;
+    running = false;
+    next = (next + 1) % QUERY_FRAMES;
+  }
+
+  void GpuTimer::collect() {
+    if (!enabled || !created || !useCurrentContext()) {
+      return;
+    }
+
+    auto now = monotonicNsec();
+    if (haveTimestamps && (syncedAtNsec == 0 || now - syncedAtNsec >= RESYNC_NSEC)) {
+      syncClocks(now);
+    }
+
+    auto first = results.size();
+    while (slots.at(oldest).pending) {
+      auto &slot = slots.at(oldest);
+      GLuint available = 0;
+      glGetQueryObjectuiv(slot.queries[haveTimestamps ? 1 : 0], GL_QUERY_RESULT_AVAILABLE, &available);
+      if (available == 0) {
+        break;
+      }
+
+      Result result;
+      result.tag = slot.tag;
+      if (haveTimestamps) {
+        GLuint64 start = 0;
+        GLuint64 end = 0;
+        getQueryObjectui64v(slot.queries[0], GL_QUERY_RESULT, &start);
+        getQueryObjectui64v(slot.queries[1], GL_QUERY_RESULT, &end);
+        result.startNsec = static_cast<int64_t>(start) + clockOffsetNsec;
+        result.endNsec = static_cast<int64_t>(end) + clockOffsetNsec;
+        result.gpuNsec = static_cast<int64_t>(end - start);
+      } else {
+        GLuint64 elapsed = 0;
+        getQueryObjectui64v(slot.queries[0], GL_QUERY_RESULT, &elapsed);
+        result.gpuNsec = static_cast<int64_t>(elapsed);
+      }
+      results.push_back(result);
+      slot.pending = false;
+      oldest = (oldest + 1) % QUERY_FRAMES;
+    }
+
+    /*
+    * A disjoint operation, such as the GPU's clock changing or a reset,
+    * makes what we just read meaningless, and our clock offset stale.
+    */
+    if (checkDisjoint) {
+      GLint disjoint = 0;
+      glGetIntegerv(GL_GPU_DISJOINT_EXT, &disjoint);
+      if (disjoint != 0) {
+        skipped += results.size() - first;
+        results.resize(first);
+        syncedAtNsec = 0;
+      }
+    }
+
+    if (results.size() > MAX_RESULTS) {
+      skipped += results.size() - MAX_RESULTS;
+      results.erase(results.begin(), results.end() - MAX_RESULTS);
+    }
+  }
+
+  auto GpuTimer::takeResults() -> std::vector<Result> {
+    return std::exchange(results, {});
+  }
+
+  /*
+  * Query names mean nothing in another context, so when we find a
+  * different one current, forget the old queries, and anything pending on
+  * them, and make new ones in this one. The old ones can't be deleted
+  * without their context current; they go when it does.
+  */
+  auto GpuTimer::useCurrentContext() -> bool {
+    auto current = eglGetCurrentContext();
+    if (current == EGL_NO_CONTEXT) {
+      return false;
+    }
+    if (current == context) {
+      return true;
+    }
+
+    if (context != EGL_NO_CONTEXT) {
+      for (auto &slot : slots) {
+        if (slot.pending) {
+          skipped++;
+        }
+        slot = {};
+      }
+      debug("GPU timer queries moved to another context\n");
+    }
+    context = current;
+    created = false;
+    running = false;
+    next = 0;
+    oldest = 0;
+    syncedAtNsec = 0;
+    return true;
+  }
+
+  /*
+  * Takes the offset between the GPU's clock and CLOCK_MONOTONIC, reading
+  * the GPU's halfway between two readings of ours.
+  */
+  void GpuTimer::syncClocks(int64_t nowNsec) {
+    GLint64 gpu = 0;
+    auto before = monotonicNsec();
+    glGetInteger64v(GL_TIMESTAMP_EXT, &gpu);
+    auto after = monotonicNsec();
+    clockOffsetNsec = before + ((after - before) / 2) - gpu;
+    syncedAtNsec = nowNsec;
+  }
+
+}
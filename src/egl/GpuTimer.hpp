@@ -0,0 +1,108 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <EGL/egl.h>
+#include <GLES3/gl3.h>
+
+namespace glplay::egl {
+
+  /*
+  * Measures how long the GPU spends on a display's frames, with timer
+  * queries: GL_EXT_disjoint_timer_query on GLES, GL_ARB_timer_query on
+  * desktop GL.
+  *
+  * glFlush returns as soon as the commands are on their way, so the CPU
+  * can't time GPU work itself; instead the GPU writes a timestamp into a
+  * query object before and after a frame's commands, and we pick the
+  * results up a few frames later, once they are there, without ever
+  * waiting for them. The timestamps are put on CLOCK_MONOTONIC by
+  * sampling the GPU clock against ours now and then.
+  *
+  * Drivers without timestamp queries still get the frame's GPU time, from
+  * a GL_TIME_ELAPSED query, but not when it ran.
+  *
+  * Query objects belong to the context they were made in. If a display's
+  * frames move to another context, as they do to its render thread's
+  * after the first frame, the queries are made again in that one, and
+  * whatever was pending in the old one is dropped.
+  */
+  class GpuTimer {
+    public:
+      /* Frames whose results may be outstanding at once. */
+      static const size_t QUERY_FRAMES = 8;
+      /* How often to take the GPU clock's offset from ours again. */
+      static const int64_t RESYNC_NSEC = 1000000000;
+
+      struct Result {
+        /* As passed to begin(). */
+        int64_t tag = 0;
+        /* When the GPU started and finished, on CLOCK_MONOTONIC; 0 if unknown. */
+        int64_t startNsec = 0;
+        int64_t endNsec = 0;
+        int64_t gpuNsec = 0;
+      };
+
+      /*
+      * Looks up the query entry points, once per process; returns false
+      * if the context lacks them. Needs a context current.
+      */
+      static auto loadEntryPoints(bool glCore) -> bool;
+
+      /* Times frames from now on, if loadEntryPoints() succeeded. */
+      void enable(bool supported) { enabled = supported; }
+      [[nodiscard]] auto isEnabled() const -> bool { return enabled; }
+
+      /*
+      * Brackets one frame's GL commands, identified by 'tag'. Frames are
+      * not timed while every query slot is still waiting on its result.
+      */
+      void begin(int64_t tag);
+      void end();
+
+      /*
+      * Picks up every result the GPU has finished writing, oldest first,
+      * without waiting for any, and keeps them for takeResults().
+      */
+      void collect();
+
+      /*
+      * Hands over the results collected so far. Unlike the calls above,
+      * this needs no context current.
+      */
+      auto takeResults() -> std::vector<Result>;
+
+      /* Frames we had no free slot for, or whose results were lost. */
+      [[nodiscard]] auto framesSkipped() const -> uint64_t { return skipped; }
+
+    private:
+      struct Slot {
+        std::array<GLuint, 2> queries{};
+        int64_t tag = 0;
+        bool pending = false;
+      };
+
+      void syncClocks(int64_t nowNsec);
+      /* Whether our queries belong to the current context, after making sure they do. */
+      auto useCurrentContext() -> bool;
+
+      bool enabled = false;
+      bool created = false;
+      /* The context the queries were made in. */
+      EGLContext context = EGL_NO_CONTEXT;
+      std::array<Slot, QUERY_FRAMES> slots{};
+      /* Next slot to start, and the oldest still pending. */
+      size_t next = 0;
+      size_t oldest = 0;
+      bool running = false;
+      /* CLOCK_MONOTONIC less GPU time, in nanoseconds. */
+      int64_t clockOffsetNsec = 0;
+      int64_t syncedAtNsec = 0;
+      std::vector<Result> results;
+      uint64_t skipped = 0;
+  };
+
+}
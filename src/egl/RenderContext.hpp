@@ -0,0 +1,82 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <map>
+
+#include <EGL/egl.h>
+#include <GLES3/gl3.h>
+
+namespace glplay::egl {
+
+  /*
+  * Everything one thread needs to render with its own EGL context.
+  *
+  * Contexts created against the device context share textures, buffers and
+  * programs with it, but container objects (framebuffers and vertex arrays)
+  * are per-context, and each thread streams its own vertices so it needs its
+  * own vertex buffer too.
+  */
+  struct RenderContext {
+    EGLContext ctx = EGL_NO_CONTEXT;
+    GLuint vbo = 0;
+    GLuint vao = 0;
+
+    /*
+    * Whether this is a shared context rather than the device context; if
+    * so, it has to wrap the buffers' textures in framebuffers of its own.
+    */
+    bool shared = false;
+
+    /* Framebuffers created in this context, keyed by the texture they wrap. */
+    std::map<GLuint, GLuint> framebuffers;
+
+    /* Must be called with this context current. */
+    auto framebufferFor(GLuint texture) -> GLuint {
+      auto found = framebuffers.find(texture);
+      if (found != framebuffers.end()) {
+        return found->second;
+      }
+
+      GLuint fbo = 0;
+      glGenFramebuffers(1, &fbo);
+      glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+      glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
+      assert(glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE);
+      framebuffers.emplace(texture, fbo);
+      return fbo;
+    }
+
+    /*
+    * An offscreen target for frames rendered at reduced resolution which
+    * the GPU then scales up into the buffer, for when the plane can't.
+    * It grows to the largest size asked for.
+    */
+    GLuint scratchTexture = 0;
+    GLuint scratchFramebuffer = 0;
+    GLsizei scratchWidth = 0;
+    GLsizei scratchHeight = 0;
+
+    /* Must be called with this context current. */
+    auto scratchFor(GLsizei width, GLsizei height) -> GLuint {
+      if (width <= scratchWidth && height <= scratchHeight) {
+        return scratchFramebuffer;
+      }
+
+      if (scratchTexture == 0) {
+        glGenTextures(1, &scratchTexture);
+        glGenFramebuffers(1, &scratchFramebuffer);
+      }
+      scratchWidth = std::max(width, scratchWidth);
+      scratchHeight = std::max(height, scratchHeight);
+      glBindTexture(GL_TEXTURE_2D, scratchTexture);
+      glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, scratchWidth, scratchHeight, 0,
+                   GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+      glBindTexture(GL_TEXTURE_2D, 0);
+      glBindFramebuffer(GL_FRAMEBUFFER, scratchFramebuffer);
+      glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, scratchTexture, 0);
+      assert(glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE);
+      return scratchFramebuffer;
+    }
+  };
+}
@@ -1,4 +1,5 @@
 #pragma once
 
 #include "EGLDevice.hpp"
-
+#include "RenderContext.hpp"
+#include "GpuTimer.hpp"
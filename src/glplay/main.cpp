@@ -6,6 +6,7 @@
 #include <GLES3/gl3.h>
 
 #include <algorithm>
+#include <array>
 #include <cstdio>
 #include <iostream>
 #include <signal.h>
@@ -65,6 +66,25 @@ linux_sync_file_get_fence_time(int fd)
 }
 
 
+/* A sync_file FD becomes readable once its fences have signalled. */
+static bool
+linux_sync_file_is_signalled(int fd)
+{
+	struct pollfd poll_fd = { .fd = fd, .events = POLLIN, .revents = 0 };
+
+	return poll(&poll_fd, 1, 0) == 1;
+}
+
+
+static int64_t
+monotonic_nsec(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return glplay::kms::timespec_to_nsec(&now);
+}
+
 static void
 fd_replace(int *target, int source)
 {
@@ -73,6 +93,87 @@ fd_replace(int *target, int source)
 	*target = source;
 }
 
+/*
+ * CRTC sequence events only carry a 64-bit cookie, which we use for the CRTC
+ * ID, so their handler finds the adapter here.
+ */
+static glplay::kms::DisplayAdapter *event_adapter = nullptr;
+
+/* When poll last returned, for measuring our wakeup latency. */
+static struct timespec poll_woken_at;
+
+/*
+ * Our animation changes every frame, so as soon as we paint a frame the
+ * output's content is out of date again. With GLPLAY_STATIC_CONTENT, it only
+ * moves on when we receive SIGUSR1, standing in for whatever external
+ * source would change what a signage screen shows; in between, outputs go
+ * idle and we sleep in poll.
+ */
+static bool animate = true;
+static volatile sig_atomic_t content_invalidated = 0;
+static glplay::nix::EventFD *signal_wakeup = nullptr;
+
+/* With GLPLAY_TRACE, SIGUSR2 writes out the trace so far. */
+static volatile sig_atomic_t trace_requested = 0;
+
+/*
+ * With GLPLAY_COROUTINES, each output's frame loop is a coroutine which
+ * waits on its entry here for anything that might give it work to do.
+ */
+static std::vector<std::unique_ptr<glplay::nix::AsyncEvent>> frame_events;
+
+static void output_wake(glplay::kms::DisplayAdapter *adapter, glplay::kms::Display &display)
+{
+	if (!frame_events.empty())
+		frame_events[&display - adapter->displays.data()]->set();
+}
+
+/*
+ * Find the output events for the given CRTC are delivered for. With render
+ * threads, the output's thread may still be finishing off the commit the
+ * event is for, so we also take its lock.
+ */
+static glplay::kms::Display *
+find_display_locked(glplay::kms::DisplayAdapter *adapter, uint32_t crtc_id,
+		    std::unique_lock<std::mutex> *lock)
+{
+	auto idx = adapter->displayIndexForCrtc(crtc_id);
+
+	if (idx < 0)
+		return nullptr;
+	if (!adapter->renderThreads.empty())
+		*lock = adapter->renderThreads[idx]->lockDisplay();
+	return &adapter->displays[idx];
+}
+
+/*
+ * Hand out the GPU timings which have come in since the last flip. They
+ * are for frames a few frames back, which are on screen by now and in the
+ * stage timeline; any which aren't yet get them when they are.
+ */
+static void display_gpu_timed(glplay::kms::DisplayAdapter *adapter, glplay::kms::Display *display)
+{
+	auto idx = static_cast<size_t>(display - adapter->displays.data());
+
+	for (const auto &result : display->gpuTimer.takeResults()) {
+		display->gpuTime.add(result.gpuNsec);
+		display->gpuBudget.addSample(result.gpuNsec);
+		display->hud.gpuTimed(result.gpuNsec);
+		adapter->stats.gpuTimed(idx, result.gpuNsec);
+		glplay::nix::traceCounter("GPU time", result.gpuNsec);
+
+		if (result.startNsec == 0 ||
+		    display->stages.gpuTimed(result.tag, result.startNsec, result.endNsec))
+			continue;
+		for (auto &buffer : display->buffers) {
+			if (buffer.render_start_nsec == result.tag) {
+				buffer.gpu_start_nsec = result.startNsec;
+				buffer.gpu_end_nsec = result.endNsec;
+			}
+		}
+	}
+}
+
 /*
  * Informs us that an atomic commit has completed for the given CRTC. This will
  * be called onence for each output (identified by the crtc_id) for each commit.
@@ -87,29 +188,17 @@ fd_replace(int *target, int source)
  * these times will be given as CLOCK_MONOTONIC values. If not (e.g. VMware),
  * all bets are off.
  */
-static void atomic_event_handler(int fd,
-	unsigned int sequence,
-	unsigned int tv_sec,
-	unsigned int tv_usec,
-	unsigned int crtc_id,
-	void *user_data)
+static void output_flip_completed(glplay::kms::DisplayAdapter *adapter, uint32_t crtc_id,
+				  unsigned int sequence, struct timespec completion)
 {
-	auto *adapter = static_cast<glplay::kms::DisplayAdapter*>(user_data);
-	glplay::kms::Display *display = nullptr;
-	struct timespec completion = {
-		.tv_sec = static_cast<__syscall_slong_t>(tv_sec),
-		.tv_nsec = static_cast<__syscall_slong_t>((tv_usec * 1000)),
-	};
 	int64_t delta_nsec;
+	uint64_t render_done_nsec = 0;
+	uint64_t kms_fence_nsec = 0;
 
-	/* Find the output this event is delivered for. */
-	for (auto &disp : adapter->displays) {
-		if(disp.crtc->crtc_id == crtc_id) {
-			display = &disp;
-			break;
-		}
-	}
+	std::unique_lock<std::mutex> display_lock;
+	auto *display = find_display_locked(adapter, crtc_id, &display_lock);
 
+	glplay::nix::traceInstant("flip", crtc_id);
 	if(!display) {
 		debug("[CRTC:%u] received atomic completion for unknown CRTC",
 		      crtc_id);
@@ -120,15 +209,29 @@ static void atomic_event_handler(int fd,
 	 * Compare the actual completion timestamp to what we had predicted it
 	 * would be when we submitted it.
 	 *
-	 * This example simply screams into the logs if we hit a different
-	 * time from what we had predicted. However, there are a number of
-	 * things you could do to better deal with this: for example, if your
-	 * frame is always late, you need to either start drawing earlier, or
-	 * if that is not possible, halve your frame rate so you can draw
-	 * steadily and predictably, if more slowly.
+	 * If our frames keep arriving late, the pacing governor will halve
+	 * (or third) our frame rate so we can draw steadily and predictably,
+	 * if more slowly; once we have had a long run of frames on time and
+	 * our repaint cost would fit, it will speed us back up.
 	 */
 	delta_nsec = glplay::kms::timespec_sub_to_nsec(&completion, &display->next_frame);
-	if (glplay::kms::timespec_to_nsec(&display->last_frame) != 0 &&
+	if (display->presented && !display->asyncFlip &&
+	    display->pacing.frameCompleted(delta_nsec > FRAME_TIMING_TOLERANCE,
+					   adapter->scheduler.repaintMargin(*display),
+					   display->refreshIntervalNsec)) {
+		debug("[%s] pacing at 1/%u of refresh rate\n",
+		      display->name.c_str(), display->pacing.divisor());
+	}
+	if (display->presented)
+		adapter->stats.framePresented(static_cast<size_t>(adapter->displayIndexForCrtc(crtc_id)),
+					      sequence, completion, display->next_frame,
+					      display->vblankPeriodNsec(), FRAME_TIMING_TOLERANCE);
+	if (display->syncGroup >= 0)
+		adapter->syncGroups[display->syncGroup].frameCompleted(*display, completion);
+	if (display->presented && !display->asyncFlip)
+		glplay::kms::DeadlineScheduler::frameCompleted(*display,
+							       delta_nsec > FRAME_TIMING_TOLERANCE);
+	if (display->presented &&
 		llabs((long long) delta_nsec) > FRAME_TIMING_TOLERANCE) {
 		debug("[%s] FRAME %" PRIi64 "ns %s: expected %" PRIu64 ", got %" PRIu64 "\n",
 		      display->name.c_str(),
@@ -143,8 +246,18 @@ static void atomic_event_handler(int fd,
 					delta_nsec);
 	}
 
-	display->needs_repaint = true;
+	display->wakeupLatency.add(glplay::kms::timespec_sub_to_nsec(&poll_woken_at, &completion));
+	if (display->presented)
+		display->flipLatency.add(glplay::kms::timespec_sub_to_nsec(&completion,
+									   &display->committed_at));
+
+	/* Async flips complete whenever they land, not on a vblank. */
+	if (!display->asyncFlip)
+		glplay::kms::VblankTracker::record(*display, sequence,
+						   glplay::kms::timespec_to_nsec(&completion));
 	display->last_frame = completion;
+	display->presented = true;
+	display->framePresented(sequence, completion);
 
 	/*
 	* buffer_pending is the buffer we've just committed; this event tells
@@ -163,8 +276,8 @@ static void atomic_event_handler(int fd,
 		if (display->bufferLast &&
 		    display->bufferLast->kms_fence_fd >= 0) {
 			assert(linux_sync_file_is_valid(display->bufferLast->kms_fence_fd));
-			debug("\tKMS fence time: %" PRIu64 "ns\n",
-			      linux_sync_file_get_fence_time(display->bufferLast->kms_fence_fd));
+			kms_fence_nsec = linux_sync_file_get_fence_time(display->bufferLast->kms_fence_fd);
+			debug("\tKMS fence time: %" PRIu64 "ns\n", kms_fence_nsec);
 		}
 
 		/*
@@ -174,10 +287,34 @@ static void atomic_event_handler(int fd,
 		* time.
 		*/
 		assert(linux_sync_file_is_valid(display->bufferPending->render_fence_fd));
-		debug("\trender fence time: %" PRIu64 "ns\n",
-		      linux_sync_file_get_fence_time(display->bufferPending->render_fence_fd));
+		render_done_nsec =
+			linux_sync_file_get_fence_time(display->bufferPending->render_fence_fd);
+		debug("\trender fence time: %" PRIu64 "ns\n", render_done_nsec);
 	}
 
+	/*
+	 * Keep the timestamps of the frame now on screen, from when we
+	 * started painting it until now, to tell where its time went.
+	 */
+	if (display->presented) {
+		glplay::kms::FrameRecord frame;
+
+		frame.set(glplay::kms::FrameStage::RenderStart, display->bufferPending->render_start_nsec);
+		frame.set(glplay::kms::FrameStage::Flush, display->bufferPending->flush_nsec);
+		frame.set(glplay::kms::FrameStage::GpuStart, display->bufferPending->gpu_start_nsec);
+		frame.set(glplay::kms::FrameStage::GpuEnd, display->bufferPending->gpu_end_nsec);
+		frame.set(glplay::kms::FrameStage::RenderDone, (int64_t) render_done_nsec);
+		frame.set(glplay::kms::FrameStage::Commit,
+			  glplay::kms::timespec_to_nsec(&display->committed_at));
+		frame.set(glplay::kms::FrameStage::KmsFence, (int64_t) kms_fence_nsec);
+		frame.set(glplay::kms::FrameStage::Flip, glplay::kms::timespec_to_nsec(&completion));
+		frame.late = !display->asyncFlip && delta_nsec > FRAME_TIMING_TOLERANCE;
+		display->stages.record(frame);
+		display->hud.frameCompleted(frame, display->frameIntervalNsec());
+	}
+	display->hud.flipped();
+	display_gpu_timed(adapter, display);
+
 	if (display->bufferLast) {
 		assert(display->bufferLast->in_use);
 		debug("\treleasing buffer with FB ID %" PRIu32 "\n", display->bufferLast->fb_id);
@@ -187,47 +324,269 @@ static void atomic_event_handler(int fd,
 	display->bufferLast = display->bufferPending;
 	display->bufferPending = NULL;
 
+	/*
+	 * With dynamic resolution, let the governor trade pixels for time,
+	 * going by how long this frame took from when we started painting it
+	 * until its render fence signalled (or, without fences, until we
+	 * committed it). With timer queries, it goes by what the GPU actually
+	 * spent, newest first, on top of our time issuing the commands, so
+	 * time queued behind other displays' frames doesn't count. Rendering
+	 * ahead, we don't know which repaint that was.
+	 */
+	if (display->resolution.enabled() && !display->firstFrame &&
+	    display->presentQueueDepth == 0) {
+		auto render_nsec = display->repaintCpuNsec;
+		if (display->gpuBudget.sampleCount() > 0 && display->bufferLast &&
+		    display->bufferLast->flush_nsec != 0)
+			render_nsec = display->bufferLast->flush_nsec -
+				display->bufferLast->render_start_nsec +
+				(display->bufferLast->gpu_end_nsec != 0 ?
+				 display->bufferLast->gpu_end_nsec - display->bufferLast->gpu_start_nsec :
+				 display->gpuBudget.last());
+		else if (render_done_nsec != 0)
+			render_nsec = (int64_t) render_done_nsec -
+				(int64_t) glplay::kms::timespec_to_nsec(&display->repaint_start);
+		if (display->resolution.frameCompleted(render_nsec, display->frameIntervalNsec()))
+			debug("[%s] dynamic resolution scale %.3f\n",
+			      display->name.c_str(), display->resolution.scale());
+	}
+
+	/*
+	 * Rather than repainting straight away, let the scheduler decide how
+	 * close to the next vblank we can leave it, or whether to repaint at
+	 * all.
+	 */
+	adapter->scheduler.frameCompleted(*display, render_done_nsec);
+	output_wake(adapter, *display);
+}
+
+/*
+ * Events queued with drmCrtcQueueSequence, for outputs we have no commit in
+ * flight for; these only keep our idea of the output's vblank timing fresh.
+ */
+static void output_vblank_event(glplay::kms::DisplayAdapter *adapter, uint32_t crtc_id,
+				uint64_t sequence, uint64_t ns)
+{
+	std::unique_lock<std::mutex> display_lock;
+	auto *display = find_display_locked(adapter, crtc_id, &display_lock);
+
+	if (!display)
+		return;
+
+	debug("[%s] vblank %" PRIu64 " at %" PRIu64 "\n", display->name.c_str(), sequence, ns);
+	glplay::kms::VblankTracker::eventReceived(*display, sequence, ns);
+	output_wake(adapter, *display);
+}
+
+/*
+ * KMS events as our EventReader decodes them; we queue CRTC sequence events
+ * with the CRTC ID as their cookie, and commits with the adapter.
+ */
+struct kms_event_handler {
+	glplay::kms::DisplayAdapter *adapter;
+
+	void flipComplete(uint32_t crtc_id, uint32_t sequence, const struct timespec &time,
+			  uint64_t user_data)
+	{
+		output_flip_completed(adapter, crtc_id, sequence, time);
+	}
+
+	void vblank(uint32_t crtc_id, uint32_t sequence, const struct timespec &time,
+		    uint64_t user_data)
+	{
+		output_vblank_event(adapter, crtc_id, sequence, glplay::kms::timespec_to_nsec(&time));
+	}
+
+	void crtcSequence(uint64_t user_data, uint64_t sequence, int64_t ns)
+	{
+		output_vblank_event(adapter, static_cast<uint32_t>(user_data), sequence, ns);
+	}
+};
+
+/*
+ * The same events through libdrm's drmHandleEvent, with GLPLAY_LIBDRM_EVENTS
+ * set, for comparison.
+ */
+static void atomic_event_handler(int fd, unsigned int sequence, unsigned int tv_sec,
+				 unsigned int tv_usec, unsigned int crtc_id, void *user_data)
+{
+	struct timespec completion = {
+		.tv_sec = static_cast<__syscall_slong_t>(tv_sec),
+		.tv_nsec = static_cast<__syscall_slong_t>((tv_usec * 1000)),
+	};
+
+	output_flip_completed(static_cast<glplay::kms::DisplayAdapter *>(user_data),
+			      crtc_id, sequence, completion);
+}
+
+static void sequence_event_handler(int fd, uint64_t sequence, uint64_t ns,
+				   uint64_t user_data)
+{
+	output_vblank_event(event_adapter, static_cast<uint32_t>(user_data), sequence, ns);
+}
+
+static drmEventContext evctx = {
+	.version = 4,
+	.page_flip_handler2 = atomic_event_handler,
+	.sequence_handler = sequence_event_handler,
+};
+
+/*
+ * Whether the output's last known vblank is too old to predict from, e.g.
+ * after it has been idle for a while.
+ */
+static bool output_timing_stale(const glplay::kms::Display &display,
+				const struct timespec *now)
+{
+	const struct timespec *base = &display.last_frame;
+
+	if (glplay::kms::timespec_sub_to_nsec(&display.last_vblank, base) > 0)
+		base = &display.last_vblank;
+	return glplay::kms::timespec_sub_to_nsec(now, base) > 2 * display.frameIntervalNsec();
 }
 
 /*
  * Advance the output's frame counter, aiming to achieve linear animation
- * speed: if we miss a frame, try to catch up by dropping frames.
+ * speed: if we miss a frame, try to catch up by dropping frames. When each
+ * frame is meant to stay up for several vblanks, each step covers that
+ * many vblanks' worth of animation.
+ *
+ * margin_nsec is how long we expect painting and committing the frame to
+ * take, as measured by the repaint scheduler.
  */
-static void advance_frame(glplay::kms::Display &display, struct timespec *now)
+static void advance_target(glplay::kms::Display &display, struct timespec *target,
+			   struct timespec *now, int64_t margin_nsec)
 {
 	struct timespec too_soon;
+	struct timespec start = *target;
+
+	glplay::kms::timespec_add_nsec(&too_soon, now, margin_nsec);
+	if (display.presentsWhenReady()) {
+		/*
+		 * With async flips, or variable refresh and no content rate,
+		 * the frame goes out as soon as it is ready; for the latter,
+		 * no sooner than the fastest the mode allows after the
+		 * previous one. The animation follows the clock rather than
+		 * counting vblanks, as there may be several frames per vblank.
+		 */
+		if (glplay::kms::timespec_sub_to_nsec(&too_soon, target) >= 0) {
+			if (!display.asyncFlip)
+				glplay::kms::timespec_add_nsec(target, target, display.frameIntervalNsec());
+			if (glplay::kms::timespec_sub_to_nsec(&too_soon, target) > 0)
+				*target = too_soon;
+		}
+		display.frame_num = (glplay::kms::timespec_to_nsec(target) /
+				     display.refreshIntervalNsec) % NUM_ANIM_FRAMES;
+		return;
+	}
+
+	while (glplay::kms::timespec_sub_to_nsec(&too_soon, target) >= 0)
+		*target = display.nextFrameTarget(*target);
+
+	display.frame_num = (display.frame_num +
+			     (glplay::kms::timespec_sub_to_nsec(target, &start) +
+			      display.refreshIntervalNsec / 2) / display.refreshIntervalNsec) % NUM_ANIM_FRAMES;
+}
+
+/*
+ * KMS latches a commit on the first vblank after it arrives, with no way to
+ * ask for a later one. When we are only showing every Nth vblank, a frame
+ * rendered for the target vblank must therefore not be committed until the
+ * vblank before it has passed, or it would go on screen early.
+ *
+ * With variable refresh, the panel starts scanning out as soon as our
+ * commit arrives, so a frame for a given time is held until that time.
+ */
+static void output_set_commit_after(glplay::kms::Display &display,
+				    const struct timespec *target)
+{
+	if (glplay::kms::timespec_is_zero(target) || display.presentsWhenReady() ||
+	    (!display.vrrEnabled && display.vblanksPerFrame() == 1)) {
+		display.commit_after = {};
+		return;
+	}
+
+	if (display.vrrEnabled) {
+		display.commit_after = *target;
+		return;
+	}
+
+	glplay::kms::timespec_add_nsec(&display.commit_after, target,
+				       glplay::kms::PacingGovernor::holdGuardNsec(display.vblankPeriodNsec()) -
+				       display.vblankPeriodNsec());
+}
+
+/*
+ * Frames in the present queue may have been submitted for a vblank beyond
+ * the next one; hold those until the vblank before their target has passed,
+ * just as when pacing at a fraction of the refresh rate.
+ */
+static void output_hold_for_target(glplay::kms::Display &display,
+				   const struct timespec *target)
+{
+	const struct timespec *base = &display.last_frame;
+	auto period = display.vblankPeriodNsec();
+
+	if (glplay::kms::timespec_sub_to_nsec(&display.last_vblank, base) > 0)
+		base = &display.last_vblank;
+	if (glplay::kms::timespec_is_zero(target) || glplay::kms::timespec_is_zero(base) ||
+	    display.presentsWhenReady() || display.vrrEnabled ||
+	    glplay::kms::timespec_sub_to_nsec(target, base) <= period + period / 2)
+		return;
+
+	glplay::kms::timespec_add_nsec(&display.commit_after, target,
+				       glplay::kms::PacingGovernor::holdGuardNsec(period) - period);
+}
+
+/*
+ * Outputs in a sync group all aim for the vblank the first of them to be
+ * painted picked, and draw the animation frame for that time.
+ */
+static void output_share_group_target(gsl::shared_ptr<glplay::kms::DisplayAdapter> adapter,
+				      glplay::kms::Display &display)
+{
+	if (display.syncGroup < 0)
+		return;
+
+	auto &group = adapter->syncGroups[display.syncGroup];
+	group.shareTarget(display);
+	display.frame_num = group.contentFrame(NUM_ANIM_FRAMES);
+}
+
+static bool output_commit_held(const glplay::kms::Display &display,
+			       const struct timespec *now)
+{
+	return glplay::kms::timespec_sub_to_nsec(&display.commit_after, now) > 0;
+}
+
+static void advance_frame(glplay::kms::Display &display, struct timespec *now,
+			  int64_t margin_nsec)
+{
+	struct timespec *base = &display.last_frame;
 
-	/* For our first tick, we won't have predicted a time. */
-	if (glplay::kms::timespec_to_nsec(&display.last_frame) == 0L)
+	/*
+	 * Predict from the newest vblank we know about: our last completion,
+	 * or a vblank we sampled since, e.g. before our first frame or after
+	 * being idle. Without either, we can't predict a time at all.
+	 */
+	if (glplay::kms::timespec_sub_to_nsec(&display.last_vblank, base) > 0)
+		base = &display.last_vblank;
+	if (glplay::kms::timespec_is_zero(base))
 		return;
 
 	/*
 	 * Starting from our last frame completion time, advance the predicted
 	 * completion for our next frame by one frame's refresh time, until we
-	 * have at least a 4ms margin in which to paint a new buffer and submit
-	 * our frame to KMS.
+	 * have enough margin in which to paint a new buffer and submit our
+	 * frame to KMS. Once the output's vblank estimator has locked on,
+	 * the predictions come from the measured vblank timing rather than
+	 * the mode's nominal refresh rate.
 	 *
 	 * This will skip frames in the animation if necessary, so it is
 	 * temporally correct.
 	 */
-	glplay::kms::timespec_add_msec(&too_soon, now, 4);
-	display.next_frame = display.last_frame;
-
-	while (glplay::kms::timespec_sub_to_nsec(&too_soon, &display.next_frame) >= 0) {
-		glplay::kms::timespec_add_nsec(&display.next_frame, &display.next_frame,
-				  display.refreshIntervalNsec);
-		display.frame_num = (display.frame_num + 1) % NUM_ANIM_FRAMES;
-	}
-}
-
-static struct glplay::kms::Buffer *find_free_buffer(struct glplay::kms::Display &display)
-{
-	for (auto &buffer : display.buffers) {
-		if (!buffer.in_use) {
-			return &buffer;
-		}
-	}
-	assert(0 && "could not find free buffer for output!");
+	display.next_frame = *base;
+	advance_target(display, &display.next_frame, now, margin_nsec);
 }
 
 static void fill_verts(GLfloat *verts, GLfloat *col, unsigned int frame_num, unsigned int loc)
@@ -290,11 +649,62 @@ static void fill_verts(GLfloat *verts, GLfloat *col, unsigned int frame_num, uns
 	verts[7] = bottom;
 }
 
-inline auto buffer_egl_fill(gsl::shared_ptr<glplay::kms::DisplayAdapter> adapter, glplay::kms::Display &display) -> glplay::kms::Buffer* {
-    static PFNEGLCREATESYNCKHRPROC create_sync = NULL;
-    static PFNEGLWAITSYNCKHRPROC wait_sync = NULL;
-    static PFNEGLDESTROYSYNCKHRPROC destroy_sync = NULL;
-    static PFNEGLDUPNATIVEFENCEFDANDROIDPROC dup_fence_fd = NULL;
+/*
+ * Map vertices of the whole picture to the part of it this output shows,
+ * for outputs making up a tiled wall; the GPU clips away the rest.
+ */
+static void tile_verts(const glplay::kms::Display &display, GLfloat *verts)
+{
+	if (display.tileColumns == 1 && display.tileRows == 1)
+		return;
+
+	for (unsigned int i = 0; i < 8; i += 2) {
+		verts[i] = (verts[i] + 1.0f) * display.tileColumns -
+			2.0f * display.tileColumn - 1.0f;
+		verts[i + 1] = (verts[i + 1] + 1.0f) * display.tileRows -
+			2.0f * display.tileRow - 1.0f;
+	}
+}
+
+/* Draw the output's frame of the animation into the bound framebuffer. */
+static void egl_draw_content(gsl::shared_ptr<glplay::kms::DisplayAdapter> adapter,
+			     glplay::kms::Display &display, glplay::egl::RenderContext &rctx)
+{
+    for (unsigned int i = 0; i < 4; i++) {
+      GLfloat col[4];
+      GLfloat verts[8];
+      GLuint err = glGetError();
+			fill_verts(verts, col, display.frame_num, i);
+      tile_verts(display, verts);
+      glBindBuffer(GL_ARRAY_BUFFER, rctx.vbo);
+      /* glBufferSubData is most supported across GLES2 / Core profile,
+      * Core profile / GLES3 might have better ways */
+      glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(GLfloat) * 8, verts);
+      glBindBuffer(GL_ARRAY_BUFFER, 0);
+      glBindVertexArray(rctx.vao);
+      glUniform4f(adapter->eglDevice.col_uniform, col[0], col[1], col[2], col[3]);
+      glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
+      glBindVertexArray(0);
+      err = glGetError();
+      if (err != GL_NO_ERROR)
+        debug("GL error state 0x%x\n", err);
+    }
+}
+
+inline auto buffer_egl_fill(gsl::shared_ptr<glplay::kms::DisplayAdapter> adapter, glplay::kms::Display &display,
+			    glplay::egl::RenderContext &rctx) -> glplay::kms::Buffer* {
+    /*
+     * Resolved on first use; function-local statics are initialised
+     * exactly once, even when several render threads get here together.
+     */
+    static auto create_sync = (PFNEGLCREATESYNCKHRPROC)
+      eglGetProcAddress("eglCreateSyncKHR");
+    static auto wait_sync = (PFNEGLWAITSYNCKHRPROC)
+      eglGetProcAddress("eglWaitSyncKHR");
+    static auto destroy_sync = (PFNEGLDESTROYSYNCKHRPROC)
+      eglGetProcAddress("eglDestroySyncKHR");
+    static auto dup_fence_fd = (PFNEGLDUPNATIVEFENCEFDANDROIDPROC)
+      eglGetProcAddress("eglDupNativeFenceFDANDROID");
     EGLSyncKHR sync;
     EGLBoolean ret;
 
@@ -304,36 +714,26 @@ inline auto buffer_egl_fill(gsl::shared_ptr<glplay::kms::DisplayAdapter> adapter
 	 * (such that it remains as linear as possible over time, even at
 	 * the cost of dropping frames), render the content for that position.
 	 */
-	auto buffer = find_free_buffer(display);
-	assert(buffer);
+	auto buffer = display.findFreeBuffer();
+	assert(buffer && "could not find free buffer for output!");
+	glplay::nix::TraceSpan span("render", display.crtc->crtc_id);
+	buffer->render_start_nsec = monotonic_nsec();
+	buffer->gpu_start_nsec = 0;
+	buffer->gpu_end_nsec = 0;
+
+    adapter->eglDevice.bindRenderContext(rctx);
 
-    ret = eglMakeCurrent(adapter->eglDevice.egl_dpy, EGL_NO_SURFACE, EGL_NO_SURFACE,
-            adapter->eglDevice.ctx);
-    assert(ret);
+    /*
+    * Pick up whatever earlier frames' GPU timings have come in, and time
+    * this one; the flip handler hands the results out.
+    */
+    display.gpuTimer.collect();
+    display.gpuTimer.begin(buffer->render_start_nsec);
 
     if (display.explicitFencing && adapter->eglDevice.explicit_fencing) {
-      if (!create_sync) {
-        create_sync = (PFNEGLCREATESYNCKHRPROC)
-          eglGetProcAddress("eglCreateSyncKHR");
-      }
       assert(create_sync);
-
-      if (!wait_sync) {
-        wait_sync = (PFNEGLWAITSYNCKHRPROC)
-          eglGetProcAddress("eglWaitSyncKHR");
-      }
       assert(wait_sync);
-
-      if (!destroy_sync) {
-        destroy_sync = (PFNEGLDESTROYSYNCKHRPROC)
-          eglGetProcAddress("eglDestroySyncKHR");
-      }
       assert(destroy_sync);
-
-      if (!dup_fence_fd) {
-        dup_fence_fd = (PFNEGLDUPNATIVEFENCEFDANDROIDPROC)
-          eglGetProcAddress("eglDupNativeFenceFDANDROID");
-      }
       assert(dup_fence_fd);
 
       /*
@@ -341,10 +741,11 @@ inline auto buffer_egl_fill(gsl::shared_ptr<glplay::kms::DisplayAdapter> adapter
       * wait before we use it, to ensure that the GPU doesn't render
       * to the buffer whilst KMS is still using it.
       *
-      * This isn't actually necessary with our current model, since we
-      * have more buffers than we need, and we wait in software until
-      * they've been released. But if you want to start rendering
-      * ahead of time, this fence will protect us.
+      * When we render each frame just before committing it, this isn't
+      * actually necessary, since we have more buffers than we need, and
+      * we wait in software until they've been released. When rendering
+      * ahead of time, buffers are handed back as soon as the commit
+      * replacing them is made, and this fence is what protects them.
       */
       if (buffer->kms_fence_fd >= 0) {
         EGLint attribs[] = {
@@ -366,26 +767,45 @@ inline auto buffer_egl_fill(gsl::shared_ptr<glplay::kms::DisplayAdapter> adapter
       }
     }
 
-    glBindFramebuffer(GL_FRAMEBUFFER, buffer->gbm.fbo_id);
-    glViewport(0, 0, buffer->width, buffer->height);
+    /*
+    * With dynamic resolution, we only render render_width x render_height
+    * pixels, into the top-left corner of the buffer for the plane to scale
+    * up; or, if the plane can't scale, offscreen, to be scaled up into the
+    * buffer on the GPU.
+    */
+    GLuint fbo = rctx.shared ? rctx.framebufferFor(buffer->gbm.tex_id) : buffer->gbm.fbo_id;
+    GLsizei width = display.render_width != 0 ? display.render_width : buffer->width;
+    GLsizei height = display.render_height != 0 ? display.render_height : buffer->height;
+    bool upscale = !display.planeScaling &&
+      (width != (GLsizei) buffer->width || height != (GLsizei) buffer->height);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, upscale ? rctx.scratchFor(buffer->width, buffer->height) : fbo);
+    glViewport(0, 0, width, height);
+
+    egl_draw_content(adapter, display, rctx);
+
+    if (upscale) {
+      glBindFramebuffer(GL_READ_FRAMEBUFFER, rctx.scratchFramebuffer);
+      glBindFramebuffer(GL_DRAW_FRAMEBUFFER, fbo);
+      glBlitFramebuffer(0, 0, width, height, 0, 0, buffer->width, buffer->height,
+                        GL_COLOR_BUFFER_BIT, GL_LINEAR);
+      width = buffer->width;
+      height = buffer->height;
+    }
+    buffer->content_width = width;
+    buffer->content_height = height;
+    /* The HUD's redraws aren't the content's cost, so stop timing here. */
+    display.gpuTimer.end();
 
-    for (unsigned int i = 0; i < 4; i++) {
-      GLfloat col[4];
-      GLfloat verts[8];
-      GLuint err = glGetError();
-			fill_verts(verts, col, display.frame_num, i);
-      glBindBuffer(GL_ARRAY_BUFFER, adapter->eglDevice.vbo);
-      /* glBufferSubData is most supported across GLES2 / Core profile,
-      * Core profile / GLES3 might have better ways */
-      glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(GLfloat) * 8, verts);
-      glBindBuffer(GL_ARRAY_BUFFER, 0);
-      glBindVertexArray(adapter->eglDevice.vao);
-      glUniform4f(adapter->eglDevice.col_uniform, col[0], col[1], col[2], col[3]);
-      glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
-      glBindVertexArray(0);
-      err = glGetError();
-      if (err != GL_NO_ERROR)
-        debug("GL error state 0x%x\n", err);
+    /*
+    * Every so often, redraw the HUD too, for its plane to pick up with
+    * this frame's commit; this frame's flush and fence then cover it.
+    */
+    if (display.hud.due(buffer->render_start_nsec)) {
+      auto &hud_buffer = display.hudBuffers[display.hud.drawBuffer()];
+      glBindFramebuffer(GL_FRAMEBUFFER,
+                        rctx.shared ? rctx.framebufferFor(hud_buffer.gbm.tex_id) : hud_buffer.gbm.fbo_id);
+      display.hud.draw(buffer->render_start_nsec);
     }
 
     /*
@@ -414,6 +834,7 @@ inline auto buffer_egl_fill(gsl::shared_ptr<glplay::kms::DisplayAdapter> adapter
     }
 
     glFlush();
+    buffer->flush_nsec = monotonic_nsec();
 
     /*
     * Now we've flushed, we can get the fence FD associated with our
@@ -428,8 +849,6 @@ inline auto buffer_egl_fill(gsl::shared_ptr<glplay::kms::DisplayAdapter> adapter
     }
 
 	buffer->in_use = true;
-	display.bufferPending = buffer;
-	display.needs_repaint = false;
 	return buffer;
 }
 
@@ -438,7 +857,8 @@ inline auto buffer_egl_fill(gsl::shared_ptr<glplay::kms::DisplayAdapter> adapter
  * Using the CPU mapping, fill the buffer with a simple pixel-by-pixel
  * checkerboard; the boundaries advance from top-left to bottom-right.
  */
-auto buffer_fill(gsl::shared_ptr<glplay::kms::DisplayAdapter> adapter, glplay::kms::Display &display) -> glplay::kms::Buffer* {
+auto buffer_fill(gsl::shared_ptr<glplay::kms::DisplayAdapter> adapter, glplay::kms::Display &display,
+		 glplay::egl::RenderContext &rctx) -> glplay::kms::Buffer* {
 
 
 	// if (buffer->gbm.bo) {
@@ -446,7 +866,7 @@ auto buffer_fill(gsl::shared_ptr<glplay::kms::DisplayAdapter> adapter, glplay::k
 			// TODO: handle return value
 			// buffer_vk_fill(buffer, frame_num);
 		// } else {
-			auto buff = buffer_egl_fill(adapter, display);
+			auto buff = buffer_egl_fill(adapter, display, rctx);
 		// }
 
 		return buff;
@@ -479,6 +899,138 @@ auto buffer_fill(gsl::shared_ptr<glplay::kms::DisplayAdapter> adapter, glplay::k
 	// }
 }
 
+/*
+ * Beam racing: render one strip of the output's frame straight into the
+ * buffer on screen, and return the strip's render fence FD, or -1 without
+ * explicit fencing.
+ */
+static int buffer_egl_fill_strip(gsl::shared_ptr<glplay::kms::DisplayAdapter> adapter,
+				 glplay::kms::Display &display, glplay::egl::RenderContext &rctx,
+				 glplay::kms::Buffer *buffer,
+				 const glplay::kms::BeamRacer::Strip &strip)
+{
+	static auto create_sync = (PFNEGLCREATESYNCKHRPROC)
+		eglGetProcAddress("eglCreateSyncKHR");
+	static auto destroy_sync = (PFNEGLDESTROYSYNCKHRPROC)
+		eglGetProcAddress("eglDestroySyncKHR");
+	static auto dup_fence_fd = (PFNEGLDUPNATIVEFENCEFDANDROIDPROC)
+		eglGetProcAddress("eglDupNativeFenceFDANDROID");
+	EGLSyncKHR sync = EGL_NO_SYNC_KHR;
+	int fence_fd = -1;
+	glplay::nix::TraceSpan span("render strip", strip.index);
+
+	adapter->eglDevice.bindRenderContext(rctx);
+	glBindFramebuffer(GL_FRAMEBUFFER,
+			  rctx.shared ? rctx.framebufferFor(buffer->gbm.tex_id) : buffer->gbm.fbo_id);
+	glViewport(0, 0, buffer->width, buffer->height);
+	glEnable(GL_SCISSOR_TEST);
+	glScissor(0, strip.firstLine, buffer->width, strip.lines);
+
+	if (display.beam.testMode()) {
+		/*
+		 * Each strip gets a colour of its own, brighter and darker on
+		 * alternate frames; a strip which missed the beam shows up as
+		 * a band of the wrong shade.
+		 */
+		GLfloat shade = (display.frame_num % 2) ? 1.0f : 0.25f;
+		glClearColor((strip.index % 3 == 0) ? shade : 0.0f,
+			     (strip.index % 3 == 1) ? shade : 0.0f,
+			     (strip.index % 3 == 2) ? shade : 0.0f, 1.0f);
+		glClear(GL_COLOR_BUFFER_BIT);
+	} else {
+		egl_draw_content(adapter, display, rctx);
+	}
+	glDisable(GL_SCISSOR_TEST);
+
+	if (display.explicitFencing && adapter->eglDevice.explicit_fencing) {
+		EGLint attribs[] = {
+			EGL_SYNC_NATIVE_FENCE_FD_ANDROID, EGL_NO_NATIVE_FENCE_FD_ANDROID,
+			EGL_NONE,
+		};
+
+		sync = create_sync(adapter->eglDevice.egl_dpy, EGL_SYNC_NATIVE_FENCE_ANDROID,
+				   attribs);
+		assert(sync);
+	}
+
+	glFlush();
+
+	if (sync != EGL_NO_SYNC_KHR) {
+		fence_fd = dup_fence_fd(adapter->eglDevice.egl_dpy, sync);
+		assert(fence_fd >= 0);
+		destroy_sync(adapter->eglDevice.egl_dpy, sync);
+	}
+
+	/*
+	 * Hardware which only scans out what it has been told has changed
+	 * (panel self-refresh, framebuffer compression) needs to hear about
+	 * the strip; drivers without such hardware don't implement this.
+	 */
+	drmModeClip clip = {
+		.x1 = 0,
+		.y1 = static_cast<uint16_t>(strip.firstLine),
+		.x2 = static_cast<uint16_t>(buffer->width),
+		.y2 = static_cast<uint16_t>(strip.firstLine + strip.lines),
+	};
+	drmModeDirtyFB(adapter->getAdapterFD(), buffer->fb_id, &clip, 1);
+
+	return fence_fd;
+}
+
+/* Records how far ahead of the beam each finished strip landed. */
+static void output_collect_beam_strips(glplay::kms::Display &display)
+{
+	auto &pending = display.beam.pending;
+
+	while (!pending.empty() && linux_sync_file_is_signalled(pending.front().fenceFd)) {
+		display.beam.landed(pending.front(),
+				    linux_sync_file_get_fence_time(pending.front().fenceFd),
+				    display.name.c_str());
+		close(pending.front().fenceFd);
+		pending.pop_front();
+	}
+}
+
+/*
+ * Render the strips of a beam-racing output which are due, into the buffer
+ * it has on screen, then have the scheduler wake us for the next one.
+ */
+static void beam_race_output(gsl::shared_ptr<glplay::kms::DisplayAdapter> adapter,
+			     glplay::kms::Display &display, glplay::egl::RenderContext &rctx)
+{
+	auto period = display.vblankPeriodNsec();
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	/*
+	 * Nothing is committed to give us completions, so sample the CRTC's
+	 * vblank ourselves once a frame to know where the beam is.
+	 */
+	if (glplay::kms::timespec_sub_to_nsec(&now, &display.last_vblank) > period)
+		adapter->vblankTracker.sample(display);
+	output_collect_beam_strips(display);
+
+	for (unsigned int n = 0; n < display.beam.strips(); n++) {
+		auto strip = display.beam.next(display.last_vblank, period, now);
+
+		if (glplay::kms::timespec_sub_to_nsec(&strip.renderAt, &now) > 0) {
+			glplay::kms::RepaintScheduler::holdUntil(display, strip.renderAt);
+			return;
+		}
+
+		display.frame_num = (glplay::kms::timespec_to_nsec(&strip.frameStart) /
+				     display.refreshIntervalNsec) % NUM_ANIM_FRAMES;
+		display.beam.rendered(strip, now,
+				      buffer_egl_fill_strip(adapter, display, rctx,
+							    display.bufferLast, strip));
+		clock_gettime(CLOCK_MONOTONIC, &now);
+	}
+
+	/* More strips are due than we render in one go; come straight back. */
+	glplay::kms::RepaintScheduler::holdUntil(display, now);
+}
+
 /* Sets a plane property inside an atomic request. */
 static int
 plane_add_prop(drmModeAtomicReqPtr req, glplay::kms::Display * display,
@@ -541,20 +1093,91 @@ connector_add_prop(drmModeAtomicReq *req, glplay::kms::Display * display,
 }
 
 /*
- * Populates an atomic request structure with this output's current
- * configuration.
- *
- * Atomic requests are applied incrementally on top of the current state, so
- * there is no need here to apply the entire output state, except on the first
- * modeset if we are changing the display routing (per output_create comments).
+ * Asks KMS, without changing anything, whether the output's primary plane
+ * can scale a width x height source up to the whole mode. Planes which
+ * can't scale at all, or not by this much, fail the test.
  */
-void output_add_atomic_req(glplay::kms::Display * display, drmModeAtomicReqPtr req,
-			   glplay::kms::Buffer *buffer)
+static bool output_plane_can_scale(gsl::shared_ptr<glplay::kms::DisplayAdapter> adapter,
+				   glplay::kms::Display &display,
+				   unsigned int width, unsigned int height)
 {
+	auto &mode = display.crtc->mode;
+	drmModeAtomicReq *req = drmModeAtomicAlloc();
 	int ret;
 
-	debug("[%s] atomic state for commit:\n", display->name.c_str());
-
+	assert(req);
+	ret = plane_add_prop(req, &display, glplay::drm::WDRM_PLANE_CRTC_ID, display.crtc->crtc_id);
+	ret |= plane_add_prop(req, &display, glplay::drm::WDRM_PLANE_FB_ID, display.buffers[0].fb_id);
+	ret |= plane_add_prop(req, &display, glplay::drm::WDRM_PLANE_SRC_X, 0);
+	ret |= plane_add_prop(req, &display, glplay::drm::WDRM_PLANE_SRC_Y, 0);
+	ret |= plane_add_prop(req, &display, glplay::drm::WDRM_PLANE_SRC_W, (uint64_t) width << 16);
+	ret |= plane_add_prop(req, &display, glplay::drm::WDRM_PLANE_SRC_H, (uint64_t) height << 16);
+	ret |= plane_add_prop(req, &display, glplay::drm::WDRM_PLANE_CRTC_X, 0);
+	ret |= plane_add_prop(req, &display, glplay::drm::WDRM_PLANE_CRTC_Y, 0);
+	ret |= plane_add_prop(req, &display, glplay::drm::WDRM_PLANE_CRTC_W, mode.hdisplay);
+	ret |= plane_add_prop(req, &display, glplay::drm::WDRM_PLANE_CRTC_H, mode.vdisplay);
+	if (ret == 0)
+		ret = drmModeAtomicCommit(adapter->getAdapterFD(), req, DRM_MODE_ATOMIC_TEST_ONLY, nullptr);
+	drmModeAtomicFree(req);
+	return ret == 0;
+}
+
+/*
+ * Picks the size to render the output's next frame at, from the dynamic
+ * resolution governor. The first time the size drops below the mode, check
+ * the plane can scale it; if it can't, the GPU has to, which still saves
+ * rendering all those pixels.
+ */
+static void output_update_resolution(gsl::shared_ptr<glplay::kms::DisplayAdapter> adapter,
+				     glplay::kms::Display &display)
+{
+	auto &mode = display.crtc->mode;
+	auto width = display.resolution.scaled(mode.hdisplay);
+	auto height = display.resolution.scaled(mode.vdisplay);
+
+	if (!display.resolution.enabled() ||
+	    (width == display.render_width && height == display.render_height))
+		return;
+	display.render_width = width;
+	display.render_height = height;
+	debug("[%s] rendering at %ux%u\n", display.name.c_str(), width, height);
+
+	if (!display.planeScaling || (width == mode.hdisplay && height == mode.vdisplay))
+		return;
+	if (!output_plane_can_scale(adapter, display, width, height)) {
+		error("[%s] primary plane can't scale %ux%u to %ux%u; scaling on the GPU\n",
+		      display.name.c_str(), width, height, mode.hdisplay, mode.vdisplay);
+		display.planeScaling = false;
+	}
+}
+
+/*
+ * Populates an atomic request structure with this output's current
+ * configuration.
+ *
+ * Atomic requests are applied incrementally on top of the current state, so
+ * there is no need here to apply the entire output state, except on the first
+ * modeset if we are changing the display routing (per output_create comments).
+ */
+void output_add_atomic_req(glplay::kms::Display * display, drmModeAtomicReqPtr req,
+			   glplay::kms::Buffer *buffer)
+{
+	int ret;
+
+	debug("[%s] atomic state for commit:\n", display->name.c_str());
+
+	/*
+	 * Async flips may only change the framebuffer: the kernel rejects
+	 * them if anything else is in the request, even with the same
+	 * value. That also rules out the fences, so the kernel's implicit
+	 * fencing makes the flip wait for rendering, and we have no
+	 * out-fence for the buffer being replaced.
+	 */
+	if (display->asyncFlip && display->presented) {
+		ret = plane_add_prop(req, display, glplay::drm::WDRM_PLANE_FB_ID, buffer->fb_id);
+		assert(ret == 0);
+		return;
+	}
 
 	ret = plane_add_prop(req, display, glplay::drm::wdrm_plane_property::WDRM_PLANE_CRTC_ID, display->crtc->crtc_id);
 
@@ -562,7 +1185,8 @@ void output_add_atomic_req(glplay::kms::Display * display, drmModeAtomicReqPtr r
 	 * SRC_X/Y/W/H are the co-ordinates to use as the dimensions of the
 	 * framebuffer source: you can use these to crop an image. Source
 	 * co-ordinates are in 16.16 fixed-point to allow for better scaling;
-	 * as we just use a full-size uncropped image, we don't need this.
+	 * we only crop to the part of the buffer we rendered, which is all
+	 * of it unless dynamic resolution has made it smaller.
 	 */
 	ret |= plane_add_prop(req, display, glplay::drm::WDRM_PLANE_FB_ID, buffer->fb_id);
 	//TODO: need adapter here to replace false.
@@ -574,16 +1198,17 @@ void output_add_atomic_req(glplay::kms::Display * display, drmModeAtomicReqPtr r
 	ret |= plane_add_prop(req, display, glplay::drm::WDRM_PLANE_SRC_X, 0);
 	ret |= plane_add_prop(req, display, glplay::drm::WDRM_PLANE_SRC_Y, 0);
 	ret |= plane_add_prop(req, display, glplay::drm::WDRM_PLANE_SRC_W,
-			      buffer->width << 16);
+			      buffer->content_width << 16);
 	ret |= plane_add_prop(req, display, glplay::drm::WDRM_PLANE_SRC_H,
-			      buffer->height << 16);
+			      buffer->content_height << 16);
 
 	/*
 	 * DST_X/Y/W/H position the plane's display within the CRTC's display
 	 * space; these positions are plain integer, as it makes no sense for
 	 * display positions to be expressed in subpixels.
 	 *
-	 * Anyway, we just use a full-screen buffer with no scaling.
+	 * The plane always covers the whole CRTC, scaling the source up to
+	 * it if that is smaller.
 	 */
 	ret |= plane_add_prop(req, display, glplay::drm::WDRM_PLANE_CRTC_X, 0);
 	ret |= plane_add_prop(req, display, glplay::drm::WDRM_PLANE_CRTC_Y, 0);
@@ -602,6 +1227,11 @@ void output_add_atomic_req(glplay::kms::Display * display, drmModeAtomicReqPtr r
 			     display->mode_blob_id);
 	ret |= crtc_add_prop(req, display, glplay::drm::WDRM_CRTC_ACTIVE, 1);
 
+	/* Drivers can switch variable refresh on and off without a modeset. */
+	if (display->props.crtc[glplay::drm::WDRM_CRTC_VRR_ENABLED].prop_id != 0)
+		ret |= crtc_add_prop(req, display, glplay::drm::WDRM_CRTC_VRR_ENABLED,
+				     display->vrrEnabled ? 1 : 0);
+
 	if (display->explicitFencing) {
 		if (display->commitFenceFD >= 0)
 			close(display->commitFenceFD);
@@ -619,10 +1249,36 @@ void output_add_atomic_req(glplay::kms::Display * display, drmModeAtomicReqPtr r
 	ret |= connector_add_prop(req, display, glplay::drm::WDRM_CONNECTOR_CRTC_ID,
 				  display->crtc->crtc_id);
 
+	/*
+	 * The HUD's plane only goes in the request when it has been redrawn;
+	 * otherwise it keeps showing the buffer it has.
+	 */
+	if (display->hud.ready()) {
+		ret |= display->hud.addPlaneState(req, display->crtc->crtc_id,
+						  display->hudBuffers[display->hud.drawBuffer()].fb_id);
+		display->hud.committed();
+	}
+
 	assert(ret == 0);
 }
 
-static void repaint_one_output(gsl::shared_ptr<glplay::kms::DisplayAdapter> adapter, glplay::kms::Display &display, drmModeAtomicReqPtr req, bool needs_modeset)
+/*
+ * Records that the output's newest frame shows its current content.
+ */
+static void output_content_painted(glplay::kms::Display &display)
+{
+	display.paintedSerial = display.contentSerial;
+	if (animate)
+		display.invalidate();
+}
+
+/*
+ * Paints the output and adds it to the atomic request. Returns false if the
+ * frame has to be held back until display.commit_after; calling this again
+ * once that has passed commits the held frame without repainting it.
+ */
+static bool repaint_one_output(gsl::shared_ptr<glplay::kms::DisplayAdapter> adapter, glplay::kms::Display &display,
+			       glplay::egl::RenderContext &rctx, drmModeAtomicReqPtr req, bool *needs_modeset)
 {
 	struct timespec now;
 	int ret;
@@ -630,8 +1286,29 @@ static void repaint_one_output(gsl::shared_ptr<glplay::kms::DisplayAdapter> adap
 	ret = clock_gettime(CLOCK_MONOTONIC, &now);
 	assert(ret == 0);
 
-	advance_frame(display, &now);
-	auto buffer = buffer_fill(adapter, display);
+	if (display.bufferHeld) {
+		glplay::kms::RepaintScheduler::repaintResumed(display, now);
+	} else {
+		glplay::kms::RepaintScheduler::repaintStarted(display, now);
+		advance_frame(display, &now, adapter->scheduler.repaintMargin(display));
+		output_share_group_target(adapter, display);
+		output_set_commit_after(display, &display.next_frame);
+		output_update_resolution(adapter, display);
+		display.bufferHeld = buffer_fill(adapter, display, rctx);
+		output_content_painted(display);
+
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		if (output_commit_held(display, &now)) {
+			glplay::kms::RepaintScheduler::repaintHeld(display, now);
+			return false;
+		}
+	}
+
+	auto *buffer = display.bufferHeld;
+	display.bufferHeld = nullptr;
+	display.commit_after = {};
+	display.bufferPending = buffer;
+	display.frameCommitted({ buffer, display.next_frame });
 
 	/* Add the output's new state to the atomic modesetting request. */
 	output_add_atomic_req(&display, req, buffer);
@@ -642,8 +1319,8 @@ static void repaint_one_output(gsl::shared_ptr<glplay::kms::DisplayAdapter> adap
 	 * have already presented to this output, then we don't need to since
 	 * our configuration is similar enough.
 	 */
-	if (glplay::kms::timespec_to_nsec(&display.last_frame) == 0UL) {
-		needs_modeset = true;
+	if (!display.presented) {
+		*needs_modeset = true;
 	}
 
 	if (glplay::kms::timespec_to_nsec(&display.next_frame) != 0UL) {
@@ -655,6 +1332,216 @@ static void repaint_one_output(gsl::shared_ptr<glplay::kms::DisplayAdapter> adap
 	} else {
 		debug("[%s] scheduling first frame\n", display.name.c_str());
 	}
+	return true;
+}
+
+/*
+ * Presentation feedback for the frames we queue: traces what became of each
+ * one, and says why when it didn't go on screen when asked.
+ */
+static void output_frame_feedback(const glplay::kms::Display &display,
+				  const glplay::kms::PresentationFeedback &feedback)
+{
+	if (feedback.discarded) {
+		glplay::nix::traceInstant("frame discarded", (int64_t) feedback.id);
+		debug("[%s] frame %" PRIu64 " dropped without being shown\n",
+		      display.name.c_str(), feedback.id);
+		return;
+	}
+
+	glplay::nix::traceInstant("frame presented", (int64_t) feedback.id);
+	if (feedback.late)
+		debug("[%s] frame %" PRIu64 " late: wanted %" PRIu64 ", shown at %" PRIu64 " (vblank %" PRIu64 ")\n",
+		      display.name.c_str(), feedback.id,
+		      glplay::kms::timespec_to_nsec(&feedback.target),
+		      glplay::kms::timespec_to_nsec(&feedback.presented), feedback.sequence);
+}
+
+/*
+ * Mailbox mode: renders a frame for the next vblank we can still make, as
+ * often as the content changes. If every buffer is taken, the oldest frame
+ * still waiting will never be shown, as there is a newer one behind it, so
+ * we render over that. Returns false if the content hasn't changed, or
+ * there is nothing to render into.
+ */
+static bool render_mailbox_frame(gsl::shared_ptr<glplay::kms::DisplayAdapter> adapter,
+				 glplay::kms::Display &display,
+				 glplay::egl::RenderContext &rctx)
+{
+	struct timespec target = display.last_frame;
+	struct timespec now;
+	struct timespec too_soon;
+
+	if (!display.contentChanged())
+		return false;
+	if (!display.findFreeBuffer()) {
+		if (display.presentQueue.size() < 2)
+			return false;
+		display.presentQueue.front().buffer->in_use = false;
+		display.frameDiscarded(display.presentQueue.front());
+		display.presentQueue.pop_front();
+		display.mailboxReplaced++;
+	}
+
+	/*
+	 * Several frames may be rendered for the same vblank, so the
+	 * animation follows the clock rather than counting frames.
+	 */
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	if (glplay::kms::timespec_sub_to_nsec(&display.last_vblank, &target) > 0)
+		target = display.last_vblank;
+	if (!glplay::kms::timespec_is_zero(&target)) {
+		glplay::kms::timespec_add_nsec(&too_soon, &now,
+					       adapter->scheduler.repaintMargin(display));
+		while (glplay::kms::timespec_sub_to_nsec(&too_soon, &target) >= 0)
+			target = display.nextFrameTarget(target);
+		display.frame_num = (glplay::kms::timespec_to_nsec(&now) /
+				     display.refreshIntervalNsec) % NUM_ANIM_FRAMES;
+	}
+
+	auto buffer = buffer_fill(adapter, display, rctx);
+	output_content_painted(display);
+	display.submitFrame(buffer, target, [&display](const auto &feedback) {
+		output_frame_feedback(display, feedback);
+	});
+	display.mailboxRendered++;
+	debug("[%s] mailbox FB %" PRIu32 " for %" PRIu64 "\n",
+	      display.name.c_str(), buffer->fb_id, glplay::kms::timespec_to_nsec(&target));
+	return true;
+}
+
+/*
+ * Leaves only the newest frame the GPU has finished rendering at the front
+ * of a mailbox output's queue, dropping everything older, and aims it at
+ * the next vblank it can still make. If the GPU hasn't finished any, the
+ * oldest one goes, and the commit waits for its fence.
+ */
+static void output_take_mailbox_frame(glplay::kms::Display &display)
+{
+	size_t newest = display.presentQueue.size() - 1;
+	struct timespec now;
+
+	while (newest > 0 && display.presentQueue[newest].buffer->render_fence_fd >= 0 &&
+	       !linux_sync_file_is_signalled(display.presentQueue[newest].buffer->render_fence_fd))
+		newest--;
+	for (size_t idx = 0; idx < newest; idx++) {
+		display.presentQueue.front().buffer->in_use = false;
+		display.frameDiscarded(display.presentQueue.front());
+		display.presentQueue.pop_front();
+		display.mailboxReplaced++;
+	}
+
+	auto &frame = display.presentQueue.front();
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	while (!glplay::kms::timespec_is_zero(&frame.target) &&
+	       glplay::kms::timespec_sub_to_nsec(&now, &frame.target) >= 0)
+		frame.target = display.nextFrameTarget(frame.target);
+}
+
+/*
+ * Renders one more frame into the output's present queue, for the vblank
+ * after the newest frame already queued (or committed). Returns false if
+ * the queue is full, there are no free buffers, or the content hasn't
+ * changed since the newest frame.
+ */
+static bool render_ahead_one_frame(gsl::shared_ptr<glplay::kms::DisplayAdapter> adapter,
+				   glplay::kms::Display &display,
+				   glplay::egl::RenderContext &rctx)
+{
+	struct timespec now;
+
+	if (display.mailbox)
+		return render_mailbox_frame(adapter, display, rctx);
+	if (display.presentQueue.size() >= display.presentQueueDepth ||
+	    !display.findFreeBuffer() || !display.contentChanged())
+		return false;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	/*
+	 * If nothing is queued or in flight, the pipeline has drained and
+	 * we predict from the last completion, just as when rendering each
+	 * frame on demand. Otherwise this frame follows the newest one we
+	 * have, unless that is already too close to make it in time.
+	 */
+	if (display.presentQueue.empty() && !display.bufferPending) {
+		display.render_target = display.last_frame;
+	} else {
+		/* Until the first frame completes, we have nothing to go on. */
+		if (glplay::kms::timespec_is_zero(&display.render_target))
+			display.render_target = display.last_frame;
+		if (!glplay::kms::timespec_is_zero(&display.render_target))
+			display.render_target = display.nextFrameTarget(display.render_target);
+		display.frame_num = (display.frame_num + display.vblanksPerFrame()) % NUM_ANIM_FRAMES;
+	}
+	if (!glplay::kms::timespec_is_zero(&display.render_target))
+		advance_target(display, &display.render_target, &now,
+			       adapter->scheduler.repaintMargin(display));
+
+	auto buffer = buffer_fill(adapter, display, rctx);
+	output_content_painted(display);
+	display.submitFrame(buffer, display.render_target, [&display](const auto &feedback) {
+		output_frame_feedback(display, feedback);
+	});
+	debug("[%s] queued FB %" PRIu32 " for %" PRIu64 " (%zu/%u queued)\n",
+	      display.name.c_str(), buffer->fb_id,
+	      glplay::kms::timespec_to_nsec(&display.render_target),
+	      display.presentQueue.size(), display.presentQueueDepth);
+	return true;
+}
+
+/*
+ * Repaint step for outputs which render ahead: once the previous commit
+ * has completed, commit the oldest queued frame (rendering one first if
+ * the queue has run dry), then top the queue up by one frame. Returns
+ * true if the queue could take more frames straight away.
+ *
+ * The oldest frame stays queued while display.commit_after is still to
+ * come.
+ */
+static bool repaint_one_output_ahead(gsl::shared_ptr<glplay::kms::DisplayAdapter> adapter,
+				     glplay::kms::Display &display,
+				     glplay::egl::RenderContext &rctx,
+				     drmModeAtomicReqPtr req, bool *needs_modeset,
+				     bool *committed)
+{
+	*committed = false;
+
+	if (!display.bufferPending) {
+		struct timespec now;
+
+		if (display.presentQueue.empty() &&
+		    !render_ahead_one_frame(adapter, display, rctx))
+			return false;
+
+		if (display.mailbox)
+			output_take_mailbox_frame(display);
+		auto frame = display.presentQueue.front();
+		output_set_commit_after(display, &frame.target);
+		if (glplay::kms::timespec_is_zero(&display.commit_after))
+			output_hold_for_target(display, &frame.target);
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		if (!output_commit_held(display, &now)) {
+			display.presentQueue.pop_front();
+			display.commit_after = {};
+			display.bufferPending = frame.buffer;
+			display.next_frame = frame.target;
+			display.frameCommitted(std::move(frame));
+			output_add_atomic_req(&display, req, display.bufferPending);
+			if (!display.presented)
+				*needs_modeset = true;
+			*committed = true;
+		}
+	}
+
+	render_ahead_one_frame(adapter, display, rctx);
+
+	/* Mailbox outputs can always render over their oldest frame. */
+	if (display.mailbox)
+		return display.contentChanged() &&
+		       (display.findFreeBuffer() || display.presentQueue.size() >= 2);
+	return display.presentQueue.size() < display.presentQueueDepth &&
+	       display.findFreeBuffer() && display.contentChanged();
 }
 
 /*
@@ -678,8 +1565,13 @@ static void repaint_one_output(gsl::shared_ptr<glplay::kms::DisplayAdapter> adap
  * or modes; here we set it on our first commit (since the prior state
  * could be very different), but make sure to not use it in steady state.
  *
- * Another flag which can be used - but isn't here - is TEST_ONLY. This
- * flag simply checks whether or not the atomic commit _would_ succeed,
+ * For immediate-mode outputs, we add the ASYNC flag: the new framebuffer
+ * is scanned out straight away, tearing with the old one, rather than at
+ * the next vblank.
+ *
+ * Another flag, which we only use in output_plane_can_scale and when
+ * finding the HUD a plane, is TEST_ONLY.
+ * This flag simply checks whether or not the atomic commit _would_ succeed,
  * and returns without committing the state to the kernel. Weston uses
  * this to determine whether or not we can use overlays by brute force:
  * we try to place each view on a particular plane one by one, testing
@@ -689,7 +1581,7 @@ static void repaint_one_output(gsl::shared_ptr<glplay::kms::DisplayAdapter> adap
  * certain planes can only scale by certain amounts.
  */
 int atomic_commit(gsl::shared_ptr<glplay::kms::DisplayAdapter> adapter, drmModeAtomicReqPtr req,
-		  bool allow_modeset)
+		  bool allow_modeset, bool async_flip)
 {
 	int ret;
 	uint32_t flags = (DRM_MODE_ATOMIC_NONBLOCK |
@@ -697,22 +1589,330 @@ int atomic_commit(gsl::shared_ptr<glplay::kms::DisplayAdapter> adapter, drmModeA
 
 	if (allow_modeset)
 		flags |= DRM_MODE_ATOMIC_ALLOW_MODESET;
+	if (async_flip)
+		flags |= DRM_MODE_PAGE_FLIP_ASYNC;
 
+	glplay::nix::TraceSpan span("commit");
 	return drmModeAtomicCommit(adapter->getAdapterFD(), req, flags, adapter.get());
 }
 
+/*
+ * The out-fence FD from KMS signals when the commit we've just made becomes
+ * active, at the same time as the event handler will fire. We can use this
+ * to find when the _previous_ buffer is free to reuse again.
+ */
+static void output_commit_fences(gsl::shared_ptr<glplay::kms::DisplayAdapter> adapter,
+				 glplay::kms::Display &display)
+{
+	/* Async commits can't carry an out-fence; see output_add_atomic_req. */
+	if (display.explicitFencing && adapter->eglDevice.explicit_fencing && display.bufferLast &&
+	    display.commitFenceFD >= 0) {
+		assert(linux_sync_file_is_valid(display.commitFenceFD));
+		fd_replace(&display.bufferLast->kms_fence_fd,
+			   display.commitFenceFD);
+		display.commitFenceFD = -1;
+
+		/*
+		 * When rendering ahead, hand the buffer back straight away:
+		 * the GPU will wait on this fence before drawing into it, so
+		 * it is safe to queue the next frame into it already.
+		 */
+		if (display.presentQueueDepth > 0) {
+			display.bufferLast->in_use = false;
+			display.bufferLast = nullptr;
+		}
+	}
+}
+
+/*
+ * Commits a request holding only this output's new state, and takes its
+ * fences. Returns the commit's error, if any.
+ */
+static int commit_one_output(gsl::shared_ptr<glplay::kms::DisplayAdapter> adapter,
+			     glplay::kms::Display &display,
+			     drmModeAtomicReq *req, bool needs_modeset)
+{
+	auto async_flip = display.asyncFlip && display.presented;
+	struct timespec now;
+	int ret;
+
+	ret = atomic_commit(adapter, req, needs_modeset, async_flip);
+
+	/*
+	 * Drivers may still refuse an async flip, e.g. for a framebuffer
+	 * with a different modifier; from then on, go back to committing
+	 * the full state on vblank.
+	 */
+	if (async_flip && ret == -EINVAL) {
+		error("[%s] async flip rejected; falling back to vsynced commits\n",
+		      display.name.c_str());
+		display.asyncFlip = false;
+		drmModeAtomicSetCursor(req, 0);
+		output_add_atomic_req(&display, req, display.bufferPending);
+		ret = atomic_commit(adapter, req, needs_modeset, false);
+	}
+	if (ret != 0)
+		return ret;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	glplay::kms::RepaintScheduler::repaintCommitted(display, now);
+	output_commit_fences(adapter, display);
+	return 0;
+}
+
+/*
+ * Paints and commits a single output in its own atomic request. This is
+ * what each render thread does when it is kicked; the output's completion
+ * event still arrives on the main thread.
+ */
+static auto repaint_and_commit_one_output(gsl::shared_ptr<glplay::kms::DisplayAdapter> adapter,
+					  glplay::kms::Display &display,
+					  glplay::egl::RenderContext &rctx)
+	-> glplay::kms::RenderThread::RepaintStatus
+{
+	using RepaintStatus = glplay::kms::RenderThread::RepaintStatus;
+	auto needs_modeset = false;
+	auto committed = true;
+	auto more_work = false;
+	struct timespec now;
+	int ret = 0;
+
+	drmModeAtomicReq *req = drmModeAtomicAlloc();
+	assert(req);
+	if (display.presentQueueDepth > 0) {
+		more_work = repaint_one_output_ahead(adapter, display, rctx, req,
+						     &needs_modeset, &committed);
+	} else {
+		committed = repaint_one_output(adapter, display, rctx, req, &needs_modeset);
+	}
+
+	/*
+	 * We have this thread to ourselves, so rather than going back to the
+	 * scheduler, just sleep until a held frame may be committed.
+	 */
+	if (!committed && !glplay::kms::timespec_is_zero(&display.commit_after)) {
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		if (output_commit_held(display, &now)) {
+			glplay::nix::traceEvent(glplay::nix::TracePhase::Begin, "hold");
+			clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &display.commit_after, nullptr);
+			glplay::nix::traceEvent(glplay::nix::TracePhase::End, "hold");
+			if (display.presentQueueDepth > 0) {
+				more_work = repaint_one_output_ahead(adapter, display, rctx, req,
+								     &needs_modeset, &committed);
+			} else {
+				committed = repaint_one_output(adapter, display, rctx, req, &needs_modeset);
+			}
+		}
+	}
+	if (committed)
+		ret = commit_one_output(adapter, display, req, needs_modeset);
+	drmModeAtomicFree(req);
+	if (ret != 0) {
+		error("[%s] atomic commit failed: %d\n", display.name.c_str(), ret);
+		return RepaintStatus::Failed;
+	}
+	return more_work ? RepaintStatus::MoreWork : RepaintStatus::Idle;
+}
+
 static bool shall_exit = false;
 
 static void sighandler(int signo)
 {
 	if (signo == SIGINT)
 		shall_exit = true;
+	if (signo == SIGUSR1)
+		content_invalidated = 1;
+	if (signo == SIGUSR2)
+		trace_requested = 1;
+	if (signal_wakeup)
+		signal_wakeup->signal();
 	return;
 }
 
+/*
+ * One output's frame loop, as a coroutine: wait until a repaint is due,
+ * paint, wait for the GPU to finish, commit, and wait for KMS to latch the
+ * commit, then go round again. Everything it waits on is an fd or a
+ * deadline on the same reactor, so all outputs run their loops on this one
+ * thread without blocking each other.
+ */
+static glplay::nix::Task output_frame_loop(gsl::shared_ptr<glplay::kms::DisplayAdapter> adapter,
+					   glplay::kms::Display &display,
+					   glplay::egl::RenderContext &rctx,
+					   glplay::nix::Reactor &reactor)
+{
+	auto &woken = *frame_events[&display - adapter->displays.data()];
+	struct timespec now;
+
+	while (!shall_exit) {
+		/* The completion of our last commit tells us what to do next. */
+		if (display.bufferPending) {
+			co_await woken;
+			continue;
+		}
+
+		/* Where the scheduler would have armed its timer. */
+		if (display.repaintScheduled) {
+			co_await reactor.until(display.repaint_at);
+			display.repaintScheduled = false;
+			display.needs_repaint = true;
+		}
+
+		if (!display.needs_repaint) {
+			if (glplay::kms::VblankTracker::wantsWakeup(display))
+				adapter->vblankTracker.queueWakeup(display);
+			co_await woken;
+			continue;
+		}
+		display.needs_repaint = false;
+
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		if (output_timing_stale(display, &now))
+			adapter->vblankTracker.sample(display);
+
+		std::unique_ptr<drmModeAtomicReq, decltype(&drmModeAtomicFree)>
+			req(drmModeAtomicAlloc(), drmModeAtomicFree);
+		auto needs_modeset = false;
+		if (!repaint_one_output(adapter, display, rctx, req.get(), &needs_modeset)) {
+			co_await reactor.until(display.commit_after);
+			repaint_one_output(adapter, display, rctx, req.get(), &needs_modeset);
+		}
+
+		/*
+		 * KMS would wait for the render fence itself, but waiting
+		 * here keeps the commit from sitting in the kernel while the
+		 * GPU catches up.
+		 */
+		if (display.bufferPending->render_fence_fd >= 0) {
+			glplay::nix::traceEvent(glplay::nix::TracePhase::AsyncBegin, "render fence wait",
+						display.crtc->crtc_id);
+			co_await reactor.readable(display.bufferPending->render_fence_fd);
+			glplay::nix::traceEvent(glplay::nix::TracePhase::AsyncEnd, "render fence wait",
+						display.crtc->crtc_id);
+		}
+
+		auto ret = commit_one_output(adapter, display, req.get(), needs_modeset);
+		if (ret != 0) {
+			error("[%s] atomic commit failed: %d\n", display.name.c_str(), ret);
+			shall_exit = true;
+			break;
+		}
+
+		/*
+		 * The out-fence signals as the commit is latched, now kept
+		 * with the buffer it releases; the completion event follows
+		 * on the DRM FD.
+		 */
+		if (display.bufferLast && display.bufferLast->kms_fence_fd >= 0) {
+			glplay::nix::traceEvent(glplay::nix::TracePhase::AsyncBegin, "KMS fence wait",
+						display.crtc->crtc_id);
+			co_await reactor.readable(display.bufferLast->kms_fence_fd);
+			glplay::nix::traceEvent(glplay::nix::TracePhase::AsyncEnd, "KMS fence wait",
+						display.crtc->crtc_id);
+		}
+	}
+}
+
+/*
+ * Reads KMS events off the DRM FD and hands them to our handlers, which wake
+ * the outputs. With io_uring, the read completes in the same submission as
+ * everything else we are waiting on.
+ */
+static glplay::nix::Task kms_event_loop(gsl::shared_ptr<glplay::kms::DisplayAdapter> adapter,
+					glplay::nix::Reactor &reactor)
+{
+	glplay::drm::EventReader reader;
+	kms_event_handler handler = { adapter.get() };
+
+	while (!shall_exit) {
+		auto len = co_await reactor.read(adapter->getAdapterFD(), reader.data(), reader.size());
+		poll_woken_at = reactor.wokenAt();
+		if (len == -EAGAIN || len == -EINTR)
+			continue;
+		/* Our read was cancelled: we are shutting down. */
+		if (len == -ECANCELED)
+			break;
+		if (len < 0) {
+			error("error reading KMS events: %zd\n", len);
+			shall_exit = true;
+			break;
+		}
+		glplay::nix::TraceSpan span("kms events");
+		glplay::nix::traceCounter("kms events per read",
+					  (int64_t) reader.dispatch(static_cast<size_t>(len), handler));
+	}
+}
+
+/*
+ * Picks up signals: invalidates the outputs' content on SIGUSR1, and writes
+ * the trace on SIGUSR2.
+ */
+static glplay::nix::Task signal_loop(gsl::shared_ptr<glplay::kms::DisplayAdapter> adapter,
+				     glplay::nix::EventFD &wakeup,
+				     glplay::nix::Reactor &reactor)
+{
+	while (!shall_exit) {
+		co_await reactor.readable(wakeup.fileDescriptor());
+		wakeup.consume();
+		if (trace_requested) {
+			trace_requested = 0;
+			glplay::nix::traceWriteInBackground();
+		}
+		if (!content_invalidated)
+			continue;
+		content_invalidated = 0;
+		for (auto &display : adapter->displays) {
+			glplay::kms::RepaintScheduler::contentInvalidated(display);
+			output_wake(adapter.get(), display);
+		}
+	}
+}
+
+/*
+ * Runs every output's frame loop as a coroutine until we exit. The first
+ * frame has already been committed for all outputs together.
+ */
+static void run_frame_coroutines(gsl::shared_ptr<glplay::kms::DisplayAdapter> adapter,
+				 glplay::egl::RenderContext &rctx,
+				 glplay::nix::EventFD &wakeup)
+{
+	const char *uring_env = getenv("GLPLAY_IO_URING");
+	glplay::nix::Reactor reactor(uring_env != nullptr && strcmp(uring_env, "0") != 0);
+	std::vector<glplay::nix::Task> tasks;
+
+	for (size_t idx = 0; idx < adapter->displays.size(); idx++)
+		frame_events.emplace_back(std::make_unique<glplay::nix::AsyncEvent>(reactor));
+	for (auto &display : adapter->displays)
+		tasks.emplace_back(output_frame_loop(adapter, display, rctx, reactor));
+	tasks.emplace_back(kms_event_loop(adapter, reactor));
+	tasks.emplace_back(signal_loop(adapter, wakeup, reactor));
+
+	for (auto &task : tasks)
+		task.start();
+	while (!shall_exit && reactor.runOnce()) {
+	}
+	for (auto &task : tasks)
+		task.rethrow();
+	debug("reactor slept %" PRIu64 " times in %s\n", reactor.waits(),
+	      reactor.usingIoUring() ? "io_uring_enter" : "ppoll");
+
+	/*
+	 * Suspended coroutines go with their tasks, before the events they
+	 * wait on; but first the kernel must let go of the buffers and
+	 * timeouts in their frames which are still submitted to the ring.
+	 */
+	reactor.cancelAll();
+	tasks.clear();
+	frame_events.clear();
+}
+
 auto main(int argc, char *argv[]) -> int {
+	glplay::nix::traceSetup();
+	glplay::nix::traceNameThread("main");
+
 	auto paths = glplay::drm::getDevicePaths();
 	auto adapter = std::make_shared<glplay::kms::DisplayAdapter>(paths.at(0));
+	event_adapter = adapter.get();
 	//Create renderer here  vk_device_create or device_egl_setup or software
 
 	auto glplay_vt = glplay::nix::find_free_VT();
@@ -722,21 +1922,114 @@ auto main(int argc, char *argv[]) -> int {
 	int orig_mode = glplay::nix::disable_keyboard(glplay_vt.vt_fd);
 	glplay::nix::set_graphics(glplay_vt.vt_fd);
 	debug("VT setup complete\n");
+
+	/*
+	 * Render threads wake us through this if one of their commits fails,
+	 * so we don't sit in poll forever.
+	 */
+	glplay::nix::EventFD thread_wakeup;
+	auto main_rctx = adapter->eglDevice.deviceRenderContext();
+
+	/* Signals wake us through the same eventfd. */
+	const char *static_env = getenv("GLPLAY_STATIC_CONTENT");
+	animate = (static_env == nullptr || strcmp(static_env, "0") == 0);
+	signal_wakeup = &thread_wakeup;
+	struct sigaction action = {};
+	action.sa_handler = sighandler;
+	sigaction(SIGINT, &action, nullptr);
+	sigaction(SIGUSR1, &action, nullptr);
+	sigaction(SIGUSR2, &action, nullptr);
+
+	/*
+	 * Optionally give every output its own render thread and EGL context,
+	 * so one slow output can't hold up the others. The first frame is
+	 * still painted here and committed for all outputs together, so the
+	 * driver sees the complete configuration in a single modeset.
+	 */
+	const char *threads_env = getenv("GLPLAY_RENDER_THREADS");
+	if (threads_env != nullptr && strcmp(threads_env, "0") != 0) {
+		for (auto &display : adapter->displays) {
+			adapter->renderThreads.emplace_back(std::make_unique<glplay::kms::RenderThread>(
+				display, adapter->eglDevice,
+				[adapter](glplay::kms::Display &display, glplay::egl::RenderContext &rctx) {
+					return repaint_and_commit_one_output(adapter, display, rctx);
+				},
+				thread_wakeup));
+		}
+		debug("using %zu render threads\n", adapter->renderThreads.size());
+	}
+
+	/*
+	 * In real-time mode, the event loop runs under SCHED_FIFO with its
+	 * memory locked, and we keep the CPUs out of deep idle states for as
+	 * long as our outputs are active. Render threads have switched
+	 * themselves over already.
+	 */
+	std::unique_ptr<glplay::nix::CpuDmaLatency> dma_latency;
+	if (glplay::nix::realtimeConfig().enabled()) {
+		glplay::nix::lockMemory();
+		glplay::nix::enterRealtime("event loop");
+		try {
+			dma_latency = std::make_unique<glplay::nix::CpuDmaLatency>();
+		} catch (const std::runtime_error &err) {
+			error("%s\n", err.what());
+		}
+	}
+	/*
+	 * Optionally run each output's frame loop as a coroutine on a single
+	 * reactor, once the first frame has gone out. Render threads and
+	 * rendering ahead have loops of their own, so don't mix with it.
+	 */
+	const char *coroutines_env = getenv("GLPLAY_COROUTINES");
+	auto use_coroutines = (coroutines_env != nullptr && strcmp(coroutines_env, "0") != 0);
+	if (use_coroutines &&
+	    (!adapter->renderThreads.empty() ||
+	     std::any_of(adapter->displays.begin(), adapter->displays.end(),
+			 [](auto &display) { return display.presentQueueDepth > 0; }))) {
+		error("GLPLAY_COROUTINES does not work with render threads or render-ahead; ignoring\n");
+		use_coroutines = false;
+	}
+	if ((!adapter->renderThreads.empty() || use_coroutines) &&
+	    std::any_of(adapter->displays.begin(), adapter->displays.end(),
+			[](auto &display) { return display.beam.enabled(); })) {
+		error("GLPLAY_BEAM_RACE does not work with render threads or coroutines; ignoring\n");
+		for (auto &display : adapter->displays)
+			display.beam.disable();
+	}
+	if (!adapter->syncGroups.empty() && (!adapter->renderThreads.empty() || use_coroutines)) {
+		error("GLPLAY_SYNC_GROUP does not work with render threads or coroutines; ignoring\n");
+		adapter->syncGroups.clear();
+		for (auto &display : adapter->displays)
+			display.syncGroup = -1;
+	}
+	if (adapter->deadlines.isEnabled() && !adapter->renderThreads.empty()) {
+		error("GLPLAY_EDF does not work with render threads; ignoring\n");
+		adapter->deadlines.disable();
+	}
+	/*
+	 * Read all the KMS events pending at each wakeup in one go, unless
+	 * asked to go through libdrm instead.
+	 */
+	const char *libdrm_events_env = getenv("GLPLAY_LIBDRM_EVENTS");
+	auto use_libdrm_events = (libdrm_events_env != nullptr && strcmp(libdrm_events_env, "0") != 0);
+	glplay::drm::EventReader event_reader;
+	kms_event_handler event_handler = { adapter.get() };
 	debug("finished initialization\n");
 
 	while (!shall_exit) {
 		drmModeAtomicReq *req;
 		auto needs_modeset = false;
+		auto more_work = false;
 		int output_count = 0;
 		int ret = 0;
-		drmEventContext evctx = {
-			.version = 3,
-			.page_flip_handler2 = atomic_event_handler,
-		};
-		struct pollfd poll_fd = {
-			.fd = adapter->getAdapterFD(),
-			.events = POLLIN,
-		};
+		std::array<struct pollfd, 3> poll_fds = {{
+			{ .fd = adapter->getAdapterFD(), .events = POLLIN, },
+			{ .fd = adapter->scheduler.timerFD(), .events = POLLIN, },
+			{ .fd = thread_wakeup.fileDescriptor(), .events = POLLIN, },
+		}};
+		std::vector<glplay::kms::Display *> repainted;
+		auto beam_racing = false;
+		struct timespec now;
 
 		/*
 		 * Allocate an atomic-modesetting request structure for any
@@ -748,6 +2041,7 @@ auto main(int argc, char *argv[]) -> int {
 		 */
 		req = drmModeAtomicAlloc();
 		assert(req);
+		clock_gettime(CLOCK_MONOTONIC, &now);
 
 		/*
 		 * See which of our outputs needs repainting, and repaint them
@@ -760,16 +2054,103 @@ auto main(int argc, char *argv[]) -> int {
 		 * This is good since it gives the driver a complete overview
 		 * of any hardware changes it would need to perform to reach
 		 * the target state.
+		 *
+		 * The GPU renders them in the order we paint them, so with
+		 * GLPLAY_EDF the deadline scheduler puts the output whose
+		 * vblank comes first at the front.
 		 */
-		for (auto &display : adapter->displays) {
-			if(display.needs_repaint) {
-				/*
-				 * Add this output's new state to the atomic
-				 * request.
-				 */
-				repaint_one_output(adapter, display, req, &needs_modeset);
-				output_count++;
+		for (auto idx : adapter->deadlines.plan(adapter->displays, now)) {
+			auto &display = adapter->displays[idx];
+			auto threaded = !adapter->renderThreads.empty() && display.presented;
+
+			/*
+			 * Outputs rendering ahead keep filling their present
+			 * queue whenever there is room, and commit the oldest
+			 * frame as soon as their previous commit completes.
+			 */
+			if (display.presentQueueDepth > 0 && !threaded) {
+				bool committed;
+
+				display.needs_repaint = false;
+				more_work |= repaint_one_output_ahead(adapter, display, main_rctx, req,
+								      &needs_modeset, &committed);
+				if (committed) {
+					repainted.push_back(&display);
+					output_count++;
+				} else if (!glplay::kms::timespec_is_zero(&display.commit_after)) {
+					glplay::kms::RepaintScheduler::holdUntil(display, display.commit_after);
+				}
+				continue;
+			}
+
+			if(!display.needs_repaint)
+				continue;
+
+			/*
+			 * Outputs in a sync group wait for each other's commits
+			 * to complete, and are then painted together.
+			 */
+			if (display.syncGroup >= 0 &&
+			    !adapter->syncGroups[display.syncGroup].ready(adapter->displays))
+				continue;
+			display.needs_repaint = false;
+
+			/*
+			 * Once its first frame is up, a beam-racing output
+			 * keeps that buffer, and renders into it a strip at a
+			 * time rather than committing new ones.
+			 */
+			if (display.beam.enabled() && display.presented && !threaded) {
+				beam_race_output(adapter, display, main_rctx);
+				beam_racing = true;
+				continue;
+			}
+
+			/*
+			 * Coming back from idle, our last completion is too
+			 * old to predict the next vblank from accurately, so
+			 * take a fresh sample of the CRTC's vblank first.
+			 */
+			if (display.presented && output_timing_stale(display, &now)) {
+				std::unique_lock<std::mutex> display_lock;
+				if (threaded)
+					display_lock = adapter->renderThreads[idx]->lockDisplay();
+				adapter->vblankTracker.sample(display);
+			}
+
+			/*
+			 * Once an output is up and running, its render thread
+			 * (if any) takes care of painting and committing it.
+			 */
+			if (threaded) {
+				adapter->renderThreads[idx]->kick();
+				continue;
+			}
+
+			/*
+			 * Async flips have to be committed on their own, so
+			 * immediate-mode outputs get a request of their own.
+			 */
+			if (display.asyncFlip && display.presented) {
+				if (repaint_and_commit_one_output(adapter, display, main_rctx) ==
+				    glplay::kms::RenderThread::RepaintStatus::Failed) {
+					shall_exit = true;
+					break;
+				}
+				continue;
+			}
+
+			/*
+			 * Add this output's new state to the atomic
+			 * request, or have the scheduler wake us when a held
+			 * frame may go in.
+			 */
+			if (!repaint_one_output(adapter, display, main_rctx, req, &needs_modeset)) {
+				glplay::kms::RepaintScheduler::holdUntil(display, display.commit_after);
+				continue;
 			}
+			repainted.push_back(&display);
+			output_count++;
 		}
 
 				/*
@@ -791,26 +2172,54 @@ auto main(int argc, char *argv[]) -> int {
 		 * with the content for every output.
 		 */
 		if (output_count != 0)
-			ret = atomic_commit(adapter, req, &needs_modeset);
+			ret = atomic_commit(adapter, req, needs_modeset, false);
 		drmModeAtomicFree(req);
 		if (ret != 0) {
 			error("atomic commit failed: %d\n", ret);
 			break;
 		}
 
+		if (output_count != 0) {
+			clock_gettime(CLOCK_MONOTONIC, &now);
+			for (auto *display : repainted)
+				glplay::kms::RepaintScheduler::repaintCommitted(*display, now);
+			adapter->batcher.committed(output_count);
+		}
+
+		for (auto *display : repainted)
+			output_commit_fences(adapter, *display);
+
 		/*
-		 * The out-fence FD from KMS signals when the commit we've just
-		 * made becomes active, at the same time as the event handler
-		 * will fire. We can use this to find when the _previous_
-		 * buffer is free to reuse again.
+		 * Outputs with nothing in flight won't send us completions, so
+		 * until we have locked on to their vblank timing, ask for
+		 * vblank events instead. Outputs with render threads get
+		 * there from their own completions.
 		 */
 		for (auto &display : adapter->displays) {
-			if (display.explicitFencing && adapter->eglDevice.explicit_fencing && display.bufferLast) {
-				assert(linux_sync_file_is_valid(display.commitFenceFD));
-				fd_replace(&display.bufferLast->kms_fence_fd,
-					   display.commitFenceFD);
-				display.commitFenceFD = -1;
-			}
+			if ((adapter->renderThreads.empty() || !display.presented) &&
+			    glplay::kms::VblankTracker::wantsWakeup(display))
+				adapter->vblankTracker.queueWakeup(display);
+		}
+
+		/*
+		 * In coroutine mode, every output carries on from its first
+		 * frame in a frame loop of its own.
+		 */
+		if (use_coroutines) {
+			run_frame_coroutines(adapter, main_rctx, thread_wakeup);
+			break;
+		}
+
+		/*
+		 * Beam-racing outputs picked the time of their next strip
+		 * while rendering, not from a completion, so arm the timer
+		 * for it now.
+		 */
+		if (beam_racing) {
+			clock_gettime(CLOCK_MONOTONIC, &now);
+			adapter->scheduler.dispatch(adapter->displays, now);
+			more_work |= std::any_of(adapter->displays.begin(), adapter->displays.end(),
+						 [](auto &display) { return display.needs_repaint; });
 		}
 
 		/*
@@ -819,19 +2228,133 @@ auto main(int argc, char *argv[]) -> int {
 		 * completes, we will receive one event per output (making
 		 * the DRM FD be readable and waking us from poll), which we
 		 * then dispatch through drmHandleEvent into our callback.
+		 *
+		 * If an output could still render further ahead, only check
+		 * for events without sleeping, then come back to render.
 		 */
-		ret = poll(&poll_fd, 1, -1);
-		if (ret == -1) {
+		glplay::nix::traceEvent(glplay::nix::TracePhase::Begin, "poll");
+		ret = poll(poll_fds.data(), poll_fds.size(), more_work ? 0 : -1);
+		glplay::nix::traceEvent(glplay::nix::TracePhase::End, "poll");
+		if (ret == -1 && errno != EINTR) {
 			error("error polling KMS FD: %d\n", ret);
 			break;
 		}
+		clock_gettime(CLOCK_MONOTONIC, &poll_woken_at);
+
+		if ((poll_fds[0].revents & POLLIN) && use_libdrm_events) {
+			glplay::nix::TraceSpan span("kms events");
+			ret = drmHandleEvent(adapter->getAdapterFD(), &evctx);
+			if (ret == -1) {
+				error("error reading KMS events: %d\n", ret);
+				break;
+			}
+		} else if (poll_fds[0].revents & POLLIN) {
+			glplay::nix::TraceSpan span("kms events");
+			auto events = event_reader.drain(adapter->getAdapterFD(), event_handler);
+			if (events >= 0)
+				glplay::nix::traceCounter("kms events per read", events);
+			if (events < 0 && events != -EINTR && events != -EAGAIN) {
+				error("error reading KMS events: %zd\n", events);
+				break;
+			}
+		}
 
-		ret = drmHandleEvent(adapter->getAdapterFD(), &evctx);
-		if (ret == -1) {
-			error("error reading KMS events: %d\n", ret);
-			break;
+		/*
+		 * Either some repaint deadlines have arrived, or completion
+		 * events have given us new ones; let the scheduler flag the
+		 * outputs which are due and rearm its timer for the rest.
+		 */
+		if (poll_fds[2].revents & POLLIN) {
+			thread_wakeup.consume();
+			if (std::any_of(adapter->renderThreads.begin(), adapter->renderThreads.end(),
+					[](auto &thread) { return thread->failed(); }))
+				break;
 		}
+
+		if (trace_requested) {
+			trace_requested = 0;
+			glplay::nix::traceWriteInBackground();
+		}
+
+		if (content_invalidated) {
+			content_invalidated = 0;
+			for (size_t idx = 0; idx < adapter->displays.size(); idx++) {
+				std::unique_lock<std::mutex> display_lock;
+				if (!adapter->renderThreads.empty())
+					display_lock = adapter->renderThreads[idx]->lockDisplay();
+				glplay::kms::RepaintScheduler::contentInvalidated(adapter->displays[idx]);
+			}
+		}
+
+		if (poll_fds[1].revents & POLLIN)
+			adapter->scheduler.timerExpired(poll_woken_at);
+		clock_gettime(CLOCK_MONOTONIC, &now);
+
+		/*
+		 * Outputs with their own render threads commit on their own;
+		 * the others can share this loop's request with whichever
+		 * outputs are due, if their vblanks are close enough.
+		 */
+		if (adapter->renderThreads.empty())
+			adapter->batcher.coalesce(adapter->displays, now);
+		adapter->scheduler.dispatch(adapter->displays, now);
+		for (auto &group : adapter->syncGroups)
+			group.coalesce(adapter->displays);
+	}
+
+	/* Stop the render threads before their displays go away. */
+	adapter->renderThreads.clear();
+	/* Frames still queued or in flight will never be reported on screen. */
+	for (auto &display : adapter->displays)
+		display.discardPendingFrames();
+	glplay::nix::traceWrite();
+
+	/*
+	 * How long commits took to reach the screen; run with and without
+	 * GLPLAY_IMMEDIATE to compare async flips with vsynced commits.
+	 */
+	for (auto &display : adapter->displays)
+		display.flipLatency.report(display.name.c_str(),
+					   display.asyncFlip ? "commit to flip (async)" :
+							       "commit to flip (vsync)");
+
+	/*
+	 * How promptly we woke up for each vblank's event and for repaint
+	 * deadlines; compare runs with and without GLPLAY_RT_PRIORITY.
+	 */
+	for (auto &display : adapter->displays)
+		display.wakeupLatency.report(display.name.c_str(), "vblank to poll wakeup");
+	/*
+	 * How close frames went on screen to the time they were meant for,
+	 * as their presentation feedback reported it.
+	 */
+	for (auto &display : adapter->displays) {
+		display.presentationError.report(display.name.c_str(), "target to presentation");
+		if (display.presentationError.samples() > 0)
+			fprintf(stderr, "[%s] presentation: %" PRIu64 " frames late, %" PRIu64 " dropped\n",
+				display.name.c_str(), display.framesLate, display.framesDiscarded);
+	}
+	for (auto &display : adapter->displays) {
+		if (display.mailbox && display.mailboxRendered > 0)
+			fprintf(stderr, "[%s] mailbox: %" PRIu64 " frames rendered, %" PRIu64 " replaced before being shown\n",
+				display.name.c_str(), display.mailboxRendered, display.mailboxReplaced);
+	}
+	for (auto &display : adapter->displays) {
+		display.gpuTime.report(display.name.c_str(), "GPU render (timer query)");
+		if (display.gpuTimer.framesSkipped() > 0)
+			fprintf(stderr, "[%s] GPU timer: %" PRIu64 " frames not timed\n",
+				display.name.c_str(), display.gpuTimer.framesSkipped());
 	}
+	for (auto &display : adapter->displays)
+		display.stages.report(display.name.c_str());
+	adapter->deadlines.report(adapter->displays);
+	for (auto &display : adapter->displays)
+		display.beam.report(display.name.c_str());
+	for (auto &group : adapter->syncGroups)
+		group.report();
+	adapter->scheduler.wakeupLateness().report("scheduler", "timer deadline to poll wakeup");
+	adapter->batcher.report();
+	dma_latency.reset();
 
 	glplay::nix::set_text(glplay_vt.vt_fd, orig_mode);
 	glplay::nix::activate_vt(glplay_vt.vt_fd, orig_vt);
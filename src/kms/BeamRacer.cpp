@@ -0,0 +1,103 @@
+#include "BeamRacer.hpp"
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+#include "time.hpp"
+
+namespace glplay::kms {
+
+  void BeamRacer::setup(const drmModeModeInfo &mode, unsigned int strips, bool testMode) {
+    vdisplay = mode.vdisplay;
+    vtotal = mode.vtotal;
+    count = std::min(strips, vdisplay);
+    test = testMode;
+    lead.assign(count, LatencyStats());
+  }
+
+  auto BeamRacer::next(const struct timespec &vblank, int64_t periodNsec, const struct timespec &now) -> Strip {
+    Strip strip;
+    auto lineNsec = static_cast<double>(periodNsec) / vtotal;
+    auto stripLines = vdisplay / count;
+    auto stripNsec = static_cast<int64_t>(stripLines * lineNsec);
+    /* Until we have measured a strip, assume it takes half a strip's scanout. */
+    auto minLead = cost.sampleCount() > 0 ? cost.estimate() : stripNsec / 2;
+
+    auto elapsed = timespec_sub_to_nsec(&now, &vblank);
+    timespec_add_nsec(&strip.frameStart, &vblank, elapsed > 0 ? (elapsed / periodNsec) * periodNsec : 0);
+
+    /* The strip the beam will reach next with time to spare, in this frame or the next. */
+    for (unsigned int frame = 0; frame < 2; frame++) {
+      for (unsigned int idx = 0; idx < count; idx++) {
+        timespec_add_nsec(&strip.scanout, &strip.frameStart,
+                          static_cast<int64_t>(idx * stripLines * lineNsec));
+        if (!timespec_is_zero(&lastScanout) && timespec_sub_to_nsec(&strip.scanout, &lastScanout) <= 0) {
+          continue;
+        }
+        if (timespec_sub_to_nsec(&strip.scanout, &now) < minLead) {
+          if (!timespec_is_zero(&lastScanout)) {
+            stripsSkipped++;
+          }
+          continue;
+        }
+
+        strip.index = idx;
+        strip.firstLine = idx * stripLines;
+        strip.lines = (idx == count - 1) ? vdisplay - strip.firstLine : stripLines;
+        timespec_add_nsec(&strip.renderAt, &strip.scanout,
+                          -std::max(stripNsec, minLead + minLead / 2));
+        return strip;
+      }
+      timespec_add_nsec(&strip.frameStart, &strip.frameStart, periodNsec);
+    }
+
+    /* Only reachable with strips costing more than a frame: start over. */
+    strip.frameStart = now;
+    strip.scanout = now;
+    strip.renderAt = now;
+    strip.lines = stripLines;
+    return strip;
+  }
+
+  void BeamRacer::rendered(const Strip &strip, const struct timespec &started, int fenceFd) {
+    lastScanout = strip.scanout;
+    stripsRendered++;
+    if (fenceFd >= 0) {
+      pending.push_back({ strip.index, strip.scanout, started, fenceFd });
+    }
+  }
+
+  void BeamRacer::landed(const PendingStrip &strip, int64_t doneNsec, const char *name) {
+    cost.addSample(doneNsec - static_cast<int64_t>(timespec_to_nsec(&strip.started)));
+
+    auto ahead = static_cast<int64_t>(timespec_to_nsec(&strip.scanout)) - doneNsec;
+    if (strip.index < lead.size()) {
+      lead[strip.index].add(ahead);
+    }
+    if (ahead < 0) {
+      stripsLate++;
+    }
+    if (test) {
+      fprintf(stderr, "[%s] strip %u landed %" PRIi64 "us %s the beam\n",
+              name, strip.index, static_cast<int64_t>(llabs(static_cast<long long>(ahead))) / 1000,
+              ahead >= 0 ? "ahead of" : "behind");
+    }
+  }
+
+  void BeamRacer::report(const char *name) const {
+    if (stripsRendered == 0) {
+      return;
+    }
+    for (unsigned int idx = 0; idx < lead.size(); idx++) {
+      auto what = "beam lead, strip " + std::to_string(idx);
+      lead[idx].report(name, what.c_str());
+    }
+    fprintf(stderr, "[%s] beam racing: %" PRIu64 " strips rendered, %" PRIu64 " skipped, "
+            "%" PRIu64 " landed behind the beam\n",
+            name, stripsRendered, stripsSkipped, stripsLate);
+  }
+
+}
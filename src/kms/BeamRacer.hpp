@@ -0,0 +1,96 @@
+#pragma once
+
+#include <cstdint>
+#include <ctime>
+#include <deque>
+#include <vector>
+
+#include <xf86drmMode.h>
+
+#include "LatencyStats.hpp"
+#include "RepaintBudget.hpp"
+
+namespace glplay::kms {
+
+  /*
+  * Schedules front-buffer rendering racing the scanout beam.
+  *
+  * Instead of flipping to a new buffer every frame, a beam-racing display
+  * keeps one buffer on its plane and renders into it a horizontal strip at
+  * a time, each just before the CRTC scans it out. KMS timestamps vblanks
+  * at the start of active scanout, so line N of the frame starting at a
+  * vblank goes out N * (period / vtotal) after it. Each strip is rendered
+  * when the beam enters the strip above it, unless its measured cost no
+  * longer fits before the beam reaches it, in which case it is skipped for
+  * that frame.
+  *
+  * Once each strip's render fence signals, we record how far ahead of the
+  * beam it landed; a strip landing behind it tore.
+  */
+  class BeamRacer {
+    public:
+      /* A strip of the frame, and when the beam reaches its first line. */
+      struct Strip {
+        unsigned int index = 0;
+        unsigned int firstLine = 0;
+        unsigned int lines = 0;
+        /* When the frame holding this strip starts scanning out. */
+        struct timespec frameStart{};
+        struct timespec scanout{};
+        /* When we should start rendering it. */
+        struct timespec renderAt{};
+      };
+
+      /* A strip handed to the GPU, waiting for its render fence. */
+      struct PendingStrip {
+        unsigned int index;
+        struct timespec scanout;
+        struct timespec started;
+        int fenceFd;
+      };
+
+      /*
+      * Enables beam racing with the given number of strips for a mode;
+      * in test mode, every strip's landing is printed as it comes in.
+      */
+      void setup(const drmModeModeInfo &mode, unsigned int strips, bool test);
+      void disable() { count = 0; }
+      [[nodiscard]] auto enabled() const -> bool { return count > 0; }
+      [[nodiscard]] auto testMode() const -> bool { return test; }
+      [[nodiscard]] auto strips() const -> unsigned int { return count; }
+
+      /*
+      * The next strip we can still render in time, from the latest
+      * vblank timestamp, the vblank period, and the current time.
+      */
+      auto next(const struct timespec &vblank, int64_t periodNsec, const struct timespec &now) -> Strip;
+
+      /* Records that a strip was handed to the GPU, with its render fence if any. */
+      void rendered(const Strip &strip, const struct timespec &started, int fenceFd);
+      /* Records that a pending strip's rendering finished at doneNsec. */
+      void landed(const PendingStrip &strip, int64_t doneNsec, const char *name);
+
+      /* Prints how far ahead of the beam strips landed when we exit. */
+      void report(const char *name) const;
+
+      /* Strips whose render fences have not been collected yet, oldest first. */
+      std::deque<PendingStrip> pending;
+
+    private:
+      unsigned int vdisplay = 0;
+      unsigned int vtotal = 0;
+      unsigned int count = 0;
+      bool test = false;
+
+      /* Scanout time of the last strip we rendered. */
+      struct timespec lastScanout{};
+      /* How long strips take from submission until their fence signals. */
+      RepaintBudget cost;
+
+      std::vector<LatencyStats> lead;
+      uint64_t stripsRendered = 0;
+      uint64_t stripsSkipped = 0;
+      uint64_t stripsLate = 0;
+  };
+
+}
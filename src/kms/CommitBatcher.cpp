@@ -0,0 +1,93 @@
+#include "CommitBatcher.hpp"
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+
+namespace glplay::kms {
+
+  CommitBatcher::CommitBatcher() {
+    const char *env = getenv("GLPLAY_COALESCE_USEC");
+    if (env != nullptr) {
+      window = strtoll(env, nullptr, 10) * 1000;
+    }
+    debug("%scoalescing commits (window %" PRIi64 "ns)\n", window > 0 ? "" : "not ", window);
+  }
+
+  /* The vblank a display's next frame is for, as far as we know yet. */
+  static auto nextVblank(const Display &display) -> struct timespec {
+    if (display.bufferHeld != nullptr) {
+      return display.next_frame;
+    }
+    return display.nextFrameTarget(display.last_frame);
+  }
+
+  void CommitBatcher::coalesce(std::vector<Display> &displays, const struct timespec &now) {
+    if (window <= 0) {
+      return;
+    }
+
+    std::vector<struct timespec> dueVblanks;
+    for (auto &display : displays) {
+      auto due = display.needs_repaint ||
+        (display.repaintScheduled && timespec_sub_to_nsec(&display.repaint_at, &now) <= 0);
+      if (due && display.presented) {
+        dueVblanks.push_back(nextVblank(display));
+      }
+    }
+    if (dueVblanks.empty()) {
+      return;
+    }
+
+    for (auto &display : displays) {
+      if (!display.repaintScheduled || display.bufferHeld != nullptr ||
+          timespec_sub_to_nsec(&display.repaint_at, &now) <= 0) {
+        continue;
+      }
+
+      auto vblank = nextVblank(display);
+      for (auto &dueVblank : dueVblanks) {
+        if (llabs(static_cast<long long>(timespec_sub_to_nsec(&vblank, &dueVblank))) > window) {
+          continue;
+        }
+        debug("[%s] repaint brought forward %" PRIi64 "ns to share a commit\n",
+              display.name.c_str(), timespec_sub_to_nsec(&display.repaint_at, &now));
+        display.repaint_at = now;
+        pulledForward++;
+        break;
+      }
+    }
+  }
+
+  void CommitBatcher::committed(unsigned int outputs) {
+    if (outputs == 0) {
+      return;
+    }
+    commits++;
+    outputsCommitted += outputs;
+    commitSizes.at(std::min(outputs, MAX_REPORTED_OUTPUTS + 1) - 1)++;
+  }
+
+  void CommitBatcher::report() const {
+    if (commits == 0) {
+      return;
+    }
+
+    uint64_t merged = commits - commitSizes.at(0);
+    fprintf(stderr, "[commits] %" PRIu64 " commits for %" PRIu64 " output updates (%.2f per commit), "
+            "%" PRIu64 " merged (%.1f%%), %" PRIu64 " repaints brought forward\n",
+            commits, outputsCommitted,
+            static_cast<double>(outputsCommitted) / static_cast<double>(commits),
+            merged, 100.0 * static_cast<double>(merged) / static_cast<double>(commits),
+            pulledForward);
+    for (unsigned int idx = 1; idx < commitSizes.size(); idx++) {
+      if (commitSizes.at(idx) == 0) {
+        continue;
+      }
+      fprintf(stderr, "[commits] %u%s outputs: %" PRIu64 "\n", idx + 1,
+              idx == MAX_REPORTED_OUTPUTS ? "+" : "", commitSizes.at(idx));
+    }
+  }
+
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <ctime>
+#include <vector>
+
+#include "Display.hpp"
+
+namespace glplay::kms {
+
+  /*
+  * Merges the commits of displays whose vblanks are close together.
+  *
+  * The main loop puts every display due for a repaint in the same iteration
+  * into one atomic request, but with just-in-time repaints, displays which
+  * are a little out of phase each wake us up and get a commit of their own.
+  * When one display is due, the batcher looks at every display's predicted
+  * next vblank, and brings forward the repaint of any display whose vblank
+  * falls within a window of the due display's, so they all go out in one
+  * request. The cost is starting those repaints up to the window early.
+  *
+  * The window comes from GLPLAY_COALESCE_USEC; 0 turns this off.
+  */
+  class CommitBatcher {
+    public:
+      /* Largest commit size the report breaks out. */
+      static const unsigned int MAX_REPORTED_OUTPUTS = 16;
+
+      CommitBatcher();
+
+      [[nodiscard]] auto windowNsec() const -> int64_t { return window; }
+
+      /*
+      * If any display is due at 'now', brings forward the repaint of every
+      * display whose next vblank is within the window of a due display's,
+      * so the scheduler flags them as due too. Call before dispatch().
+      */
+      void coalesce(std::vector<Display> &displays, const struct timespec &now);
+
+      /* Records one atomic commit carrying the given number of outputs. */
+      void committed(unsigned int outputs);
+
+      /* Prints how often commits were merged when we exit. */
+      void report() const;
+
+    private:
+      int64_t window = 0;
+      uint64_t commits = 0;
+      uint64_t outputsCommitted = 0;
+      uint64_t pulledForward = 0;
+      /* Commits by number of outputs; the last entry counts anything larger. */
+      std::array<uint64_t, MAX_REPORTED_OUTPUTS + 1> commitSizes{};
+  };
+
+}
@@ -0,0 +1,130 @@
+#include "DeadlineScheduler.hpp"
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <numeric>
+
+namespace glplay::kms {
+
+  DeadlineScheduler::DeadlineScheduler() {
+    const char *env = getenv("GLPLAY_EDF");
+    enabled = (env != nullptr && strcmp(env, "0") != 0);
+    debug("%sordering repaints by deadline\n", enabled ? "" : "not ");
+  }
+
+  /* The vblank a display's next frame has to be ready for. */
+  static auto deadlineOf(const Display &display, const struct timespec &now) -> struct timespec {
+    if (!display.presented) {
+      return now;
+    }
+    if (display.bufferHeld != nullptr || !timespec_is_zero(&display.commit_after)) {
+      return display.next_frame;
+    }
+    return display.nextFrameTarget(display.last_frame);
+  }
+
+  auto DeadlineScheduler::plan(std::vector<Display> &displays, const struct timespec &now)
+    -> const std::vector<size_t> & {
+    order.resize(displays.size());
+    std::iota(order.begin(), order.end(), 0);
+    if (!enabled) {
+      return order;
+    }
+
+    std::vector<struct timespec> deadlines;
+    deadlines.reserve(displays.size());
+    for (auto &display : displays) {
+      deadlines.push_back(deadlineOf(display, now));
+    }
+
+    auto due = [&displays](size_t idx) {
+      return displays[idx].needs_repaint || displays[idx].presentQueueDepth > 0;
+    };
+    auto dueEnd = std::stable_partition(order.begin(), order.end(), due);
+    std::stable_sort(order.begin(), dueEnd, [&deadlines](size_t lhs, size_t rhs) {
+      return timespec_sub_to_nsec(&deadlines[lhs], &deadlines[rhs]) < 0;
+    });
+
+    /*
+    * Predict when each display's frame will be done if everything ahead
+    * of it goes first; a display which won't make it whatever we do goes
+    * to the back, so it only delays frames which would be late anyway.
+    */
+    auto finish = now;
+    auto admitted = [&](size_t idx) {
+      auto &display = displays[idx];
+      if (!display.presented || display.presentQueueDepth > 0 || display.asyncFlip ||
+          !display.needs_repaint) {
+        return true;
+      }
+      /*
+      * Once timer queries have measured what the display costs the GPU,
+      * that is what it adds to the queue. Its repaint budget runs until
+      * its render fence, so it already includes waiting behind the
+      * displays painted before it; adding those up counts that twice, so
+      * it is only what we go on until we have measurements.
+      */
+      auto cost = display.gpuBudget.sampleCount() > 0 ? display.gpuBudget.estimate() :
+        display.repaintBudget.estimate();
+      struct timespec done;
+      timespec_add_nsec(&done, &finish, cost);
+      if (timespec_sub_to_nsec(&done, &deadlines[idx]) <= 0) {
+        display.deadlineDeferStreak = 0;
+        finish = done;
+        return true;
+      }
+
+      display.deadlinesDeferred++;
+      debug("[%s] repaint deferred: would finish %" PRIi64 "ns after its vblank\n",
+            display.name.c_str(), timespec_sub_to_nsec(&done, &deadlines[idx]));
+      if (++display.deadlineDeferStreak >= DEFER_FRAMES) {
+        display.deadlineDeferStreak = 0;
+        if (display.pacing.slowDown()) {
+          display.deadlineFallbacks++;
+          debug("[%s] pacing at 1/%u of refresh rate to share the GPU\n",
+                display.name.c_str(), display.pacing.divisor());
+        }
+      }
+      return false;
+    };
+    std::vector<size_t> deferred;
+    auto out = order.begin();
+    for (auto it = order.begin(); it != dueEnd; ++it) {
+      if (admitted(*it)) {
+        *out++ = *it;
+      } else {
+        deferred.push_back(*it);
+      }
+    }
+    std::copy(deferred.begin(), deferred.end(), out);
+    return order;
+  }
+
+  void DeadlineScheduler::frameCompleted(Display &display, bool missed) {
+    display.deadlineFrames++;
+    if (missed) {
+      display.deadlinesMissed++;
+    }
+  }
+
+  void DeadlineScheduler::report(const std::vector<Display> &displays) const {
+    if (!enabled) {
+      return;
+    }
+    for (const auto &display : displays) {
+      if (display.deadlineFrames == 0) {
+        continue;
+      }
+      fprintf(stderr, "[%s] deadlines: %" PRIu64 " frames, %" PRIu64 " missed (%.1f%%), "
+              "%" PRIu64 " repaints deferred, %" PRIu64 " frame rate fallbacks\n",
+              display.name.c_str(), display.deadlineFrames, display.deadlinesMissed,
+              100.0 * static_cast<double>(display.deadlinesMissed) /
+                static_cast<double>(display.deadlineFrames),
+              display.deadlinesDeferred, display.deadlineFallbacks);
+    }
+  }
+
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstdint>
+#include <ctime>
+#include <vector>
+
+#include "Display.hpp"
+
+namespace glplay::kms {
+
+  /*
+  * Orders the repaints of displays sharing the GPU by their deadlines.
+  *
+  * The main loop paints every due display one after the other, and the GPU
+  * works through them in the order they were submitted. Going in vector
+  * order, a 60Hz display's repaint can hold up a 144Hz display whose next
+  * vblank is much sooner, and make it miss. Instead, the scheduler sorts
+  * the due displays by the vblank their frame is for, earliest first.
+  *
+  * Walking that order, it adds up what each display costs the GPU, as
+  * measured by timer queries (or, until those come in, its repaint cost,
+  * which runs until its render fence signals), to predict when its frame
+  * will be done. A display which could not make its vblank even so is
+  * deferred behind all the others, rather than delaying them for a frame
+  * which will be late anyway. A display deferred for several frames in a
+  * row is asked to drop to a lower frame rate by its pacing governor.
+  *
+  * Enabled with GLPLAY_EDF. Render threads submit their displays' work on
+  * their own, so it is not used with them.
+  */
+  class DeadlineScheduler {
+    public:
+      /* Consecutive deferred frames which make us lower a display's frame rate. */
+      static const unsigned int DEFER_FRAMES = 3;
+
+      DeadlineScheduler();
+
+      [[nodiscard]] auto isEnabled() const -> bool { return enabled; }
+      void disable() { enabled = false; }
+
+      /*
+      * The order to go through the displays in at 'now': displays due for
+      * a repaint by deadline, those deferred, then the rest.
+      */
+      auto plan(std::vector<Display> &displays, const struct timespec &now)
+        -> const std::vector<size_t> &;
+
+      /* Records whether the display's last frame made its vblank. */
+      static void frameCompleted(Display &display, bool missed);
+
+      /* Prints how many deadlines each display missed when we exit. */
+      void report(const std::vector<Display> &displays) const;
+
+    private:
+      bool enabled = false;
+      std::vector<size_t> order;
+  };
+
+}
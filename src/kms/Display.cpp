@@ -1,12 +1,20 @@
 #include "Display.hpp"
 #include "Edid.hpp"
 #include "kms.hpp"
+#include <algorithm>
 #include <array>
+#include <cmath>
 #include <cstdint>
 #include <gbm.h>
 
 namespace glplay::kms {
 
+  /* Refresh rate of a mode in mHz, rounded to the nearest. */
+  static auto modeRefreshMilliHz(const drmModeModeInfo &mode) -> int64_t {
+    return ((mode.clock * 1000000LL / mode.htotal) +
+		  (mode.vtotal / 2)) / mode.vtotal;
+  }
+
   void Display::buffer_egl_destroy(int adapterFD, egl::EGLDevice &eglDevice, Buffer &buffer) {
     drmModeRmFB(adapterFD, buffer.fb_id);
     static PFNEGLDESTROYIMAGEKHRPROC destroy_img = nullptr;
@@ -68,6 +76,12 @@ namespace glplay::kms {
     explicitFencing(false), connector(drm::make_connetor_ptr(adapterFD, connectorId)) {
     auto encoder = findEncoderForConnector(adapterFD, resources, connector);
     this->crtc = findCrtcForEncoder(adapterFD, resources, encoder);
+    /* Planes name the CRTCs they can go on by their index, not their ID. */
+    for (int idx = 0; idx < resources->count_crtcs; idx++) {
+      if (resources->crtcs[idx] == crtc->crtc_id) {
+        crtcIndex = static_cast<unsigned int>(idx);
+      }
+    }
 
     auto planeResources = drm::make_plane_resources_ptr(adapterFD);
 
@@ -81,14 +95,14 @@ namespace glplay::kms {
     }
 
     this->primary_plane = findPrimaryPlaneForCrtc();
-    auto refresh = ((crtc->mode.clock * 1000000LL / crtc->mode.htotal) +
-		  (crtc->mode.vtotal / 2)) / crtc->mode.vtotal;
+    auto refresh = modeRefreshMilliHz(crtc->mode);
 
     name = ((connector->connector_type < drm::connectorTypes.size()) ?
 		 	drm::connectorTypes.at(connector->connector_type) :
 			"UNKNOWN") + "-" + std::to_string(connector->connector_type_id);
 
     refreshIntervalNsec = millihzToNsec(refresh);
+    frameBaseNsec = refreshIntervalNsec;
 
     mode_blob_id = drm::mode_blob_create(adapterFD, &crtc->mode);
 
@@ -103,6 +117,8 @@ namespace glplay::kms {
     drm::drm_property_info_populate(adapterFD, drm::connector_props, this->props.connector, drm::connector_props.size(), connectorProps);
 
     this->get_edid(adapterFD, connectorProps);
+    this->vrrCapable =
+      drm::drm_property_get_value(&this->props.connector.at(drm::WDRM_CONNECTOR_VRR_CAPABLE), connectorProps, 0) != 0;
 
     /*
 	  * Set if we support explicit fencing inside KMS; the EGL renderer will
@@ -115,73 +131,221 @@ namespace glplay::kms {
   }
 
   void Display::createEGLBuffers(int adapterFD, bool adapterSupportsFBModifiers, egl::EGLDevice &eglDevice, gbm::GBMDevice &gbmDevice) {
-    for (int idx = 0; idx < BUFFER_QUEUE_DEPTH; idx++) {
-      Buffer buffer = createEGLBuffer(adapterFD, adapterSupportsFBModifiers, eglDevice, gbmDevice);
-      std::array<uint64_t, 4> buffer_modifiers = { 0, };
-
-      for (int i = 0; buffer.gem_handles.at(i); i++) {
-        buffer_modifiers.at(i) = buffer.modifier;
-        debug("[GEM:%" PRIu32 "]: %u x %u %s buffer (plane %d), pitch %u\n",
-              buffer.gem_handles.at(i), buffer.width, buffer.height,
-              "GBM",
-              i, buffer.pitches.at(i));
+    auto count = std::max(MIN_BUFFER_COUNT, presentQueueDepth + 2);
+    for (unsigned int idx = 0; idx < count; idx++) {
+      Buffer buffer = createEGLBuffer(adapterFD, adapterSupportsFBModifiers, eglDevice, gbmDevice,
+                                      crtc->mode.hdisplay, crtc->mode.vdisplay);
+      addFramebuffer(adapterFD, eglDevice, buffer);
+      buffers.push_back(buffer);
+    }
+  }
+
+  void Display::addFramebuffer(int adapterFD, egl::EGLDevice &eglDevice, Buffer &buffer) {
+    std::array<uint64_t, 4> buffer_modifiers = { 0, };
+
+    for (int i = 0; buffer.gem_handles.at(i); i++) {
+      buffer_modifiers.at(i) = buffer.modifier;
+      debug("[GEM:%" PRIu32 "]: %u x %u %s buffer (plane %d), pitch %u\n",
+            buffer.gem_handles.at(i), buffer.width, buffer.height,
+            "GBM",
+            i, buffer.pitches.at(i));
+    }
+
+    int err = 0;
+
+    /*
+    * Wrap our GEM buffer in a KMS framebuffer, so we can then attach it
+    * to a plane.
+    *
+    * drmModeAddFB2 accepts multiple image planes (not to be confused with
+    * the KMS plane objects!), for images which have multiple buffers.
+    * For example, YUV images may have the luma (Y) components in a
+    * separate buffer to the chroma (UV) components.
+    *
+    * When using modifiers (which we do not for dumb buffers), we can also
+    * have multiple planes even for RGB images, as image compression often
+    * uses an auxiliary buffer to store compression metadata.
+    *
+    * Dumb buffers are always strictly single-planar, so we do not need
+    * the extra planes nor the offset field.
+    *
+    * AddFB2WithModifiers takes a list of modifiers per plane, however
+    * the kernel enforces that they must be the same for each plane
+    * which is there, and 0 for everything else.
+    */
+    if (buffer.supportsFBModifiers) {
+      err = drmModeAddFB2WithModifiers(adapterFD,
+        buffer.width, buffer.height,
+        buffer.format,
+        buffer.gem_handles.data(),
+        buffer.pitches.data(),
+        buffer.offsets.data(),
+        buffer_modifiers.data(),
+        &buffer.fb_id,
+        DRM_MODE_FB_MODIFIERS);
+    } else {
+      err = drmModeAddFB2(adapterFD,
+        buffer.width, buffer.height,
+        buffer.format,
+        buffer.gem_handles.data(),
+        buffer.pitches.data(),
+        buffer.offsets.data(),
+        &buffer.fb_id,
+        0);
+    }
+
+    if (err != 0 || buffer.fb_id == 0) {
+      error("failed AddFB2 on %u x %u %s (modifier 0x%" PRIx64 ") buffer: %s\n",
+        buffer.width, buffer.height,
+        "GBM",
+        buffer.modifier, strerror(errno));
+      Display::buffer_egl_destroy(adapterFD, eglDevice, buffer);
+    }
+  }
+
+  void Display::setupHud(int adapterFD, egl::EGLDevice &eglDevice, gbm::GBMDevice &gbmDevice,
+                         std::vector<uint32_t> &claimedPlanes) {
+    drm::Plane cursor;
+    std::vector<drm::drm_property_info> cursorProps;
+
+    /*
+    * Any free overlay plane which can go on our CRTC and show XRGB8888
+    * will do; failing that, the cursor plane, which we never otherwise use.
+    * Cursor planes mostly only show ARGB8888, which does as well, as the
+    * HUD is drawn opaque.
+    */
+    uint32_t cursorFormat = DRM_FORMAT_XRGB8888;
+    for (auto &plane : planes) {
+      auto *formatsEnd = plane->formats + plane->count_formats;
+      auto hasXrgb = std::find(plane->formats, formatsEnd, DRM_FORMAT_XRGB8888) != formatsEnd;
+      auto hasArgb = std::find(plane->formats, formatsEnd, DRM_FORMAT_ARGB8888) != formatsEnd;
+      if ((plane->possible_crtcs & (1U << crtcIndex)) == 0 ||
+          std::find(claimedPlanes.begin(), claimedPlanes.end(), plane->plane_id) != claimedPlanes.end() ||
+          (!hasXrgb && !hasArgb)) {
+        continue;
       }
 
-      int err = 0;
-
-     	/*
-      * Wrap our GEM buffer in a KMS framebuffer, so we can then attach it
-      * to a plane.
-      *
-      * drmModeAddFB2 accepts multiple image planes (not to be confused with
-      * the KMS plane objects!), for images which have multiple buffers.
-      * For example, YUV images may have the luma (Y) components in a
-      * separate buffer to the chroma (UV) components.
-      *
-      * When using modifiers (which we do not for dumb buffers), we can also
-      * have multiple planes even for RGB images, as image compression often
-      * uses an auxiliary buffer to store compression metadata.
-      *
-      * Dumb buffers are always strictly single-planar, so we do not need
-      * the extra planes nor the offset field.
-      *
-      * AddFB2WithModifiers takes a list of modifiers per plane, however
-      * the kernel enforces that they must be the same for each plane
-      * which is there, and 0 for everything else.
-      */
-      if (buffer.supportsFBModifiers) {
-        err = drmModeAddFB2WithModifiers(adapterFD,
-          buffer.width, buffer.height,
-          buffer.format,
-          buffer.gem_handles.data(),
-          buffer.pitches.data(),
-          buffer.offsets.data(),
-          buffer_modifiers.data(),
-          &buffer.fb_id,
-          DRM_MODE_FB_MODIFIERS);
-      } else {
-        err = drmModeAddFB2(adapterFD,
-          buffer.width, buffer.height,
-          buffer.format,
-          buffer.gem_handles.data(),
-          buffer.pitches.data(),
-          buffer.offsets.data(),
-          &buffer.fb_id,
-          0);
+      auto *objectProps = drmModeObjectGetProperties(adapterFD, plane->plane_id, DRM_MODE_OBJECT_PLANE);
+      if (objectProps == nullptr) {
+        continue;
+      }
+      std::vector<drm::drm_property_info> planeProps;
+      drm::drm_property_info_populate(adapterFD, drm::plane_props, planeProps, drm::plane_props.size(), objectProps);
+      auto type = drm::drm_property_get_value(&planeProps.at(drm::WDRM_PLANE_TYPE), objectProps,
+                                              drm::WDRM_PLANE_TYPE_PRIMARY);
+      drmModeFreeObjectProperties(objectProps);
+
+      if (type == drm::WDRM_PLANE_TYPE_OVERLAY && hasXrgb) {
+        hud.usePlane(plane->plane_id, std::move(planeProps),
+                     std::min<unsigned int>(PerfHud::WIDTH, crtc->mode.hdisplay - (2 * PerfHud::MARGIN)),
+                     std::min<unsigned int>(PerfHud::HEIGHT, crtc->mode.vdisplay - (2 * PerfHud::MARGIN)),
+                     false);
+        break;
+      }
+      if (type == drm::WDRM_PLANE_TYPE_CURSOR && cursor == nullptr) {
+        cursor = plane;
+        cursorProps = std::move(planeProps);
+        cursorFormat = hasXrgb ? DRM_FORMAT_XRGB8888 : DRM_FORMAT_ARGB8888;
+      }
+    }
+
+    /* Cursor planes often take nothing but their one size. */
+    if (!hud.enabled() && cursor != nullptr) {
+      uint64_t width = 64;
+      uint64_t height = 64;
+      drmGetCap(adapterFD, DRM_CAP_CURSOR_WIDTH, &width);
+      drmGetCap(adapterFD, DRM_CAP_CURSOR_HEIGHT, &height);
+      hud.usePlane(cursor->plane_id, std::move(cursorProps), width, height, true);
+    }
+    if (!hud.enabled()) {
+      error("[%s] no free overlay or cursor plane for the HUD\n", name.c_str());
+      return;
+    }
+
+    /* Planes other than the primary are the likeliest to want linear buffers. */
+    for (size_t idx = 0; idx < PerfHud::BUFFER_COUNT; idx++) {
+      Buffer buffer = createEGLBuffer(adapterFD, false, eglDevice, gbmDevice, hud.width(), hud.height(),
+                                      hud.onCursorPlane() ? cursorFormat : DRM_FORMAT_XRGB8888);
+      addFramebuffer(adapterFD, eglDevice, buffer);
+      hudBuffers.push_back(buffer);
+    }
+
+    /*
+    * Check the plane will take our buffer where we want it before relying
+    * on it. Our first modeset is still to come, so test it along with the
+    * whole state that will bring: the CRTC may be off for now, and in
+    * another mode than the one we chose.
+    */
+    auto *req = drmModeAtomicAlloc();
+    auto ret = addModesetState(req, buffers.front());
+    if (ret == 0) {
+      ret = hud.addPlaneState(req, crtc->crtc_id, hudBuffers.front().fb_id);
+    }
+    if (ret == 0) {
+      ret = drmModeAtomicCommit(adapterFD, req, DRM_MODE_ATOMIC_TEST_ONLY | DRM_MODE_ATOMIC_ALLOW_MODESET, nullptr);
+    }
+    drmModeAtomicFree(req);
+    if (ret != 0) {
+      error("[%s] plane %u can't show the HUD: %s\n", name.c_str(), hud.plane(), strerror(-ret));
+      for (auto &buffer : hudBuffers) {
+        buffer_egl_destroy(adapterFD, eglDevice, buffer);
       }
+      hudBuffers.clear();
+      hud.disable();
+      return;
+    }
 
-      if (err != 0 || buffer.fb_id == 0) {
-        error("failed AddFB2 on %u x %u %s (modifier 0x%" PRIx64 ") buffer: %s\n",
-          buffer.width, buffer.height,
-          "GBM",
-          buffer.modifier, strerror(errno));
-        Display::buffer_egl_destroy(adapterFD, eglDevice, buffer);
+    claimedPlanes.push_back(hud.plane());
+    debug("[%s] HUD on %s plane %u, %ux%u\n", name.c_str(), hud.onCursorPlane() ? "cursor" : "overlay",
+          hud.plane(), hud.width(), hud.height());
+  }
+
+  /*
+  * Adds our mode, the connector and a full-screen buffer on the primary
+  * plane to an atomic request, as our first commit sets them. Returns
+  * non-zero if a property is missing.
+  */
+  auto Display::addModesetState(drmModeAtomicReq *req, const Buffer &buffer) const -> int {
+    const std::array<std::pair<drm::wdrm_plane_property, uint64_t>, 10> planeState = {{
+      { drm::WDRM_PLANE_CRTC_ID, crtc->crtc_id },
+      { drm::WDRM_PLANE_FB_ID, buffer.fb_id },
+      { drm::WDRM_PLANE_SRC_X, 0 },
+      { drm::WDRM_PLANE_SRC_Y, 0 },
+      { drm::WDRM_PLANE_SRC_W, static_cast<uint64_t>(buffer.width) << 16 },
+      { drm::WDRM_PLANE_SRC_H, static_cast<uint64_t>(buffer.height) << 16 },
+      { drm::WDRM_PLANE_CRTC_X, 0 },
+      { drm::WDRM_PLANE_CRTC_Y, 0 },
+      { drm::WDRM_PLANE_CRTC_W, buffer.width },
+      { drm::WDRM_PLANE_CRTC_H, buffer.height },
+    }};
+    auto add = [req](uint32_t objectId, const drm::drm_property_info &info, uint64_t value) {
+      return info.prop_id != 0 && drmModeAtomicAddProperty(req, objectId, info.prop_id, value) > 0;
+    };
+
+    for (const auto &[prop, value] : planeState) {
+      if (!add(primary_plane->plane_id, props.plane.at(prop), value)) {
+        return -1;
       }
-      buffers.push_back(buffer);
     }
+    if (!add(crtc->crtc_id, props.crtc.at(drm::WDRM_CRTC_MODE_ID), mode_blob_id) ||
+        !add(crtc->crtc_id, props.crtc.at(drm::WDRM_CRTC_ACTIVE), 1) ||
+        !add(connector->connector_id, props.connector.at(drm::WDRM_CONNECTOR_CRTC_ID), crtc->crtc_id)) {
+      return -1;
+    }
+    return 0;
   }
 
-  auto Display::createEGLBuffer(int adapterFD, bool adapterSupportsFBModifiers, egl::EGLDevice &eglDevice, gbm::GBMDevice &gbmDevice) -> Buffer {
+  auto Display::findFreeBuffer() -> Buffer * {
+    for (auto &buffer : buffers) {
+      if (!buffer.in_use) {
+        return &buffer;
+      }
+    }
+    return nullptr;
+  }
+
+  auto Display::createEGLBuffer(int adapterFD, bool adapterSupportsFBModifiers, egl::EGLDevice &eglDevice, gbm::GBMDevice &gbmDevice,
+                                unsigned int width, unsigned int height, uint32_t format) -> Buffer {
     static PFNEGLCREATEIMAGEKHRPROC create_img = nullptr;
     static PFNGLEGLIMAGETARGETTEXTURE2DOESPROC target_tex_2d = nullptr;
     std::array<EGLint, 17> attribs = { 0, }; /* see note below about type */
@@ -205,9 +369,9 @@ namespace glplay::kms {
     if (buffer.supportsFBModifiers && gbm_bo_create_with_modifiers) {
       buffer.gbm.bo = gbm_bo_create_with_modifiers(
         gbmDevice.get(),
-        crtc->mode.hdisplay,
-        crtc->mode.vdisplay,
-        DRM_FORMAT_XRGB8888,
+        width,
+        height,
+        format,
         modifiers.data(),
         modifiers.size());
     }
@@ -219,15 +383,15 @@ namespace glplay::kms {
       buffer.supportsFBModifiers = false;
       buffer.gbm.bo = gbm_bo_create(
         gbmDevice.get(),
-        crtc->mode.hdisplay,
-        crtc->mode.vdisplay,
-        DRM_FORMAT_XRGB8888,
+        width,
+        height,
+        format,
         GBM_BO_USE_RENDERING | GBM_BO_USE_SCANOUT);
     }
 
     if(buffer.gbm.bo == nullptr) {
       error("failed to create %u x %u BO\n",
-		    crtc->mode.hdisplay, crtc->mode.vdisplay);
+		    width, height);
       throw std::runtime_error("failed to create BO\n");
     }
 
@@ -235,9 +399,9 @@ namespace glplay::kms {
     * We can query all the image properties from the GBM BO once we've
     * created it.
     */
-    buffer.format = DRM_FORMAT_XRGB8888;
-    buffer.width = crtc->mode.hdisplay;
-    buffer.height = crtc->mode.vdisplay;
+    buffer.format = format;
+    buffer.width = width;
+    buffer.height = height;
     buffer.modifier = DRM_FORMAT_MOD_SAMSUNG_64_32_TILE; //gbm_bo_get_modifier(buffer.gbm.bo);
     num_planes = 1;//gbm_bo_get_plane_count(buffer.gbm.bo);
     for (int i = 0; i < num_planes; i++) {
@@ -289,7 +453,7 @@ namespace glplay::kms {
     attribs.at(nattribs++) = EGL_HEIGHT;
     attribs.at(nattribs++) = buffer.height;
     attribs.at(nattribs++) = EGL_LINUX_DRM_FOURCC_EXT;
-    attribs.at(nattribs++) = DRM_FORMAT_XRGB8888;
+    attribs.at(nattribs++) = format;
     debug("importing %u x %u EGLImage with %d planes\n", buffer.width, buffer.height, num_planes);
 
     attribs.at(nattribs++) = EGL_DMA_BUF_PLANE0_FD_EXT;
@@ -437,6 +601,171 @@ namespace glplay::kms {
       this->name.c_str(), edid.pnp_id.data(), edid.eisa_id.data(),
       edid.monitor_name.data(), edid.serial_number.data());
 
+    vrrMinHz = edid.min_vrefresh;
+    vrrMaxHz = edid.max_vrefresh;
+  }
+
+  auto Display::vblankPeriodNsec() const -> int64_t {
+    if (vrrEnabled || !vblank.valid()) {
+      return refreshIntervalNsec;
+    }
+    return std::llround(vblank.periodNsec());
+  }
+
+  auto Display::nextFrameTarget(const struct timespec &from) const -> struct timespec {
+    struct timespec target{};
+
+    if (vrrEnabled || !vblank.valid()) {
+      timespec_add_nsec(&target, &from, frameIntervalNsec());
+      return target;
+    }
+
+    auto sequence = vblank.sequenceNear(timespec_to_nsec(&from)) + vblanksPerFrame();
+    timespec_from_nsec(&target, vblank.timeOf(sequence));
+    return target;
+  }
+
+  auto Display::submitFrame(Buffer *buffer, const struct timespec &target,
+                            PresentationCallback feedback) -> uint64_t {
+    auto id = nextFrameId++;
+    presentQueue.push_back({ buffer, target, id, std::move(feedback) });
+    return id;
+  }
+
+  void Display::frameCommitted(QueuedFrame frame) {
+    if (frame.id == 0) {
+      frame.id = nextFrameId++;
+    }
+    frameInFlight = std::move(frame);
+  }
+
+  void Display::framePresented(uint64_t sequence, const struct timespec &when) {
+    if (!frameInFlight) {
+      return;
+    }
+
+    PresentationFeedback feedback;
+    feedback.id = frameInFlight->id;
+    feedback.target = frameInFlight->target;
+    feedback.presented = when;
+    feedback.sequence = sequence;
+    feedback.refreshNsec = vblankPeriodNsec();
+
+    /* Anything within half a vblank of the target landed on its vblank. */
+    if (!timespec_is_zero(&feedback.target)) {
+      auto error = timespec_sub_to_nsec(&when, &feedback.target);
+      presentationError.add(error);
+      feedback.late = error > feedback.refreshNsec / 2;
+      if (feedback.late) {
+        framesLate++;
+      }
+    }
+
+    auto callback = std::move(frameInFlight->feedback);
+    frameInFlight.reset();
+    if (callback) {
+      callback(feedback);
+    }
+  }
+
+  void Display::frameDiscarded(const QueuedFrame &frame) {
+    framesDiscarded++;
+    if (!frame.feedback) {
+      return;
+    }
+
+    PresentationFeedback feedback;
+    feedback.id = frame.id;
+    feedback.target = frame.target;
+    feedback.discarded = true;
+    frame.feedback(feedback);
+  }
+
+  void Display::discardPendingFrames() {
+    if (frameInFlight) {
+      auto frame = std::move(*frameInFlight);
+      frameInFlight.reset();
+      frameDiscarded(frame);
+    }
+    for (const auto &frame : presentQueue) {
+      frameDiscarded(frame);
+    }
+    presentQueue.clear();
+  }
+
+  void Display::matchContentRate(int adapterFD, uint32_t contentMilliHz, bool allowVrr) {
+    contentIntervalNsec = (contentMilliHz != 0) ? millihzToNsec(contentMilliHz) : 0;
+
+    /*
+    * With variable refresh, the panel holds each frame until the next
+    * commit arrives, so we can simply present every content frame when
+    * it is due. Below the bottom of the panel's range it can't wait that
+    * long, so we show each content frame as many times as needed to stay
+    * inside it. Without a content rate, frames go out as soon as they are
+    * ready, no faster than the current mode.
+    */
+    if (allowVrr && vrrCapable && props.crtc.at(drm::WDRM_CRTC_VRR_ENABLED).prop_id != 0) {
+      vrrEnabled = true;
+      if (contentIntervalNsec != 0) {
+        int64_t repeats = 1;
+        if (vrrMinHz > 0) {
+          auto longest = static_cast<int64_t>(NSEC_PER_SEC / vrrMinHz);
+          repeats = (contentIntervalNsec + longest - 1) / longest;
+        }
+        frameBaseNsec = std::max(contentIntervalNsec / repeats, refreshIntervalNsec);
+      }
+      debug("[%s] using variable refresh (%u-%u Hz), presenting every %" PRIi64 "ns\n",
+            name.c_str(), vrrMinHz, vrrMaxHz, frameBaseNsec);
+      return;
+    }
+
+    if (contentMilliHz == 0) {
+      return;
+    }
+
+    /*
+    * Otherwise, look for a mode at the same size whose refresh rate is a
+    * whole multiple of the content rate, so every content frame is shown
+    * for the same number of vblanks. Prefer the one closest to the mode
+    * we already have.
+    */
+    auto current = modeRefreshMilliHz(crtc->mode);
+    const drmModeModeInfo *best = nullptr;
+    int64_t bestMultiple = 0;
+    for (int idx = 0; idx < connector->count_modes; idx++) {
+      const auto &mode = connector->modes[idx];
+      if (mode.hdisplay != crtc->mode.hdisplay || mode.vdisplay != crtc->mode.vdisplay ||
+          (mode.flags & DRM_MODE_FLAG_INTERLACE) != (crtc->mode.flags & DRM_MODE_FLAG_INTERLACE)) {
+        continue;
+      }
+
+      auto refresh = modeRefreshMilliHz(mode);
+      auto multiple = (refresh + contentMilliHz / 2) / contentMilliHz;
+      /* Allow 0.1% for rounding in the mode timings. */
+      if (multiple == 0 || std::llabs(refresh - multiple * contentMilliHz) * 1000 > refresh) {
+        continue;
+      }
+      if (best == nullptr || std::llabs(refresh - current) < std::llabs(modeRefreshMilliHz(*best) - current)) {
+        best = &mode;
+        bestMultiple = multiple;
+      }
+    }
+
+    if (best == nullptr) {
+      debug("[%s] no mode refreshes at a multiple of %u mHz; content will judder\n",
+            name.c_str(), contentMilliHz);
+      return;
+    }
+
+    if (modeRefreshMilliHz(*best) != current) {
+      crtc->mode = *best;
+      drmModeDestroyPropertyBlob(adapterFD, mode_blob_id);
+      mode_blob_id = drm::mode_blob_create(adapterFD, &crtc->mode);
+      refreshIntervalNsec = millihzToNsec(modeRefreshMilliHz(*best));
+    }
+    frameBaseNsec = refreshIntervalNsec * bestMultiple;
+    debug("[%s] content at %u mHz, showing each frame for %" PRIi64 " vblanks of %s@%" PRIi64 " mHz\n",
+          name.c_str(), contentMilliHz, bestMultiple, crtc->mode.name, modeRefreshMilliHz(crtc->mode));
   }
 
   void Display::plane_formats_populate(int adapterFD, drmModeObjectPropertiesPtr props) {
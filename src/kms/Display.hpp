@@ -1,6 +1,9 @@
 #pragma once
 
+#include <algorithm>
 #include <array>
+#include <deque>
+#include <optional>
 #include <asm-generic/int-ll64.h>
 #include <string>
 #include <vector>
@@ -27,11 +30,30 @@
 #include "../gbm/gbm.hpp"
 #include "time.hpp"
 #include "Edid.hpp"
+#include "RepaintBudget.hpp"
+#include "PacingGovernor.hpp"
+#include "ResolutionGovernor.hpp"
+#include "VblankEstimator.hpp"
+#include "LatencyStats.hpp"
+#include "PresentationFeedback.hpp"
+#include "BeamRacer.hpp"
+#include "StageTimeline.hpp"
+#include "PerfHud.hpp"
 #include "../egl/egl.hpp"
 
 namespace glplay::kms {
 
-  const int BUFFER_QUEUE_DEPTH = 3;
+  /*
+  * Enough buffers for one on screen, one committed and one being painted;
+  * rendering ahead needs one more for every frame allowed in the queue.
+  */
+  const unsigned int MIN_BUFFER_COUNT = 3;
+
+  /*
+  * Frames a mailbox display keeps around: the newest finished one, and one
+  * being rendered to replace it.
+  */
+  const unsigned int MAILBOX_DEPTH = 2;
 
   struct Buffer {
     /*
@@ -117,19 +139,53 @@ namespace glplay::kms {
 
     unsigned int width{};
     unsigned int height{};
+    /*
+    * The part of the buffer the last frame was rendered into, from the
+    * top-left corner; smaller than the buffer with dynamic resolution,
+    * when the plane scales it up to the full mode.
+    */
+    unsigned int content_width{};
+    unsigned int content_height{};
+    /*
+    * When we started painting the last frame into it, and flushed that to
+    * the GPU, in CLOCK_MONOTONIC nanoseconds.
+    */
+    int64_t render_start_nsec = 0;
+    int64_t flush_nsec = 0;
+    /*
+    * When the GPU ran that frame, from its timer queries, if their results
+    * came in before it went on screen; 0 otherwise.
+    */
+    int64_t gpu_start_nsec = 0;
+    int64_t gpu_end_nsec = 0;
     std::array<unsigned int, 4> pitches{}; /* in bytes */
     std::array<unsigned int, 4> offsets{}; /* in bytes */
   };
 
+  /*
+  * A frame rendered ahead of time, waiting in the present queue for its
+  * turn to be committed.
+  */
+  struct QueuedFrame {
+    Buffer *buffer;
+    /* The vblank this frame's content was rendered for. */
+    struct timespec target;
+    /* Identifies the frame in its presentation feedback. */
+    uint64_t id = 0;
+    PresentationCallback feedback;
+  };
+
   class Display {
     public:
       explicit Display(int adapterFD, uint32_t connectorId, drm::Resources &resources);
       void createEGLBuffers(int adapterFD, bool adapterSupportsFBModifiers, egl::EGLDevice &eglDevice, gbm::GBMDevice &gbmDevice);
+      /* Free buffers, or nullptr if every buffer is queued, committed or on screen. */
+      auto findFreeBuffer() -> Buffer *;
       bool needs_repaint = true;
       /* Whether or not the output supports explicit fencing. */
       bool explicitFencing;
-      Buffer *bufferPending;
-      Buffer *bufferLast;
+      Buffer *bufferPending = nullptr;
+      Buffer *bufferLast = nullptr;
 
       /* Fence FD for completion of the last atomic commit. */
       int commitFenceFD = -1;
@@ -138,14 +194,235 @@ namespace glplay::kms {
       * Time the last frame's commit completed from KMS, and when the
       * next frame's commit is predicted to complete.
       */
-      struct timespec last_frame;
-      struct timespec next_frame;
+      struct timespec last_frame{};
+      struct timespec next_frame{};
+
+      /*
+      * When the repaint scheduler wants the next repaint to start, and
+      * when the current one did start; see RepaintScheduler.
+      */
+      struct timespec repaint_at{};
+      struct timespec repaint_start{};
+      bool repaintScheduled = false;
+      /* CPU time from repaint_start until the commit was submitted. */
+      int64_t repaintCpuNsec = 0;
+      RepaintBudget repaintBudget;
+      /* Whether the next completion is for the initial modeset commit. */
+      bool firstFrame = true;
+
+      /*
+      * Which fraction of the refresh rate we are running at, and the
+      * earliest time the frame we have rendered may be committed so it
+      * can't land before the vblank it was rendered for.
+      */
+      PacingGovernor pacing;
+      struct timespec commit_after{};
+      /* A frame rendered but held back until commit_after. */
+      Buffer *bufferHeld = nullptr;
+      /* When bufferHeld started waiting, so the wait isn't billed as repaint cost. */
+      struct timespec repaint_held{};
+      /* Time between two frames at the current pacing. */
+      [[nodiscard]] auto frameIntervalNsec() const -> int64_t {
+        return frameBaseNsec * pacing.divisor();
+      }
+      /*
+      * The measured vblank timing of our CRTC, and what we predict from
+      * it: the vblank period, and when the frame after one shown at the
+      * given time should go on screen. Until the estimator has enough
+      * samples, or with variable refresh, these use the nominal timings.
+      */
+      VblankEstimator vblank;
+      /*
+      * The most recent vblank we know the time of, from any source, and
+      * whether a vblank event has been queued for us; see VblankTracker.
+      * presented is set once our first commit has completed.
+      */
+      struct timespec last_vblank{};
+      bool sequenceQueued = false;
+      bool presented = false;
+      [[nodiscard]] auto vblankPeriodNsec() const -> int64_t;
+      [[nodiscard]] auto nextFrameTarget(const struct timespec &from) const -> struct timespec;
+      /* How many refresh intervals each frame is meant to stay on screen. */
+      [[nodiscard]] auto vblanksPerFrame() const -> unsigned int {
+        return static_cast<unsigned int>(
+          std::max<int64_t>(1, (frameIntervalNsec() + refreshIntervalNsec / 2) / refreshIntervalNsec));
+      }
+
+      /*
+      * Variable refresh: whether the connector supports it, the refresh
+      * range from its EDID (0 if unknown), and whether we are using it.
+      * contentIntervalNsec is how often the content changes, or 0 to
+      * paint at the display's own rate.
+      */
+      bool vrrCapable = false;
+      uint32_t vrrMinHz = 0;
+      uint32_t vrrMaxHz = 0;
+      bool vrrEnabled = false;
+      int64_t contentIntervalNsec = 0;
+      /*
+      * Immediate mode: commit with async (tearing) page flips, which
+      * replace the scanout buffer straight away rather than at the next
+      * vblank. Async commits may only change FB_ID.
+      */
+      bool asyncFlip = false;
+      /* Whether each frame goes out as soon as it is ready, not on a fixed vblank. */
+      [[nodiscard]] auto presentsWhenReady() const -> bool {
+        return asyncFlip || (vrrEnabled && contentIntervalNsec == 0);
+      }
+
+      /*
+      * Dynamic resolution: the governor picks the size to render at from
+      * how long frames take, render_width x render_height (0 for the full
+      * mode). planeScaling is cleared once a TEST_ONLY commit shows the
+      * primary plane can't scale to the mode, so the GPU scales instead.
+      */
+      ResolutionGovernor resolution;
+      unsigned int render_width = 0;
+      unsigned int render_height = 0;
+      bool planeScaling = true;
+
+      /* When the last commit was submitted, and how long commits take to land. */
+      struct timespec committed_at{};
+      LatencyStats flipLatency;
+      /* From each vblank to our poll waking up for its completion event. */
+      LatencyStats wakeupLatency;
+
+      /*
+      * Chooses how to present content changing at the given rate (0 for
+      * as fast as we can): with variable refresh if allowed and supported,
+      * otherwise by switching to a mode refreshing at a multiple of it.
+      */
+      void matchContentRate(int adapterFD, uint32_t contentMilliHz, bool allowVrr);
+
+      /*
+      * Content-change tracking: contentSerial counts changes to what the
+      * display should show, and paintedSerial is the one its newest frame
+      * was rendered from. When they match, the next frame would be the
+      * same as the last, so the display stops repainting and committing
+      * until invalidate() is called; see RepaintScheduler::contentInvalidated.
+      */
+      uint64_t contentSerial = 1;
+      uint64_t paintedSerial = 0;
+      void invalidate() { contentSerial++; }
+      [[nodiscard]] auto contentChanged() const -> bool { return paintedSerial != contentSerial; }
 
       /*
       * The frame of the animation to display.
       */
-      int frame_num;
+      int frame_num = 0;
+
+      /*
+      * How many frames may be rendered ahead of the one being committed;
+      * 0 renders each frame just before committing it. Frames rendered
+      * ahead wait in presentQueue, oldest first, and are committed one
+      * per vblank. render_target is the vblank the newest one is for.
+      */
+      unsigned int presentQueueDepth = 0;
+      std::deque<QueuedFrame> presentQueue;
+      struct timespec render_target{};
+
+      /*
+      * Presentation API, after wp_presentation and VK_GOOGLE_display_timing:
+      * a producer submits a rendered buffer to go on screen at a target
+      * time, and it is committed so as to land on the first vblank at or
+      * after that. Once it is on screen, or has been dropped for a newer
+      * frame, the producer's callback is told when, on which vblank, and
+      * whether that was later than asked for. Returns the frame's id.
+      */
+      auto submitFrame(Buffer *buffer, const struct timespec &target,
+                       PresentationCallback feedback = {}) -> uint64_t;
+      /*
+      * Records the frame just committed, whose feedback comes with the
+      * next completion; frames not from the queue get an id here.
+      */
+      void frameCommitted(QueuedFrame frame);
+      /* Sends feedback for the committed frame, now on screen. */
+      void framePresented(uint64_t sequence, const struct timespec &when);
+      /* Sends feedback for a queued frame dropped without being shown. */
+      void frameDiscarded(const QueuedFrame &frame);
+      /*
+      * Sends feedback for every frame still queued or in flight as not
+      * shown, and empties the queue; for when we exit.
+      */
+      void discardPendingFrames();
+      std::optional<QueuedFrame> frameInFlight;
+      uint64_t nextFrameId = 1;
+      /*
+      * How far from their targets frames went on screen, and how many
+      * missed their vblank or were dropped.
+      */
+      LatencyStats presentationError;
+      uint64_t framesLate = 0;
+      uint64_t framesDiscarded = 0;
+
+      /*
+      * Mailbox mode: frames are rendered as fast as the content changes,
+      * for the next vblank we can make, and each commit takes the newest
+      * one the GPU has finished; older frames waiting in presentQueue are
+      * dropped without ever being shown. Counts frames rendered, and
+      * replaced by a newer one before their turn came.
+      */
+      bool mailbox = false;
+      uint64_t mailboxRendered = 0;
+      uint64_t mailboxReplaced = 0;
+
+      /*
+      * For the deadline scheduler: frames completed and how many missed
+      * their vblank, repaints deferred behind other displays, how many of
+      * those in a row, and how often that lowered our frame rate.
+      */
+      uint64_t deadlineFrames = 0;
+      uint64_t deadlinesMissed = 0;
+      uint64_t deadlinesDeferred = 0;
+      unsigned int deadlineDeferStreak = 0;
+      uint64_t deadlineFallbacks = 0;
+
+      /*
+      * The SyncGroup this display belongs to, as an index into
+      * DisplayAdapter::syncGroups, or -1; and its place in the group.
+      */
+      int syncGroup = -1;
+      size_t syncSlot = 0;
+      /*
+      * The part of the picture this display shows, as a column and row of
+      * a grid of tiles; the whole of it unless in a tiled sync group.
+      */
+      unsigned int tileColumns = 1;
+      unsigned int tileRows = 1;
+      unsigned int tileColumn = 0;
+      unsigned int tileRow = 0;
+
+      /*
+      * Beam racing: after the first frame, the buffer on screen stays
+      * there, and is rendered into a strip at a time ahead of scanout.
+      */
+      BeamRacer beam;
+
+      /* Stage timestamps of recent frames, from render start to flip. */
+      StageTimeline stages;
+
+      /*
+      * Times each frame's GPU work with timer queries, where the device
+      * has them; gpuTime is every frame's it measured, and gpuBudget the
+      * recent ones, for scheduling.
+      */
+      egl::GpuTimer gpuTimer;
+      LatencyStats gpuTime;
+      RepaintBudget gpuBudget;
+
+      /*
+      * The performance HUD, and the buffers it is drawn into. setupHud
+      * finds it a plane none of the planes in claimedPlanes, and adds the
+      * one it takes; without one, the HUD stays off.
+      */
+      PerfHud hud;
+      std::vector<Buffer> hudBuffers;
+      void setupHud(int adapterFD, egl::EGLDevice &eglDevice, gbm::GBMDevice &gbmDevice,
+                    std::vector<uint32_t> &claimedPlanes);
+
 	    int64_t refreshIntervalNsec = -1;
+      /* Time between frames before the pacing governor's divisor. */
+      int64_t frameBaseNsec = -1;
       /* Buffers allocated by us.*/
       std::vector<Buffer> buffers;
       drm::Crtc crtc;
@@ -158,7 +435,10 @@ namespace glplay::kms {
     private:
       void plane_formats_populate(int adapterFD, drmModeObjectPropertiesPtr props);
       void get_edid(int adapterFD, drmModeObjectPropertiesPtr props);
-      auto createEGLBuffer(int adapterFD, bool adapterSupportsFBModifiers, egl::EGLDevice &eglDevice, gbm::GBMDevice &gbmDevice) -> Buffer;
+      auto createEGLBuffer(int adapterFD, bool adapterSupportsFBModifiers, egl::EGLDevice &eglDevice, gbm::GBMDevice &gbmDevice,
+                           unsigned int width, unsigned int height, uint32_t format = DRM_FORMAT_XRGB8888) -> Buffer;
+      void addFramebuffer(int adapterFD, egl::EGLDevice &eglDevice, Buffer &buffer);
+      auto addModesetState(drmModeAtomicReq *req, const Buffer &buffer) const -> int;
       auto findPrimaryPlaneForCrtc() -> drm::Plane;
       static auto findCrtcForEncoder(int adapterFD, drm::Resources &resources, drm::Encoder &encoder) -> drm::Crtc;
       static auto findEncoderForConnector(int adapterFD, drm::Resources &resources, drm::Connector &connector) -> drm::Encoder;
@@ -168,6 +448,8 @@ namespace glplay::kms {
       //   /* Supported format modifiers for XRGB8888. */
       std::vector<uint64_t> modifiers;
       std::vector<drm::Plane> planes;
+      /* Our CRTC's place in the resources' list, as planes' possible_crtcs has it. */
+      unsigned int crtcIndex = 0;
 
   };
 
@@ -1,11 +1,40 @@
 #include "DisplayAdapter.hpp"
 #include "Display.hpp"
 
+#include <cmath>
+#include <cstring>
+#include <sstream>
+
+/* Atomic async flips were only allowed from Linux 6.8 on. */
+#ifndef DRM_CAP_ATOMIC_ASYNC_PAGE_FLIP
+#define DRM_CAP_ATOMIC_ASYNC_PAGE_FLIP 0x15
+#endif
+
 namespace glplay::kms {
+
+  /* Whether a comma-separated list of display names, or "all", includes this one. */
+  static auto displayListed(const char *list, const std::string &name) -> bool {
+    if (list == nullptr) {
+      return false;
+    }
+    if (strcmp(list, "all") == 0 || strcmp(list, "1") == 0) {
+      return true;
+    }
+    std::istringstream names(list);
+    std::string entry;
+    while (std::getline(names, entry, ',')) {
+      if (entry == name) {
+        return true;
+      }
+    }
+    return false;
+  }
+
   DisplayAdapter::DisplayAdapter(std::string &path): adapterFD(path, O_RDWR | O_CLOEXEC),
 		//InitDrmDevice
 		gbmDevice(gbm::make_gbm_ptr(adapterFD.fileDescriptor())),
-		eglDevice(gbmDevice) {
+		eglDevice(gbmDevice),
+		vblankTracker(adapterFD.fileDescriptor()) {
     uint64_t cap = 0;
     drm_magic_t magic = 0;
     auto fd = adapterFD.fileDescriptor();
@@ -26,6 +55,97 @@ namespace glplay::kms {
     err = drmGetCap(fd, DRM_CAP_ADDFB2_MODIFIERS, &cap);
 		bool supportsFBModifiers = (err == 0 && cap !=0);
 
+		/*
+		 * Repaint deadlines are derived from the completion timestamps
+		 * KMS gives us, so they are only meaningful if those are on
+		 * CLOCK_MONOTONIC like our timerfd.
+		 */
+		err = drmGetCap(fd, DRM_CAP_TIMESTAMP_MONOTONIC, &cap);
+		if (err != 0 || cap == 0) {
+			debug("KMS timestamps are not monotonic; repainting immediately\n");
+			scheduler.disable();
+		}
+
+		/*
+		 * How many frames each display may render ahead of the one it
+		 * is committing; see Display::presentQueueDepth.
+		 */
+		unsigned int queueDepth = 0;
+		const char *depthEnv = getenv("GLPLAY_QUEUE_DEPTH");
+		if (depthEnv != nullptr) {
+			queueDepth = std::stoul(depthEnv);
+		}
+
+		/*
+		 * The slowest rate the pacing governor may fall back to, as a
+		 * divisor of the refresh rate; 1 disables it.
+		 */
+		unsigned int maxDivisor = 3;
+		const char *divisorEnv = getenv("GLPLAY_MAX_FRAME_DIVISOR");
+		if (divisorEnv != nullptr) {
+			maxDivisor = std::stoul(divisorEnv);
+		}
+
+		/*
+		 * Present on variable refresh displays as frames become due,
+		 * and/or match the display to a given content frame rate.
+		 */
+		const char *vrrEnv = getenv("GLPLAY_VRR");
+		bool allowVrr = (vrrEnv != nullptr && strcmp(vrrEnv, "0") != 0);
+		uint32_t contentMilliHz = 0;
+		const char *contentEnv = getenv("GLPLAY_CONTENT_FPS");
+		if (contentEnv != nullptr) {
+			contentMilliHz = std::lround(std::stod(contentEnv) * 1000);
+		}
+
+		/*
+		 * Displays to present on with async (tearing) flips. Atomic
+		 * commits need their own capability for this; the older
+		 * DRM_CAP_ASYNC_PAGE_FLIP only covers the legacy page-flip
+		 * ioctl.
+		 */
+		const char *immediateEnv = getenv("GLPLAY_IMMEDIATE");
+		/* Displays to present in mailbox mode; see Display::mailbox. */
+		const char *mailboxEnv = getenv("GLPLAY_MAILBOX");
+		err = drmGetCap(fd, DRM_CAP_ATOMIC_ASYNC_PAGE_FLIP, &cap);
+		bool supportsAsyncFlip = (err == 0 && cap != 0);
+
+		/*
+		 * Displays to race the beam on, and in how many strips; see
+		 * BeamRacer.
+		 */
+		const char *beamEnv = getenv("GLPLAY_BEAM_RACE");
+		unsigned int beamStrips = 4;
+		const char *stripsEnv = getenv("GLPLAY_BEAM_STRIPS");
+		if (stripsEnv != nullptr) {
+			beamStrips = std::max(1UL, std::stoul(stripsEnv));
+		}
+		const char *beamTestEnv = getenv("GLPLAY_BEAM_TEST");
+		bool beamTest = (beamTestEnv != nullptr && strcmp(beamTestEnv, "0") != 0);
+
+		/*
+		 * Displays to show the performance HUD on, and how many times
+		 * a second to redraw it; see PerfHud. Each takes a plane of its
+		 * own, so no two may have the same one.
+		 */
+		const char *hudEnv = getenv("GLPLAY_HUD");
+		unsigned int hudHz = 4;
+		const char *hudHzEnv = getenv("GLPLAY_HUD_HZ");
+		if (hudHzEnv != nullptr) {
+			hudHz = std::max(1UL, std::stoul(hudHzEnv));
+		}
+		std::vector<uint32_t> hudPlanes;
+
+		/*
+		 * The smallest share of the mode size dynamic resolution may
+		 * render at; unset keeps rendering at full size.
+		 */
+		double minScale = 1.0;
+		const char *scaleEnv = getenv("GLPLAY_DYNAMIC_RESOLUTION");
+		if (scaleEnv != nullptr) {
+			minScale = std::stod(scaleEnv);
+		}
+
     auto resources = drm::make_resources_ptr(fd);
 		
 		for(int idx = 0; idx < resources->count_connectors; idx++) {
@@ -38,11 +158,68 @@ namespace glplay::kms {
 			}
 			if(connector->encoder_id != 0 /* && encoder->encoder_id != 0 && crtc->buffer_id != 0*/) {
 				displays.emplace_back(fd, connectorId, resources);
+				displays.back().presentQueueDepth = queueDepth;
+				if (displayListed(immediateEnv, displays.back().name)) {
+					if (supportsAsyncFlip) {
+						/* There is no queue to keep when every frame replaces the last. */
+						displays.back().asyncFlip = true;
+						displays.back().presentQueueDepth = 0;
+					} else {
+						debug("[%s] async page flips not supported; using vsynced commits\n",
+						      displays.back().name.c_str());
+					}
+				}
+				if (displayListed(mailboxEnv, displays.back().name) && !displays.back().asyncFlip) {
+					displays.back().mailbox = true;
+					displays.back().presentQueueDepth = MAILBOX_DEPTH;
+				}
+				displays.back().pacing.setMaxDivisor(maxDivisor);
+				/* This may switch modes, so comes before anything timed off the mode. */
+				displays.back().matchContentRate(fd, contentMilliHz, allowVrr);
+				/* Racing the beam needs the one buffer on screen to stay put. */
+				if (displayListed(beamEnv, displays.back().name) && !displays.back().asyncFlip &&
+				    displays.back().presentQueueDepth == 0) {
+					displays.back().beam.setup(displays.back().crtc->mode, beamStrips, beamTest);
+				}
+				/* Async flips can only change FB_ID, not the plane's source. */
+				if (minScale < 1.0 && !displays.back().asyncFlip &&
+				    displays.back().presentQueueDepth == 0 && !displays.back().beam.enabled()) {
+					displays.back().resolution.setMinScale(minScale);
+				}
 				displays.back().createEGLBuffers(fd, supportsFBModifiers, eglDevice, gbmDevice);
+				displays.back().gpuTimer.enable(eglDevice.gpu_timers);
+				/*
+				 * The HUD's plane goes out with our commits: async flips
+				 * can't carry it, and racing the beam makes none after
+				 * the first.
+				 */
+				if (displayListed(hudEnv, displays.back().name) && !displays.back().asyncFlip &&
+				    !displays.back().beam.enabled()) {
+					displays.back().hud.setup(hudHz);
+					displays.back().setupHud(fd, eglDevice, gbmDevice, hudPlanes);
+				}
 			}
 		}
 		if(displays.empty()) {
 			throw std::runtime_error("Device has not active displays");
 		}
+		syncGroups = SyncGroup::fromEnvironment(displays);
+		stats.attach(displays);
+
+		for (size_t idx = 0; idx < displays.size(); idx++) {
+			auto crtcId = displays[idx].crtc->crtc_id;
+			if (crtcId >= crtcDisplays.size()) {
+				crtcDisplays.resize(crtcId + 1, -1);
+			}
+			crtcDisplays[crtcId] = static_cast<int>(idx);
+		}
+
+		/*
+		 * Pick up the vblank phase of every CRTC which is already
+		 * running, so even our first frame has a timing reference.
+		 */
+		for (auto &display : displays) {
+			vblankTracker.sample(display);
+		}
   }
 }
@@ -8,9 +8,17 @@
 
 #include <cstdio>
 #include <iostream>
+#include <memory>
 #include <vector>
 
 #include "Display.hpp"
+#include "RepaintScheduler.hpp"
+#include "CommitBatcher.hpp"
+#include "DeadlineScheduler.hpp"
+#include "SyncGroup.hpp"
+#include "StatsPublisher.hpp"
+#include "RenderThread.hpp"
+#include "VblankTracker.hpp"
 #include "../drm/drm.hpp"
 #include "../nix/nix.hpp"
 #include "../gbm/gbm.hpp"
@@ -27,6 +35,31 @@ namespace glplay::kms {
       std::vector<Display> displays;
       gbm::GBMDevice gbmDevice;
       egl::EGLDevice eglDevice;
+      RepaintScheduler scheduler;
+      CommitBatcher batcher;
+      DeadlineScheduler deadlines;
+      /* Displays showing one picture together; see SyncGroup. */
+      std::vector<SyncGroup> syncGroups;
+      /* Frame pacing statistics, published for glplay-stats. */
+      StatsPublisher stats;
+      VblankTracker vblankTracker;
+      /*
+      * One render thread per display, indexed like displays, when
+      * running with GLPLAY_RENDER_THREADS; empty otherwise.
+      */
+      std::vector<std::unique_ptr<RenderThread>> renderThreads;
+
+      /* Index into displays of the display driving a CRTC, or -1. */
+      [[nodiscard]] auto displayIndexForCrtc(uint32_t crtcId) const -> int {
+        return crtcId < crtcDisplays.size() ? crtcDisplays[crtcId] : -1;
+      }
+
+    private:
+      /*
+      * Indexed by CRTC ID, which KMS hands out from a small range, so
+      * finding the display for an event doesn't mean searching for it.
+      */
+      std::vector<int> crtcDisplays;
   };
 
 }
\ No newline at end of file
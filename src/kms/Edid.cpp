@@ -55,6 +55,10 @@ namespace glplay::kms {
       } else if (data[idx+3] == EDID_DESCRIPTOR_ALPHANUMERIC_DATA_STRING) {
         auto eisa_id = parse_string(&data[idx+5]);
         std::copy(std::begin(eisa_id), std::end(eisa_id), std::begin(this->eisa_id));
+      } else if (data[idx+3] == EDID_DESCRIPTOR_DISPLAY_RANGE_LIMITS) {
+        /* EDID 1.4 adds 255 to either rate if its offset flag is set. */
+        this->min_vrefresh = data[idx+5] + (((data[idx+4] & 0x1) != 0) ? 255 : 0);
+        this->max_vrefresh = data[idx+6] + (((data[idx+4] & 0x2) != 0) ? 255 : 0);
       }
     }
   }
@@ -66,7 +70,8 @@ namespace glplay::kms {
 
   // Move constructor
   // Transfer ownership 
-  Edid::Edid(Edid&& other) noexcept : eisa_id(other.eisa_id), monitor_name(other.monitor_name), pnp_id(other.pnp_id), serial_number(other.serial_number) {
+  Edid::Edid(Edid&& other) noexcept : eisa_id(other.eisa_id), monitor_name(other.monitor_name), pnp_id(other.pnp_id), serial_number(other.serial_number),
+    min_vrefresh(other.min_vrefresh), max_vrefresh(other.max_vrefresh) {
     std::fill( std::begin(other.eisa_id), std::end(other.eisa_id), 0 );
     std::fill( std::begin(other.monitor_name), std::end(other.monitor_name), 0 );
     std::fill( std::begin(other.pnp_id), std::end(other.pnp_id), 0 );
@@ -84,6 +89,8 @@ namespace glplay::kms {
     std::copy(std::begin(other.monitor_name), std::end(other.monitor_name), std::begin(monitor_name));
     std::copy(std::begin(other.pnp_id), std::end(other.pnp_id), std::begin(pnp_id));
     std::copy(std::begin(other.serial_number), std::end(other.serial_number), std::begin(serial_number));
+    min_vrefresh = other.min_vrefresh;
+    max_vrefresh = other.max_vrefresh;
     return *this;
   }
 
@@ -98,6 +105,8 @@ namespace glplay::kms {
     std::copy(std::begin(other.monitor_name), std::end(other.monitor_name), std::begin(monitor_name));
     std::copy(std::begin(other.pnp_id), std::end(other.pnp_id), std::begin(pnp_id));
     std::copy(std::begin(other.serial_number), std::end(other.serial_number), std::begin(serial_number));
+    min_vrefresh = other.min_vrefresh;
+    max_vrefresh = other.max_vrefresh;
 
     std::fill( std::begin(other.eisa_id), std::end(other.eisa_id), 0 );
     std::fill( std::begin(other.monitor_name), std::end(other.monitor_name), 0 );
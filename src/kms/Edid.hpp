@@ -14,6 +14,7 @@
 #define EDID_DESCRIPTOR_ALPHANUMERIC_DATA_STRING 0xfe
 #define EDID_DESCRIPTOR_DISPLAY_PRODUCT_NAME 0xfc
 #define EDID_DESCRIPTOR_DISPLAY_PRODUCT_SERIAL_NUMBER 0xff
+#define EDID_DESCRIPTOR_DISPLAY_RANGE_LIMITS 0xfd
 #define EDID_OFFSET_DATA_BLOCKS 0x36
 #define EDID_OFFSET_LAST_BLOCK 0x6c
 #define EDID_OFFSET_PNPID 0x08
@@ -27,6 +28,9 @@ namespace glplay::kms {
 	    std::array<char, 13> monitor_name;
 	    std::array<char, 5> pnp_id;
 	    std::array<char, 13> serial_number;
+      /* Vertical refresh range in Hz from the range limits descriptor, or 0. */
+      uint32_t min_vrefresh = 0;
+      uint32_t max_vrefresh = 0;
 
       explicit Edid(const uint8_t *data, size_t length);
       Edid(const Edid& other); //Copy constructor
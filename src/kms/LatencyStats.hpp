@@ -0,0 +1,57 @@
+#pragma once
+
+#include <algorithm>
+#include <cinttypes>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <limits>
+
+namespace glplay::kms {
+
+  /*
+  * Running count, mean, standard deviation and extremes of one latency
+  * measured every frame, printed as a one-line summary when we exit.
+  */
+  class LatencyStats {
+    public:
+      void add(int64_t nsec) {
+        count++;
+        total += nsec;
+        auto value = static_cast<double>(nsec);
+        totalSquares += value * value;
+        min = std::min(min, nsec);
+        max = std::max(max, nsec);
+      }
+
+      [[nodiscard]] auto samples() const -> uint64_t { return count; }
+      [[nodiscard]] auto meanNsec() const -> int64_t {
+        return (count == 0) ? 0 : total / static_cast<int64_t>(count);
+      }
+
+      [[nodiscard]] auto stddevNsec() const -> int64_t {
+        if (count < 2) {
+          return 0;
+        }
+        auto mean = static_cast<double>(total) / static_cast<double>(count);
+        auto variance = totalSquares / static_cast<double>(count) - mean * mean;
+        return std::llround(std::sqrt(std::max(variance, 0.0)));
+      }
+
+      void report(const char *display, const char *what) const {
+        if (count == 0) {
+          return;
+        }
+        fprintf(stderr, "[%s] %s: %" PRIu64 " samples, mean %" PRIi64 "us, stddev %" PRIi64 "us, min %" PRIi64 "us, max %" PRIi64 "us\n",
+                display, what, count, meanNsec() / 1000, stddevNsec() / 1000, min / 1000, max / 1000);
+      }
+
+    private:
+      uint64_t count = 0;
+      int64_t total = 0;
+      double totalSquares = 0;
+      int64_t min = std::numeric_limits<int64_t>::max();
+      int64_t max = std::numeric_limits<int64_t>::min();
+  };
+
+}
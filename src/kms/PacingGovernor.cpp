@@ -0,0 +1,58 @@
+#include "PacingGovernor.hpp"
+
+#include <algorithm>
+#include <bitset>
+
+namespace glplay::kms {
+
+  void PacingGovernor::reset() {
+    missHistory = 0;
+    hitStreak = 0;
+  }
+
+  void PacingGovernor::setMaxDivisor(unsigned int max) {
+    maxDivisor = std::max(1U, max);
+    currentDivisor = std::min(currentDivisor, maxDivisor);
+    reset();
+  }
+
+  auto PacingGovernor::slowDown() -> bool {
+    if (currentDivisor >= maxDivisor) {
+      return false;
+    }
+    currentDivisor++;
+    reset();
+    return true;
+  }
+
+  auto PacingGovernor::holdGuardNsec(int64_t refreshIntervalNsec) -> int64_t {
+    const int64_t guard = 1000000;
+    return std::min(guard, refreshIntervalNsec / 4);
+  }
+
+  auto PacingGovernor::frameCompleted(bool missed, int64_t budgetNsec, int64_t refreshIntervalNsec) -> bool {
+    missHistory = ((missHistory << 1U) | (missed ? 1U : 0U)) & ((1ULL << MISS_WINDOW) - 1);
+    hitStreak = missed ? 0 : hitStreak + 1;
+
+    auto misses = std::bitset<64>(missHistory).count();
+    if (misses >= MISS_THRESHOLD && currentDivisor < maxDivisor) {
+      currentDivisor++;
+      reset();
+      return true;
+    }
+
+    /*
+    * Frames at the faster rate have (divisor - 1) refresh intervals from
+    * one completion to the next commit deadline.
+    */
+    if (hitStreak >= RECOVERY_FRAMES && currentDivisor > 1 &&
+        budgetNsec < RECOVERY_HEADROOM * static_cast<double>((currentDivisor - 1) * refreshIntervalNsec)) {
+      currentDivisor--;
+      reset();
+      return true;
+    }
+
+    return false;
+  }
+
+}
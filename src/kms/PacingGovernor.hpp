@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace glplay::kms {
+
+  /*
+  * Picks how many vblanks each frame of a display stays on screen for.
+  *
+  * A display which keeps missing its deadline looks far worse dropping an
+  * unpredictable frame every now and then than it does running steadily
+  * at half (or a third of) the refresh rate. The governor watches whether
+  * each completed frame hit the vblank it was predicted for, and moves
+  * between 1/1, 1/2 and 1/3 of the refresh rate.
+  *
+  * To avoid flapping between two rates, it only slows down when misses
+  * are frequent, and only speeds back up after a long run without any
+  * misses, when the measured repaint cost would also comfortably fit the
+  * faster rate.
+  */
+  class PacingGovernor {
+    public:
+      /* Frames we look back over when deciding to slow down. */
+      static const unsigned int MISS_WINDOW = 30;
+      /* Misses within MISS_WINDOW which make us slow down. */
+      static const unsigned int MISS_THRESHOLD = 3;
+      /* Consecutive hits needed before we consider speeding up. */
+      static const unsigned int RECOVERY_FRAMES = 120;
+      /* Share of the faster rate's frame time the repaint cost may use. */
+      static constexpr double RECOVERY_HEADROOM = 0.75;
+
+      /*
+      * Records one completed frame. budgetNsec is the display's current
+      * repaint cost estimate. Returns true if the divisor changed.
+      */
+      auto frameCompleted(bool missed, int64_t budgetNsec, int64_t refreshIntervalNsec) -> bool;
+
+      [[nodiscard]] auto divisor() const -> unsigned int { return currentDivisor; }
+      /*
+      * Drops to the next lower frame rate straight away, if there is one;
+      * for when we know frames won't fit before they miss. Returns true if
+      * the divisor changed.
+      */
+      auto slowDown() -> bool;
+      void setMaxDivisor(unsigned int max);
+
+      /*
+      * How long after the vblank preceding a frame's target we wait before
+      * committing it, so the commit can't be latched a vblank early.
+      */
+      static auto holdGuardNsec(int64_t refreshIntervalNsec) -> int64_t;
+
+    private:
+      void reset();
+
+      unsigned int currentDivisor = 1;
+      unsigned int maxDivisor = 3;
+
+      /* One bit per frame in the window, set for a miss. */
+      uint64_t missHistory = 0;
+      unsigned int hitStreak = 0;
+  };
+
+}
@@ -0,0 +1,245 @@
+#include "PerfHud.hpp"
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <utility>
+
+#include <GLES3/gl3.h>
+
+#include "kms.hpp"
+
+namespace glplay::kms {
+
+  namespace {
+
+    /*
+    * A 3x5 pixel font, just big enough for the numbers and labels we
+    * show: each glyph is five rows of three bits, top row first, the
+    * leftmost pixel of each row in the row's highest bit.
+    */
+    struct Glyph {
+      char character;
+      uint16_t rows;
+    };
+
+    const std::array<Glyph, 19> FONT = {{
+      { '0', 0b111'101'101'101'111 },
+      { '1', 0b010'110'010'010'111 },
+      { '2', 0b111'001'111'100'111 },
+      { '3', 0b111'001'111'001'111 },
+      { '4', 0b101'101'111'001'001 },
+      { '5', 0b111'100'111'001'111 },
+      { '6', 0b111'100'111'101'111 },
+      { '7', 0b111'001'001'001'001 },
+      { '8', 0b111'101'111'101'111 },
+      { '9', 0b111'101'111'001'111 },
+      { '.', 0b000'000'000'000'010 },
+      { '-', 0b000'000'111'000'000 },
+      { 'F', 0b111'100'110'100'100 },
+      { 'P', 0b110'101'110'100'100 },
+      { 'S', 0b011'100'010'001'110 },
+      { 'M', 0b101'111'111'101'101 },
+      { 'I', 0b111'010'010'010'111 },
+      { 'G', 0b011'100'101'101'011 },
+      { 'U', 0b101'101'101'101'111 },
+    }};
+
+    /* Font pixels are drawn this many HUD pixels square. */
+    const unsigned int SCALE = 2;
+    const unsigned int GLYPH_WIDTH = 3 * SCALE;
+    const unsigned int GLYPH_HEIGHT = 5 * SCALE;
+    const unsigned int ADVANCE = GLYPH_WIDTH + SCALE;
+    const unsigned int LINE_HEIGHT = GLYPH_HEIGHT + SCALE;
+    const unsigned int PADDING = 4;
+    /* Frame times the graph's full height stands for, in frame intervals. */
+    const int64_t GRAPH_INTERVALS = 2;
+
+    /*
+    * Fills a rectangle, y counted from the top: our framebuffers are
+    * scanned out from their first row, which is GL's y = 0.
+    */
+    void fill(unsigned int x, unsigned int y, unsigned int width, unsigned int height,
+              GLfloat red, GLfloat green, GLfloat blue) {
+      glScissor(static_cast<GLint>(x), static_cast<GLint>(y),
+                static_cast<GLsizei>(width), static_cast<GLsizei>(height));
+      glClearColor(red, green, blue, 1.0F);
+      glClear(GL_COLOR_BUFFER_BIT);
+    }
+
+  }
+
+  void PerfHud::setup(unsigned int updateHz) {
+    updateNsec = updateHz > 0 ? NSEC_PER_SEC / updateHz : 0;
+  }
+
+  void PerfHud::usePlane(uint32_t plane, std::vector<drm::drm_property_info> planeProps,
+                         unsigned int planeWidth, unsigned int planeHeight, bool cursor) {
+    planeId = plane;
+    props = std::move(planeProps);
+    hudWidth = planeWidth;
+    hudHeight = planeHeight;
+    cursorPlane = cursor;
+  }
+
+  auto PerfHud::addPlaneState(drmModeAtomicReq *req, uint32_t crtcId, uint32_t fbId) const -> int {
+    const std::array<std::pair<drm::wdrm_plane_property, uint64_t>, 10> state = {{
+      { drm::WDRM_PLANE_CRTC_ID, crtcId },
+      { drm::WDRM_PLANE_FB_ID, fbId },
+      { drm::WDRM_PLANE_SRC_X, 0 },
+      { drm::WDRM_PLANE_SRC_Y, 0 },
+      { drm::WDRM_PLANE_SRC_W, static_cast<uint64_t>(hudWidth) << 16 },
+      { drm::WDRM_PLANE_SRC_H, static_cast<uint64_t>(hudHeight) << 16 },
+      { drm::WDRM_PLANE_CRTC_X, MARGIN },
+      { drm::WDRM_PLANE_CRTC_Y, MARGIN },
+      { drm::WDRM_PLANE_CRTC_W, hudWidth },
+      { drm::WDRM_PLANE_CRTC_H, hudHeight },
+    }};
+
+    for (const auto &[prop, value] : state) {
+      const auto &info = props.at(prop);
+      if (info.prop_id == 0 || drmModeAtomicAddProperty(req, planeId, info.prop_id, value) <= 0) {
+        return -1;
+      }
+    }
+    return 0;
+  }
+
+  void PerfHud::frameCompleted(const FrameRecord &frame, int64_t frameIntervalNsec) {
+    auto flip = frame.at(FrameStage::Flip);
+    if (lastFlipNsec != 0) {
+      samples.at(nextSample) = { flip - lastFlipNsec, frame.late };
+      nextSample = (nextSample + 1) % GRAPH_FRAMES;
+    }
+    lastFlipNsec = flip;
+    intervalNsec = frameIntervalNsec;
+    framesShown++;
+    if (frame.late) {
+      framesMissed++;
+    }
+    if (!timerQueries && frame.at(FrameStage::Flush) != 0 && frame.at(FrameStage::RenderDone) != 0) {
+      gpuNsec += frame.at(FrameStage::RenderDone) - frame.at(FrameStage::Flush);
+      gpuFrames++;
+    }
+  }
+
+  void PerfHud::gpuTimed(int64_t nsec) {
+    if (!timerQueries) {
+      gpuNsec = 0;
+      gpuFrames = 0;
+      timerQueries = true;
+    }
+    gpuNsec += nsec;
+    gpuFrames++;
+  }
+
+  auto PerfHud::due(int64_t nowNsec) const -> bool {
+    return enabled() && !drawn && !inFlight && nowNsec >= nextUpdateNsec;
+  }
+
+  void PerfHud::draw(int64_t nowNsec) {
+    std::array<char, 32> text{};
+    unsigned int x = PADDING;
+    unsigned int y = PADDING;
+
+    glViewport(0, 0, static_cast<GLsizei>(hudWidth), static_cast<GLsizei>(hudHeight));
+    glEnable(GL_SCISSOR_TEST);
+    fill(0, 0, hudWidth, hudHeight, 0.1F, 0.1F, 0.1F);
+
+    double fps = 0.0;
+    if (lastDrawNsec != 0 && nowNsec > lastDrawNsec) {
+      fps = static_cast<double>(framesShown - framesAtDraw) * NSEC_PER_SEC /
+        static_cast<double>(nowNsec - lastDrawNsec);
+    }
+    snprintf(text.data(), text.size(), "%.1f FPS", fps);
+    drawText(text.data(), &x, &y);
+    snprintf(text.data(), text.size(), "%" PRIu64 " MISS", framesMissed);
+    drawText(text.data(), &x, &y);
+    if (gpuFrames > 0) {
+      snprintf(text.data(), text.size(), "%.2f GPU",
+               static_cast<double>(gpuNsec) / static_cast<double>(gpuFrames) / 1e6);
+    } else {
+      snprintf(text.data(), text.size(), "-- GPU");
+    }
+    drawText(text.data(), &x, &y);
+
+    drawGraph(y + LINE_HEIGHT + PADDING);
+    glDisable(GL_SCISSOR_TEST);
+
+    framesAtDraw = framesShown;
+    gpuNsec = 0;
+    gpuFrames = 0;
+    lastDrawNsec = nowNsec;
+    nextUpdateNsec = nowNsec + updateNsec;
+    drawn = true;
+  }
+
+  /*
+  * Draws a word at (*x, *y), or at the start of the next line if it
+  * doesn't fit on this one, and moves *x past it.
+  */
+  void PerfHud::drawText(const std::string &text, unsigned int *x, unsigned int *y) const {
+    auto width = static_cast<unsigned int>(text.size()) * ADVANCE;
+    if (*x != PADDING && *x + width > hudWidth) {
+      *x = PADDING;
+      *y += LINE_HEIGHT;
+    }
+
+    for (auto character : text) {
+      const auto *glyph = std::find_if(FONT.begin(), FONT.end(),
+                                       [character](const Glyph &g) { return g.character == character; });
+      if (glyph != FONT.end()) {
+        for (unsigned int row = 0; row < 5; row++) {
+          for (unsigned int column = 0; column < 3; column++) {
+            if ((glyph->rows & (1U << (14 - (row * 3) - column))) != 0) {
+              fill(*x + (column * SCALE), *y + (row * SCALE), SCALE, SCALE, 1.0F, 1.0F, 1.0F);
+            }
+          }
+        }
+      }
+      *x += ADVANCE;
+    }
+    *x += ADVANCE;
+  }
+
+  /*
+  * Draws a bar for each recent frame, newest on the right, from the bottom
+  * up to 'top'; red ones missed their vblank. The line across is one frame
+  * interval.
+  */
+  void PerfHud::drawGraph(unsigned int top) const {
+    if (top + PADDING >= hudHeight || intervalNsec <= 0) {
+      return;
+    }
+    auto bottom = hudHeight - PADDING;
+    auto graphHeight = bottom - top;
+    auto fullScale = intervalNsec * GRAPH_INTERVALS;
+
+    auto bars = std::min<size_t>(GRAPH_FRAMES, (hudWidth - (2 * PADDING)) / 2);
+    for (size_t idx = 0; idx < bars; idx++) {
+      const auto &sample = samples.at((nextSample + GRAPH_FRAMES - 1 - idx) % GRAPH_FRAMES);
+      if (sample.frameNsec <= 0) {
+        break;
+      }
+      auto height = static_cast<unsigned int>(
+        std::min(sample.frameNsec, fullScale) * graphHeight / fullScale);
+      auto x = hudWidth - PADDING - static_cast<unsigned int>((idx + 1) * 2);
+      fill(x, bottom - height, 1, std::max(height, 1U),
+           sample.late ? 1.0F : 0.2F, sample.late ? 0.2F : 0.9F, 0.2F);
+    }
+    fill(PADDING, bottom - (graphHeight / GRAPH_INTERVALS), hudWidth - (2 * PADDING), 1, 0.9F, 0.9F, 0.2F);
+  }
+
+  void PerfHud::committed() {
+    drawn = false;
+    inFlight = true;
+  }
+
+  void PerfHud::flipped() {
+    if (inFlight) {
+      onScreen = drawBuffer();
+      inFlight = false;
+    }
+  }
+
+}
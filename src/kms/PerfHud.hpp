@@ -0,0 +1,127 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <xf86drmMode.h>
+
+#include "../drm/drm.hpp"
+#include "StageTimeline.hpp"
+
+namespace glplay::kms {
+
+  /*
+  * An on-screen performance overlay: frame rate, a graph of recent frame
+  * times, missed frames and GPU time, drawn into a small buffer of its own
+  * and shown on an overlay plane (or the cursor plane, if there is no
+  * overlay plane free) above the display's content.
+  *
+  * Being on a plane of its own, it costs the content nothing to show: the
+  * display hardware composes it, and it is only redrawn and recommitted a
+  * few times a second. Between updates the plane keeps showing the last
+  * buffer committed to it without being part of our commits at all.
+  *
+  * The buffers themselves belong to the Display, in Display::hudBuffers;
+  * this keeps track of the plane, what to draw and which buffer is where.
+  */
+  class PerfHud {
+    public:
+      /* One on screen and one being drawn. */
+      static const size_t BUFFER_COUNT = 2;
+      /* Size on overlay planes, and distance from the top-left corner. */
+      static const unsigned int WIDTH = 256;
+      static const unsigned int HEIGHT = 64;
+      static const unsigned int MARGIN = 16;
+      /* Frame times kept for the graph, one bar each. */
+      static const size_t GRAPH_FRAMES = 128;
+
+      /* Turns the HUD on, redrawing it 'updateHz' times a second. */
+      void setup(unsigned int updateHz);
+      /* Whether we also got a plane and buffers to show it with. */
+      [[nodiscard]] auto enabled() const -> bool { return planeId != 0; }
+      void disable() { planeId = 0; }
+
+      /*
+      * Takes the given plane for the HUD, at width x height; props are
+      * the plane's, as from drm_property_info_populate.
+      */
+      void usePlane(uint32_t plane, std::vector<drm::drm_property_info> planeProps,
+                    unsigned int planeWidth, unsigned int planeHeight, bool cursor);
+      [[nodiscard]] auto plane() const -> uint32_t { return planeId; }
+      [[nodiscard]] auto width() const -> unsigned int { return hudWidth; }
+      [[nodiscard]] auto height() const -> unsigned int { return hudHeight; }
+      [[nodiscard]] auto onCursorPlane() const -> bool { return cursorPlane; }
+
+      /*
+      * Adds the plane's full state to an atomic request, showing the given
+      * framebuffer on the given CRTC. Returns non-zero on failure.
+      */
+      auto addPlaneState(drmModeAtomicReq *req, uint32_t crtcId, uint32_t fbId) const -> int;
+
+      /* Records a frame which went on screen, with the display's frame interval. */
+      void frameCompleted(const FrameRecord &frame, int64_t frameIntervalNsec);
+      /*
+      * Records a frame's GPU time from a timer query; once these come in,
+      * they are shown instead of the time from flush to render fence.
+      */
+      void gpuTimed(int64_t nsec);
+
+      /* Whether it is time to redraw, and there is a buffer free to draw into. */
+      [[nodiscard]] auto due(int64_t nowNsec) const -> bool;
+      /* The index of the buffer to draw into next. */
+      [[nodiscard]] auto drawBuffer() const -> size_t { return (onScreen + 1) % BUFFER_COUNT; }
+      /*
+      * Draws the statistics into the bound framebuffer, which must be
+      * the HUD buffer from drawBuffer(), leaving it ready to commit.
+      */
+      void draw(int64_t nowNsec);
+
+      /*
+      * Whether a freshly drawn buffer is waiting to go into the next
+      * commit; committed() says it went, and flipped() that the commit
+      * carrying it has landed, so the buffer it replaced is free.
+      */
+      [[nodiscard]] auto ready() const -> bool { return drawn; }
+      void committed();
+      void flipped();
+
+    private:
+      struct Sample {
+        int64_t frameNsec = 0;
+        bool late = false;
+      };
+
+      void drawText(const std::string &text, unsigned int *x, unsigned int *y) const;
+      void drawGraph(unsigned int top) const;
+
+      uint32_t planeId = 0;
+      std::vector<drm::drm_property_info> props;
+      unsigned int hudWidth = 0;
+      unsigned int hudHeight = 0;
+      bool cursorPlane = false;
+
+      int64_t updateNsec = 0;
+      int64_t nextUpdateNsec = 0;
+      int64_t lastDrawNsec = 0;
+      size_t onScreen = BUFFER_COUNT - 1;
+      bool drawn = false;
+      bool inFlight = false;
+
+      /* Recent frame times, oldest first from 'nextSample'. */
+      std::array<Sample, GRAPH_FRAMES> samples{};
+      size_t nextSample = 0;
+      int64_t lastFlipNsec = 0;
+      int64_t intervalNsec = 0;
+      uint64_t framesShown = 0;
+      uint64_t framesMissed = 0;
+      /* Since the last redraw, to average over. */
+      uint64_t framesAtDraw = 0;
+      int64_t gpuNsec = 0;
+      uint64_t gpuFrames = 0;
+      bool timerQueries = false;
+  };
+
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstdint>
+#include <ctime>
+#include <functional>
+
+namespace glplay::kms {
+
+  /*
+  * What became of one frame submitted for presentation; see
+  * Display::submitFrame. Along the lines of wp_presentation feedback and
+  * VK_GOOGLE_display_timing's past presentation timing.
+  */
+  struct PresentationFeedback {
+    /* As returned by Display::submitFrame. */
+    uint64_t id = 0;
+    /* When the frame was asked to go on screen; zero for as soon as possible. */
+    struct timespec target{};
+    /* When it did go on screen: the time of the vblank it was latched on. */
+    struct timespec presented{};
+    /* KMS's vblank counter for that vblank, as in the page-flip event. */
+    uint64_t sequence = 0;
+    /* The vblank period at the time, for working out the next one. */
+    int64_t refreshNsec = 0;
+    /* Whether it went on screen on a later vblank than the target's. */
+    bool late = false;
+    /* Whether it was dropped in favour of a newer frame, and never shown. */
+    bool discarded = false;
+  };
+
+  /*
+  * Called from the KMS event handler once the frame is on screen or has
+  * been dropped, with the display's lock held if it has a render thread.
+  */
+  using PresentationCallback = std::function<void(const PresentationFeedback &)>;
+
+}
@@ -0,0 +1,66 @@
+#include "RenderThread.hpp"
+
+namespace glplay::kms {
+
+  RenderThread::RenderThread(Display &display, egl::EGLDevice &eglDevice, RepaintFn repaint, nix::EventFD &wakeup):
+    display(display), eglDevice(eglDevice), rctx(eglDevice.createSharedContext()),
+    repaint(std::move(repaint)), wakeup(wakeup), thread(&RenderThread::run, this) {
+  }
+
+  RenderThread::~RenderThread() {
+    {
+      std::lock_guard<std::mutex> guard(queueMutex);
+      stopping = true;
+    }
+    queueCond.notify_one();
+    thread.join();
+  }
+
+  void RenderThread::kick() {
+    {
+      std::lock_guard<std::mutex> guard(queueMutex);
+      repaintRequested = true;
+    }
+    queueCond.notify_one();
+  }
+
+  void RenderThread::run() {
+    eglDevice.bindRenderContext(rctx);
+    nix::traceNameThread(display.name.c_str());
+    debug("[%s] render thread started\n", display.name.c_str());
+
+    /* Just below the main loop, so it can always dispatch our events. */
+    nix::enterRealtime(display.name.c_str(), 1);
+
+    auto status = RepaintStatus::Idle;
+    while (true) {
+      {
+        std::unique_lock<std::mutex> queue(queueMutex);
+        /*
+        * If we can still render ahead, carry on without waiting, but
+        * drop the display lock in between so completion events for
+        * this display don't have to wait for the whole queue to fill.
+        */
+        if (status != RepaintStatus::MoreWork) {
+          queueCond.wait(queue, [this] { return repaintRequested || stopping; });
+        }
+        if (stopping) {
+          break;
+        }
+        repaintRequested = false;
+      }
+
+      std::lock_guard<std::mutex> guard(displayMutex);
+      status = repaint(display, rctx);
+      if (status == RepaintStatus::Failed) {
+        hasFailed = true;
+        wakeup.signal();
+        break;
+      }
+    }
+
+    eglDevice.destroySharedContext(rctx);
+    debug("[%s] render thread exiting\n", display.name.c_str());
+  }
+
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+#include "Display.hpp"
+#include "../egl/egl.hpp"
+#include "../nix/nix.hpp"
+
+namespace glplay::kms {
+
+  /*
+  * Runs one display's repaint loop on its own thread, with its own EGL
+  * context shared with the device context.
+  *
+  * The main thread keeps polling the KMS FD and running the repaint
+  * scheduler; when a display is due it kicks that display's thread, which
+  * paints, builds and commits its own atomic request. Completion events
+  * still arrive on the main thread, which takes lockDisplay() before it
+  * touches the display's state.
+  */
+  class RenderThread {
+    public:
+      /*
+      * What a repaint left behind: nothing, more frames it could render
+      * ahead straight away, or a failed commit.
+      */
+      enum class RepaintStatus { Idle, MoreWork, Failed };
+      /* Paints and/or commits the display's next frame. */
+      using RepaintFn = std::function<RepaintStatus(Display &, egl::RenderContext &)>;
+
+      RenderThread(Display &display, egl::EGLDevice &eglDevice, RepaintFn repaint, nix::EventFD &wakeup);
+      RenderThread(const RenderThread& other) = delete;
+      auto operator=(const RenderThread& other) -> RenderThread& = delete;
+      ~RenderThread();
+
+      /* Asks the thread to repaint its display. */
+      void kick();
+      /* Held by the thread for the whole of each repaint and commit. */
+      auto lockDisplay() -> std::unique_lock<std::mutex> { return std::unique_lock<std::mutex>(displayMutex); }
+      /* Set if a commit failed; the thread then signals wakeup and exits. */
+      [[nodiscard]] auto failed() const -> bool { return hasFailed; }
+
+    private:
+      void run();
+
+      Display &display;
+      egl::EGLDevice &eglDevice;
+      egl::RenderContext rctx;
+      RepaintFn repaint;
+      nix::EventFD &wakeup;
+
+      std::mutex displayMutex;
+      std::mutex queueMutex;
+      std::condition_variable queueCond;
+      bool repaintRequested = false;
+      bool stopping = false;
+      std::atomic<bool> hasFailed{false};
+
+      std::thread thread;
+  };
+
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace glplay::kms {
+
+  /*
+  * Until we have measured a display, assume a repaint takes as long as
+  * the fixed margin advance_frame has always kept.
+  */
+  const int64_t DEFAULT_REPAINT_BUDGET_NSEC = 4000000;
+
+  /*
+  * Tracks how long recent repaints of one display took, from the moment we
+  * started painting until the commit was in the kernel's hands and the GPU
+  * had finished rendering into the buffer.
+  *
+  * The estimate is the worst of the recent samples rather than an average:
+  * starting a repaint too late costs a whole frame, whereas starting it a
+  * little early only costs a little latency.
+  */
+  class RepaintBudget {
+    public:
+      static constexpr size_t WINDOW = 32;
+
+      void addSample(int64_t costNsec) {
+        samples.at(next) = costNsec;
+        next = (next + 1) % WINDOW;
+        count = std::min(count + 1, WINDOW);
+      }
+
+      [[nodiscard]] auto estimate() const -> int64_t {
+        if (count == 0) {
+          return DEFAULT_REPAINT_BUDGET_NSEC;
+        }
+        return *std::max_element(samples.begin(), samples.begin() + count);
+      }
+
+      [[nodiscard]] auto sampleCount() const -> size_t { return count; }
+      /* The newest sample; 0 if there are none. */
+      [[nodiscard]] auto last() const -> int64_t {
+        return count == 0 ? 0 : samples.at((next + WINDOW - 1) % WINDOW);
+      }
+
+    private:
+      std::array<int64_t, WINDOW> samples{};
+      size_t next = 0;
+      size_t count = 0;
+  };
+
+}
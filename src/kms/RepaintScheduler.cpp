@@ -0,0 +1,137 @@
+#include "RepaintScheduler.hpp"
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstdlib>
+#include <cstring>
+
+namespace glplay::kms {
+
+  RepaintScheduler::RepaintScheduler() {
+    const char *env = getenv("GLPLAY_JIT_REPAINT");
+    enabled = (env == nullptr || strcmp(env, "0") != 0);
+
+    env = getenv("GLPLAY_REPAINT_SLACK_USEC");
+    if (env != nullptr) {
+      slackNsec = strtoll(env, nullptr, 10) * 1000;
+    }
+    debug("%susing just-in-time repaint (slack %" PRIi64 "ns)\n",
+          enabled ? "" : "not ", slackNsec);
+  }
+
+  auto RepaintScheduler::repaintMargin(const Display &display) const -> int64_t {
+    if (!enabled) {
+      return DEFAULT_REPAINT_BUDGET_NSEC;
+    }
+    return display.repaintBudget.estimate();
+  }
+
+  void RepaintScheduler::repaintStarted(Display &display, const struct timespec &now) {
+    display.repaint_start = now;
+  }
+
+  void RepaintScheduler::repaintCommitted(Display &display, const struct timespec &now) {
+    display.repaintCpuNsec = timespec_sub_to_nsec(&now, &display.repaint_start);
+    display.committed_at = now;
+  }
+
+  void RepaintScheduler::repaintHeld(Display &display, const struct timespec &now) {
+    display.repaint_held = now;
+  }
+
+  void RepaintScheduler::repaintResumed(Display &display, const struct timespec &now) {
+    timespec_add_nsec(&display.repaint_start, &display.repaint_start,
+                      timespec_sub_to_nsec(&now, &display.repaint_held));
+  }
+
+  void RepaintScheduler::holdUntil(Display &display, const struct timespec &when) {
+    display.repaint_at = when;
+    display.repaintScheduled = true;
+  }
+
+  void RepaintScheduler::contentInvalidated(Display &display) {
+    display.invalidate();
+    if (display.bufferPending != nullptr || display.bufferHeld != nullptr ||
+        display.repaintScheduled || !display.presentQueue.empty()) {
+      return;
+    }
+    display.needs_repaint = true;
+  }
+
+  void RepaintScheduler::frameCompleted(Display &display, int64_t renderDoneNsec) {
+    /*
+    * Displays rendering ahead already have their next frame waiting, so
+    * there is nothing to gain by holding back its commit; immediate-mode
+    * displays don't wait for vblank at all.
+    */
+    if (!enabled || display.presentQueueDepth > 0 || display.asyncFlip) {
+      display.needs_repaint = display.contentChanged();
+      return;
+    }
+
+    /*
+    * The first commit carries a modeset, which is far more expensive
+    * than anything we do in steady state; don't let it skew the budget.
+    */
+    if (display.repaintCpuNsec > 0 && !display.firstFrame) {
+      int64_t cost = display.repaintCpuNsec;
+      if (renderDoneNsec != 0) {
+        cost = std::max(cost, renderDoneNsec - timespec_to_nsec(&display.repaint_start));
+      }
+      display.repaintBudget.addSample(cost);
+    }
+    display.firstFrame = false;
+
+    /* Nothing has changed since the frame now on screen: go idle. */
+    if (!display.contentChanged()) {
+      debug("[%s] content unchanged, going idle\n", display.name.c_str());
+      return;
+    }
+
+    /*
+    * The commit we just saw complete is on screen from last_frame; the
+    * next one is due one frame later (more than one vblank if the pacing
+    * governor has slowed us down). Start painting just early enough to
+    * make it. If our budget is longer than that this lands in the past,
+    * and dispatch() will flag the display straight away.
+    */
+    auto target = display.nextFrameTarget(display.last_frame);
+    timespec_add_nsec(&display.repaint_at, &target,
+                      -display.repaintBudget.estimate() - slackNsec);
+    display.repaintScheduled = true;
+  }
+
+  void RepaintScheduler::timerExpired(const struct timespec &wokenAt) {
+    if (timer.consume() > 0) {
+      timerLateness.add(timespec_sub_to_nsec(&wokenAt, &deadline));
+    }
+  }
+
+  void RepaintScheduler::dispatch(std::vector<Display> &displays, const struct timespec &now) {
+    const struct timespec *earliest = nullptr;
+
+    for (auto &display : displays) {
+      if (!display.repaintScheduled) {
+        continue;
+      }
+
+      if (timespec_sub_to_nsec(&display.repaint_at, &now) <= 0) {
+        display.repaintScheduled = false;
+        display.needs_repaint = true;
+        continue;
+      }
+
+      if (earliest == nullptr || timespec_sub_to_nsec(&display.repaint_at, earliest) < 0) {
+        earliest = &display.repaint_at;
+      }
+    }
+
+    if (earliest != nullptr) {
+      deadline = *earliest;
+      timer.armAt(deadline);
+    } else {
+      timer.disarm();
+    }
+  }
+
+}
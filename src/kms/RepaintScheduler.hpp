@@ -0,0 +1,90 @@
+#pragma once
+
+#include <cstdint>
+#include <ctime>
+#include <vector>
+
+#include "Display.hpp"
+#include "LatencyStats.hpp"
+#include "time.hpp"
+#include "../nix/nix.hpp"
+
+namespace glplay::kms {
+
+  /*
+  * Decides when each display should start painting its next frame.
+  *
+  * Repainting as soon as the previous frame completes means the content is
+  * sampled almost a full refresh interval before it reaches the screen.
+  * Instead, once a frame completes we predict the next vblank, subtract the
+  * display's measured repaint cost plus some slack, and arm a timerfd for
+  * that instant. The main loop polls the timerfd next to the KMS FD, and
+  * calls dispatch() on every wakeup to flag the displays which are due.
+  *
+  * All timing decisions take the current time as a parameter rather than
+  * reading the clock themselves, so they can be driven by a fake clock.
+  */
+  class RepaintScheduler {
+    public:
+      RepaintScheduler();
+
+      [[nodiscard]] auto timerFD() const -> int { return timer.fileDescriptor(); }
+      [[nodiscard]] auto isEnabled() const -> bool { return enabled; }
+      void disable() { enabled = false; }
+
+      /*
+      * How far ahead of 'now' a frame must be predicted for us to still
+      * make it in time; used by advance_frame to pick the target vblank.
+      */
+      [[nodiscard]] auto repaintMargin(const Display &display) const -> int64_t;
+
+      /* Records that we are about to paint the given display. */
+      static void repaintStarted(Display &display, const struct timespec &now);
+      /* Records that the display's commit has been handed to KMS. */
+      static void repaintCommitted(Display &display, const struct timespec &now);
+      /*
+      * Records that a rendered frame is being held back until
+      * display.commit_after, and that it has been picked up again; the
+      * time in between is not part of the repaint cost.
+      */
+      static void repaintHeld(Display &display, const struct timespec &now);
+      static void repaintResumed(Display &display, const struct timespec &now);
+
+      /* Wakes the display up again at the given time. */
+      static void holdUntil(Display &display, const struct timespec &when);
+
+      /*
+      * Marks the display's content as changed, and repaints it straight
+      * away if it had gone idle. A display with a frame in flight or due
+      * picks the change up when that completes.
+      */
+      static void contentInvalidated(Display &display);
+
+      /*
+      * Called from the completion handler once the display's last commit
+      * has been latched. renderDoneNsec is the time the render fence for
+      * that frame signalled, or 0 if we don't know it.
+      */
+      void frameCompleted(Display &display, int64_t renderDoneNsec);
+
+      /*
+      * Flags every display whose repaint deadline has passed as needing a
+      * repaint, and arms the timer for the earliest deadline left.
+      */
+      void dispatch(std::vector<Display> &displays, const struct timespec &now);
+
+      /* Called when poll reports the timer, with the time poll woke us. */
+      void timerExpired(const struct timespec &wokenAt);
+      /* How late the timer woke us compared to the deadline it was armed for. */
+      [[nodiscard]] auto wakeupLateness() const -> const LatencyStats & { return timerLateness; }
+
+    private:
+      nix::TimerFD timer;
+      struct timespec deadline{};
+      LatencyStats timerLateness;
+      bool enabled = true;
+      /* Extra headroom on top of the measured cost to absorb wakeup latency. */
+      int64_t slackNsec = 1000000;
+  };
+
+}
@@ -0,0 +1,61 @@
+#include "ResolutionGovernor.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace glplay::kms {
+
+  void ResolutionGovernor::setMinScale(double min) {
+    min = std::clamp(min, 1.0 / SCALE_STEPS, 1.0);
+    minSteps = static_cast<unsigned int>(std::ceil(min * SCALE_STEPS));
+    steps = SCALE_STEPS;
+    overStreak = 0;
+    fitStreak = 0;
+  }
+
+  auto ResolutionGovernor::scaled(unsigned int size) const -> unsigned int {
+    if (steps >= SCALE_STEPS) {
+      return size;
+    }
+    auto result = (size * steps / SCALE_STEPS) & ~1U;
+    return std::max(result, 2U);
+  }
+
+  auto ResolutionGovernor::frameCompleted(int64_t renderNsec, int64_t frameIntervalNsec) -> bool {
+    if (!enabled() || renderNsec <= 0 || frameIntervalNsec <= 0) {
+      return false;
+    }
+
+    auto target = TARGET_LOAD * static_cast<double>(frameIntervalNsec);
+    auto cost = static_cast<double>(renderNsec);
+
+    if (cost > target) {
+      fitStreak = 0;
+      if (++overStreak < OVER_FRAMES || steps <= minSteps) {
+        return false;
+      }
+      /* The cost follows the area, so scale each side by the square root. */
+      auto wanted = static_cast<unsigned int>(std::floor(steps * std::sqrt(target / cost)));
+      steps = std::clamp(wanted, minSteps, steps - 1);
+      overStreak = 0;
+      return true;
+    }
+
+    overStreak = 0;
+    if (steps >= SCALE_STEPS) {
+      return false;
+    }
+    auto growth = static_cast<double>(steps + 1) / steps;
+    if (cost * growth * growth >= RECOVERY_HEADROOM * target) {
+      fitStreak = 0;
+      return false;
+    }
+    if (++fitStreak < RECOVERY_FRAMES) {
+      return false;
+    }
+    steps++;
+    fitStreak = 0;
+    return true;
+  }
+
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstdint>
+
+namespace glplay::kms {
+
+  /*
+  * Picks how much of the full mode size each frame of a display is rendered
+  * at, when dynamic resolution is enabled.
+  *
+  * A GPU too slow to fill every pixel of a large mode in one frame time
+  * would otherwise make the display miss vblanks; rendering fewer pixels
+  * and letting the display hardware scale them up keeps it at full rate.
+  * The governor watches how long each frame took to render against the
+  * frame interval, and scales both dimensions down in steps of 1/16 when
+  * frames keep taking too long, by roughly as much as needed assuming the
+  * cost follows the pixel count. It steps back up, one step at a time,
+  * after a long run of frames which would still fit at the larger size.
+  */
+  class ResolutionGovernor {
+    public:
+      /* Scale factors are multiples of 1/SCALE_STEPS. */
+      static const unsigned int SCALE_STEPS = 16;
+      /* Share of the frame interval rendering may take. */
+      static constexpr double TARGET_LOAD = 0.8;
+      /* Consecutive frames over target which make us scale down. */
+      static const unsigned int OVER_FRAMES = 3;
+      /* Consecutive frames which would fit one step up before we take it. */
+      static const unsigned int RECOVERY_FRAMES = 60;
+      /* Share of the target a frame one step up would be predicted to use. */
+      static constexpr double RECOVERY_HEADROOM = 0.9;
+
+      /* Enables the governor, never going below the given scale. */
+      void setMinScale(double min);
+      [[nodiscard]] auto enabled() const -> bool { return minSteps < SCALE_STEPS; }
+
+      [[nodiscard]] auto scale() const -> double {
+        return static_cast<double>(steps) / SCALE_STEPS;
+      }
+      /* A full-size dimension at the current scale, rounded down to even when scaled. */
+      [[nodiscard]] auto scaled(unsigned int size) const -> unsigned int;
+
+      /*
+      * Records how long the last frame took to render, against the time
+      * between frames. Returns true if the scale changed.
+      */
+      auto frameCompleted(int64_t renderNsec, int64_t frameIntervalNsec) -> bool;
+
+    private:
+      unsigned int steps = SCALE_STEPS;
+      unsigned int minSteps = SCALE_STEPS;
+      unsigned int overStreak = 0;
+      unsigned int fitStreak = 0;
+  };
+
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace glplay::kms {
+
+  /*
+  * Layout of the shared memory region StatsPublisher keeps up to date, and
+  * glplay-stats (or any monitoring agent) maps read-only.
+  *
+  * Each display's block is guarded by a seqlock: the writer makes its
+  * sequence odd, updates the block, and makes it even again. Readers copy
+  * the block and retry if the sequence was odd or changed meanwhile. The
+  * writer never waits for readers, and readers never make a syscall.
+  */
+  const uint32_t SHARED_STATS_MAGIC = 0x676c7374; /* "glst" */
+  const uint32_t SHARED_STATS_VERSION = 2;
+  const size_t SHARED_STATS_MAX_DISPLAYS = 16;
+  /* Histogram of time between presentations, in buckets of 500us; the last takes the rest. */
+  const size_t SHARED_STATS_BUCKETS = 64;
+  const int64_t SHARED_STATS_BUCKET_NSEC = 500000;
+
+  static_assert(std::atomic<uint64_t>::is_always_lock_free,
+                "the seqlock must work across processes");
+
+  struct SharedDisplayStats {
+    char name[32];
+    /* Frames presented, and vblanks which went by without the frame due on them. */
+    uint64_t frames;
+    uint64_t missedVblanks;
+    /* Frames presented before or after their target, beyond the tolerance. */
+    uint64_t early;
+    uint64_t late;
+    /* KMS vblank counter and time of the last presentation. */
+    uint64_t lastSequence;
+    int64_t lastPresentNsec;
+    int64_t refreshNsec;
+    /* Frames per second over the last second or so. */
+    double fps;
+    /*
+    * Frames the GPU was timed on, from timer queries, and the last and
+    * total GPU time; all 0 where timer queries aren't supported.
+    */
+    uint64_t gpuFrames;
+    int64_t gpuLastNsec;
+    int64_t gpuTotalNsec;
+    uint64_t histogram[SHARED_STATS_BUCKETS];
+  };
+
+  struct SharedDisplayBlock {
+    std::atomic<uint64_t> sequence;
+    SharedDisplayStats stats;
+  };
+
+  struct SharedStats {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t displayCount;
+    uint32_t bucketNsec;
+    int32_t pid;
+    SharedDisplayBlock displays[SHARED_STATS_MAX_DISPLAYS];
+  };
+
+  /* Publishes a display's stats; only ever called from one thread. */
+  inline void shared_stats_write(SharedDisplayBlock &block, const SharedDisplayStats &stats) {
+    auto sequence = block.sequence.load(std::memory_order_relaxed);
+    block.sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    memcpy(&block.stats, &stats, sizeof(stats));
+    block.sequence.store(sequence + 2, std::memory_order_release);
+  }
+
+  /* Takes a consistent copy of a display's stats; false if the writer kept getting in the way. */
+  inline auto shared_stats_read(const SharedDisplayBlock &block, SharedDisplayStats &stats) -> bool {
+    for (int attempt = 0; attempt < 1000; attempt++) {
+      auto before = block.sequence.load(std::memory_order_acquire);
+      if ((before & 1U) != 0) {
+        continue;
+      }
+      memcpy(&stats, &block.stats, sizeof(stats));
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (block.sequence.load(std::memory_order_relaxed) == before) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+}
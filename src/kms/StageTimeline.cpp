@@ -0,0 +1,166 @@
+#include "StageTimeline.hpp"
+
+#include <algorithm>
+#include <cinttypes>
+#include <cmath>
+#include <cstdio>
+
+namespace glplay::kms {
+
+  namespace {
+
+    /* The stretches of a frame's life we report on. */
+    struct Interval {
+      FrameStage from;
+      FrameStage to;
+      const char *what;
+    };
+
+    const std::array<Interval, 8> REPORTED = {{
+      { FrameStage::RenderStart, FrameStage::Flush, "CPU render" },
+      { FrameStage::Flush, FrameStage::RenderDone, "GPU render" },
+      { FrameStage::RenderStart, FrameStage::GpuStart, "render start to GPU" },
+      { FrameStage::GpuStart, FrameStage::GpuEnd, "GPU execution" },
+      { FrameStage::RenderDone, FrameStage::Commit, "render done to commit" },
+      { FrameStage::Commit, FrameStage::KmsFence, "commit to KMS fence" },
+      { FrameStage::Commit, FrameStage::Flip, "commit to flip" },
+      { FrameStage::RenderStart, FrameStage::Flip, "render start to flip" },
+    }};
+
+    /* The CPU, GPU and display stretches late frames are blamed on. */
+    const std::array<Interval, 3> BOUNDS = {{
+      { FrameStage::RenderStart, FrameStage::Flush, "CPU" },
+      { FrameStage::Flush, FrameStage::RenderDone, "GPU" },
+      { FrameStage::Commit, FrameStage::Flip, "display" },
+    }};
+
+    /*
+     * The GPU's own execution, from timer queries; where a frame has it, it
+     * stands for the GPU instead of flush to fence, which also takes in the
+     * time queued behind other work.
+     */
+    const Interval GPU_TIMED = { FrameStage::GpuStart, FrameStage::GpuEnd, "GPU" };
+    const size_t GPU_BOUND = 1;
+
+    auto known(const FrameRecord &frame, FrameStage from, FrameStage to) -> bool {
+      return frame.at(from) != 0 && frame.at(to) != 0;
+    }
+
+  }
+
+  auto StageTimeline::intervals(FrameStage from, FrameStage to) const -> std::vector<int64_t> {
+    std::vector<int64_t> values;
+    values.reserve(frames.size());
+    for (const auto &frame : frames) {
+      if (known(frame, from, to)) {
+        values.push_back(frame.at(to) - frame.at(from));
+      }
+    }
+    return values;
+  }
+
+  auto StageTimeline::percentile(FrameStage from, FrameStage to, double p) const -> int64_t {
+    auto values = intervals(from, to);
+    if (values.empty()) {
+      return 0;
+    }
+    auto rank = static_cast<size_t>(std::ceil(p / 100.0 * static_cast<double>(values.size())));
+    rank = std::clamp<size_t>(rank, 1, values.size()) - 1;
+    std::nth_element(values.begin(), values.begin() + static_cast<std::ptrdiff_t>(rank), values.end());
+    return values[rank];
+  }
+
+  void StageTimeline::record(const FrameRecord &frame) {
+    if (frames.size() < CAPACITY) {
+      frames.push_back(frame);
+    } else {
+      frames[next] = frame;
+    }
+    next = (next + 1) % CAPACITY;
+    recorded++;
+    if (frame.late) {
+      lateFrames++;
+    }
+  }
+
+  /*
+  * Blames each late frame in the ring on whichever stretch overran its
+  * median over the ring by the most. Done here rather than as frames come
+  * in, so the flip handler never sorts anything.
+  */
+  auto StageTimeline::blame() const -> std::array<uint64_t, static_cast<size_t>(Bound::Count)> {
+    std::array<uint64_t, static_cast<size_t>(Bound::Count)> counts{};
+    std::array<int64_t, BOUNDS.size()> medians{};
+    for (size_t idx = 0; idx < BOUNDS.size(); idx++) {
+      medians.at(idx) = percentile(BOUNDS.at(idx).from, BOUNDS.at(idx).to, 50);
+    }
+    auto gpuTimedMedian = percentile(GPU_TIMED.from, GPU_TIMED.to, 50);
+
+    for (const auto &frame : frames) {
+      if (!frame.late) {
+        continue;
+      }
+      int64_t worst = 0;
+      auto bound = Bound::Count;
+      for (size_t idx = 0; idx < BOUNDS.size(); idx++) {
+        const auto *interval = &BOUNDS.at(idx);
+        auto median = medians.at(idx);
+        if (idx == GPU_BOUND && known(frame, GPU_TIMED.from, GPU_TIMED.to)) {
+          interval = &GPU_TIMED;
+          median = gpuTimedMedian;
+        }
+        if (!known(frame, interval->from, interval->to)) {
+          continue;
+        }
+        auto excess = frame.at(interval->to) - frame.at(interval->from) - median;
+        if (bound == Bound::Count || excess > worst) {
+          worst = excess;
+          bound = static_cast<Bound>(idx);
+        }
+      }
+      if (bound != Bound::Count) {
+        counts.at(static_cast<size_t>(bound))++;
+      }
+    }
+    return counts;
+  }
+
+  auto StageTimeline::gpuTimed(int64_t renderStartNsec, int64_t startNsec, int64_t endNsec) -> bool {
+    /* Results come in a few frames late, so look from the newest back. */
+    for (size_t age = 1; age <= frames.size(); age++) {
+      auto &frame = frames[(next + CAPACITY - age) % CAPACITY];
+      if (frame.at(FrameStage::RenderStart) == renderStartNsec) {
+        frame.set(FrameStage::GpuStart, startNsec);
+        frame.set(FrameStage::GpuEnd, endNsec);
+        return true;
+      }
+    }
+    return false;
+  }
+
+  void StageTimeline::report(const char *name) const {
+    if (frames.empty()) {
+      return;
+    }
+    fprintf(stderr, "[%s] frame stages over the last %zu of %" PRIu64 " frames:\n",
+            name, frames.size(), recorded);
+    for (const auto &interval : REPORTED) {
+      if (intervals(interval.from, interval.to).empty()) {
+        continue;
+      }
+      fprintf(stderr, "[%s]   %-22s p50 %6" PRIi64 "us, p90 %6" PRIi64 "us, p99 %6" PRIi64 "us, max %6" PRIi64 "us\n",
+              name, interval.what,
+              percentile(interval.from, interval.to, 50) / 1000,
+              percentile(interval.from, interval.to, 90) / 1000,
+              percentile(interval.from, interval.to, 99) / 1000,
+              percentile(interval.from, interval.to, 100) / 1000);
+    }
+    if (lateFrames > 0) {
+      auto counts = blame();
+      fprintf(stderr, "[%s]   %" PRIu64 " late frames; of those in the last %zu, %" PRIu64 " CPU-bound, "
+              "%" PRIu64 " GPU-bound, %" PRIu64 " display-bound\n",
+              name, lateFrames, frames.size(), counts[0], counts[1], counts[2]);
+    }
+  }
+
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace glplay::kms {
+
+  /* The points in a frame's life we take a timestamp at, in order. */
+  enum class FrameStage : size_t {
+    /* We started painting it on the CPU. */
+    RenderStart,
+    /* We flushed its GL commands to the GPU. */
+    Flush,
+    /*
+    * The GPU started and finished its commands, from timer queries; these
+    * arrive frames later, and the GPU may start before we flush.
+    */
+    GpuStart,
+    GpuEnd,
+    /* Its render fence signalled: the GPU was done. */
+    RenderDone,
+    /* We handed the atomic commit carrying it to KMS. */
+    Commit,
+    /* The commit's out-fence signalled. */
+    KmsFence,
+    /* KMS reported it on screen. */
+    Flip,
+    Count,
+  };
+
+  /* One frame's timestamps, as CLOCK_MONOTONIC nanoseconds; 0 where unknown. */
+  struct FrameRecord {
+    std::array<int64_t, static_cast<size_t>(FrameStage::Count)> nsec{};
+    /* Whether it went on screen after its target vblank. */
+    bool late = false;
+
+    void set(FrameStage stage, int64_t when) { nsec.at(static_cast<size_t>(stage)) = when; }
+    [[nodiscard]] auto at(FrameStage stage) const -> int64_t { return nsec.at(static_cast<size_t>(stage)); }
+  };
+
+  /*
+  * Keeps the stage timestamps of a display's recent frames in a ring, and
+  * reports percentiles of the time between stages, so a slow frame can be
+  * put down to the CPU, the GPU or the display without a profiler.
+  *
+  * Each late frame still in the ring is also blamed on whichever of the
+  * CPU, GPU or display stretches overran its median by the most.
+  */
+  class StageTimeline {
+    public:
+      /* Frames kept for the percentiles. */
+      static const size_t CAPACITY = 1024;
+
+      /* Where a late frame lost its time. */
+      enum class Bound { Cpu, Gpu, Display, Count };
+
+      void record(const FrameRecord &frame);
+
+      /*
+      * Adds the GPU's start and end to the recorded frame which started
+      * rendering at 'renderStartNsec'; false if it isn't in the ring.
+      */
+      auto gpuTimed(int64_t renderStartNsec, int64_t startNsec, int64_t endNsec) -> bool;
+
+      /*
+      * The p-th percentile (0 to 100) of the time from one stage to a
+      * later one, over the frames in the ring with both; 0 if none.
+      */
+      [[nodiscard]] auto percentile(FrameStage from, FrameStage to, double p) const -> int64_t;
+
+      /* Late frames in the ring, by what they are put down to. */
+      [[nodiscard]] auto blame() const -> std::array<uint64_t, static_cast<size_t>(Bound::Count)>;
+
+      /* Prints the percentiles and late frame breakdown when we exit. */
+      void report(const char *name) const;
+
+    private:
+      [[nodiscard]] auto intervals(FrameStage from, FrameStage to) const -> std::vector<int64_t>;
+
+      std::vector<FrameRecord> frames;
+      size_t next = 0;
+      uint64_t recorded = 0;
+      uint64_t lateFrames = 0;
+  };
+
+}
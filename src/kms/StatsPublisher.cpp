@@ -0,0 +1,181 @@
+#include "StatsPublisher.hpp"
+#include "Display.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <csignal>
+#include <fcntl.h>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace glplay::kms {
+
+  /* How long achieved FPS is averaged over. */
+  static const int64_t FPS_WINDOW_NSEC = 1000000000;
+
+  /* Whether the process which made the named region is still running. */
+  static auto regionInUse(const std::string &name) -> bool {
+    int fd = shm_open(name.c_str(), O_RDONLY | O_CLOEXEC, 0);
+    if (fd < 0) {
+      return false;
+    }
+    struct stat st = {};
+    void *mem = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size >= static_cast<off_t>(sizeof(SharedStats))) {
+      mem = mmap(nullptr, sizeof(SharedStats), PROT_READ, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    if (mem == MAP_FAILED) {
+      return false;
+    }
+    auto pid = static_cast<const SharedStats *>(mem)->pid;
+    munmap(mem, sizeof(SharedStats));
+    return pid > 0 && (kill(pid, 0) == 0 || errno == EPERM);
+  }
+
+  StatsPublisher::StatsPublisher() {
+    const char *env = getenv("GLPLAY_STATS_SHM");
+    name = (env != nullptr) ? env : "/glplay-stats";
+    if (name == "0") {
+      debug("not publishing frame statistics\n");
+      return;
+    }
+
+    /*
+    * Never take over a region another glplay is still publishing in: one
+    * left behind by an instance which has gone is replaced, but while
+    * the default name is taken by a live one, we add our PID to it.
+    */
+    int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+    if (fd < 0 && errno == EEXIST && !regionInUse(name)) {
+      shm_unlink(name.c_str());
+      fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+    }
+    if (fd < 0 && errno == EEXIST && env == nullptr) {
+      name += "-" + std::to_string(getpid());
+      fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+    }
+    if (fd < 0 || ftruncate(fd, sizeof(SharedStats)) != 0) {
+      error("could not create shared memory %s for frame statistics: %s\n",
+            name.c_str(), strerror(errno));
+      if (fd >= 0) {
+        close(fd);
+        shm_unlink(name.c_str());
+      }
+      return;
+    }
+
+    auto *mem = mmap(nullptr, sizeof(SharedStats), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mem == MAP_FAILED) {
+      error("could not map shared memory %s: %s\n", name.c_str(), strerror(errno));
+      shm_unlink(name.c_str());
+      return;
+    }
+    shared = static_cast<SharedStats *>(mem);
+    shared->version = SHARED_STATS_VERSION;
+    shared->bucketNsec = SHARED_STATS_BUCKET_NSEC;
+    shared->pid = getpid();
+    debug("publishing frame statistics in %s\n", name.c_str());
+  }
+
+  StatsPublisher::~StatsPublisher() {
+    if (shared == nullptr) {
+      return;
+    }
+    munmap(shared, sizeof(SharedStats));
+    shm_unlink(name.c_str());
+  }
+
+  void StatsPublisher::attach(const std::vector<Display> &displays) {
+    trackers.resize(std::min(displays.size(), SHARED_STATS_MAX_DISPLAYS));
+    for (size_t idx = 0; idx < trackers.size(); idx++) {
+      auto &stats = trackers[idx].stats;
+      snprintf(stats.name, sizeof(stats.name), "%s", displays[idx].name.c_str());
+      stats.refreshNsec = displays[idx].refreshIntervalNsec;
+      if (shared != nullptr) {
+        shared_stats_write(shared->displays[idx], stats);
+      }
+    }
+    if (shared != nullptr) {
+      shared->displayCount = trackers.size();
+      /* Readers check the magic last, so they never see a half-made region. */
+      std::atomic_thread_fence(std::memory_order_release);
+      shared->magic = SHARED_STATS_MAGIC;
+    }
+  }
+
+  void StatsPublisher::framePresented(size_t display, uint64_t sequence, const struct timespec &presented,
+                                      const struct timespec &target, int64_t periodNsec, int64_t toleranceNsec) {
+    if (display >= trackers.size()) {
+      return;
+    }
+    auto &tracker = trackers[display];
+    auto &stats = tracker.stats;
+    auto now = static_cast<int64_t>(timespec_to_nsec(&presented));
+
+    if (stats.frames > 0) {
+      auto interval = now - stats.lastPresentNsec;
+      auto bucket = std::clamp<int64_t>(interval / SHARED_STATS_BUCKET_NSEC, 0, SHARED_STATS_BUCKETS - 1);
+      stats.histogram[bucket]++;
+
+      /*
+      * The vblank the frame was meant for, counted on from the last one
+      * we presented on; anything after it went by without our frame.
+      */
+      if (!timespec_is_zero(&target) && periodNsec > 0) {
+        auto wanted = std::llround(static_cast<double>(timespec_to_nsec(&target) - stats.lastPresentNsec) /
+                                   static_cast<double>(periodNsec));
+        auto expected = stats.lastSequence + static_cast<uint64_t>(std::max(wanted, 1LL));
+        if (sequence > expected) {
+          stats.missedVblanks += sequence - expected;
+        }
+      }
+    }
+
+    if (!timespec_is_zero(&target)) {
+      auto delta = timespec_sub_to_nsec(&presented, &target);
+      if (delta < -toleranceNsec) {
+        stats.early++;
+      } else if (delta > toleranceNsec) {
+        stats.late++;
+      }
+    }
+
+    stats.frames++;
+    stats.lastSequence = sequence;
+    stats.lastPresentNsec = now;
+    stats.refreshNsec = periodNsec;
+
+    if (tracker.windowStartNsec == 0) {
+      tracker.windowStartNsec = now;
+    }
+    tracker.windowFrames++;
+    if (now - tracker.windowStartNsec >= FPS_WINDOW_NSEC) {
+      stats.fps = static_cast<double>(tracker.windowFrames - 1) * 1e9 /
+        static_cast<double>(now - tracker.windowStartNsec);
+      tracker.windowStartNsec = now;
+      tracker.windowFrames = 1;
+    }
+
+    if (shared != nullptr) {
+      shared_stats_write(shared->displays[display], stats);
+    }
+  }
+
+  void StatsPublisher::gpuTimed(size_t display, int64_t gpuNsec) {
+    if (display >= trackers.size()) {
+      return;
+    }
+    auto &stats = trackers[display].stats;
+    stats.gpuFrames++;
+    stats.gpuLastNsec = gpuNsec;
+    stats.gpuTotalNsec += gpuNsec;
+  }
+
+}
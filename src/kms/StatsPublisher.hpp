@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstdint>
+#include <ctime>
+#include <string>
+#include <vector>
+
+#include "SharedStats.hpp"
+
+namespace glplay::kms {
+
+  class Display;
+
+  /*
+  * Keeps per-display frame pacing statistics, always on, and publishes
+  * them in a POSIX shared memory region for glplay-stats and monitoring
+  * agents to read; see SharedStats.hpp for the layout.
+  *
+  * The region is named by GLPLAY_STATS_SHM (default "/glplay-stats"); set
+  * it to 0 to keep the statistics to ourselves. If another glplay is
+  * already publishing under the default name, ours gets "-<pid>" added.
+  */
+  class StatsPublisher {
+    public:
+      StatsPublisher();
+      ~StatsPublisher();
+      StatsPublisher(const StatsPublisher &) = delete;
+      auto operator=(const StatsPublisher &) -> StatsPublisher & = delete;
+
+      [[nodiscard]] auto isPublishing() const -> bool { return shared != nullptr; }
+
+      /* Sets up a block for each display, in the same order. */
+      void attach(const std::vector<Display> &displays);
+
+      /*
+      * Records that a display's frame went on screen at 'presented', on
+      * the given vblank, having been predicted for 'target'.
+      */
+      void framePresented(size_t display, uint64_t sequence, const struct timespec &presented,
+                          const struct timespec &target, int64_t periodNsec, int64_t toleranceNsec);
+
+      /* Records a display's frame's GPU time; published with the next frame presented. */
+      void gpuTimed(size_t display, int64_t gpuNsec);
+
+    private:
+      struct Tracker {
+        SharedDisplayStats stats{};
+        int64_t windowStartNsec = 0;
+        uint64_t windowFrames = 0;
+      };
+
+      std::string name;
+      SharedStats *shared = nullptr;
+      std::vector<Tracker> trackers;
+  };
+
+}
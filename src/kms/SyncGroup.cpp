@@ -0,0 +1,154 @@
+#include "SyncGroup.hpp"
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+
+namespace glplay::kms {
+
+  auto SyncGroup::fromEnvironment(std::vector<Display> &displays) -> std::vector<SyncGroup> {
+    std::vector<SyncGroup> groups;
+    const char *env = getenv("GLPLAY_SYNC_GROUP");
+    if (env == nullptr || strcmp(env, "0") == 0) {
+      return groups;
+    }
+
+    unsigned int columns = 0;
+    unsigned int rows = 0;
+    const char *tilesEnv = getenv("GLPLAY_SYNC_TILES");
+    if (tilesEnv != nullptr && sscanf(tilesEnv, "%ux%u", &columns, &rows) != 2) {
+      throw std::runtime_error("GLPLAY_SYNC_TILES must be COLUMNSxROWS");
+    }
+
+    std::istringstream groupList(env);
+    std::string groupSpec;
+    while (std::getline(groupList, groupSpec, ';')) {
+      std::vector<size_t> members;
+      std::istringstream names(groupSpec);
+      std::string entry;
+      while (std::getline(names, entry, ',')) {
+        for (size_t idx = 0; idx < displays.size(); idx++) {
+          /* Frames rendered ahead, flipped immediately or raced can't be held for the others. */
+          if ((entry == "all" || entry == displays[idx].name) && displays[idx].syncGroup < 0 &&
+              displays[idx].presentQueueDepth == 0 && !displays[idx].asyncFlip &&
+              !displays[idx].beam.enabled() &&
+              std::find(members.begin(), members.end(), idx) == members.end()) {
+            members.push_back(idx);
+          }
+        }
+      }
+      if (members.size() < 2) {
+        debug("sync group '%s' has fewer than two displays; ignoring\n", groupSpec.c_str());
+        continue;
+      }
+
+      for (size_t slot = 0; slot < members.size(); slot++) {
+        auto &display = displays[members[slot]];
+        display.syncGroup = static_cast<int>(groups.size());
+        display.syncSlot = slot;
+        /* A member falling back to a lower rate would leave the others behind. */
+        display.pacing.setMaxDivisor(1);
+        if (columns > 0 && rows > 0 && slot < columns * rows) {
+          display.tileColumns = columns;
+          display.tileRows = rows;
+          display.tileColumn = slot % columns;
+          display.tileRow = slot / columns;
+        }
+      }
+      groups.emplace_back(groupSpec, std::move(members));
+      groups.back().contentPeriodNsec = displays[groups.back().members.front()].refreshIntervalNsec;
+      debug("sync group '%s': %zu displays\n", groupSpec.c_str(), groups.back().members.size());
+    }
+    return groups;
+  }
+
+  SyncGroup::SyncGroup(std::string name, std::vector<size_t> members)
+    : groupName(std::move(name)), members(std::move(members)) {
+    completions.resize(this->members.size());
+  }
+
+  auto SyncGroup::ready(const std::vector<Display> &displays) const -> bool {
+    return std::none_of(members.begin(), members.end(), [&displays](size_t idx) {
+      return displays[idx].bufferPending != nullptr;
+    });
+  }
+
+  void SyncGroup::coalesce(std::vector<Display> &displays) {
+    auto due = std::any_of(members.begin(), members.end(), [&displays](size_t idx) {
+      return displays[idx].needs_repaint;
+    });
+    if (!due) {
+      return;
+    }
+
+    for (auto idx : members) {
+      displays[idx].needs_repaint = true;
+      displays[idx].repaintScheduled = false;
+    }
+    if (!roundOpen && ready(displays)) {
+      roundOpen = true;
+      roundTarget = {};
+      std::fill(completions.begin(), completions.end(), timespec{});
+      completed = 0;
+    }
+  }
+
+  void SyncGroup::shareTarget(Display &display) {
+    if (timespec_is_zero(&display.next_frame)) {
+      return;
+    }
+    if (timespec_is_zero(&roundTarget)) {
+      roundTarget = display.next_frame;
+      return;
+    }
+
+    auto period = display.vblankPeriodNsec();
+    while (timespec_sub_to_nsec(&roundTarget, &display.next_frame) > period / 2) {
+      display.next_frame = display.nextFrameTarget(display.next_frame);
+    }
+    /* We can't make the round's vblank any more; the drift will show it. */
+    if (timespec_sub_to_nsec(&display.next_frame, &roundTarget) > period / 2) {
+      misaligned++;
+      debug("[%s] %" PRIi64 "ns behind sync group '%s'\n", display.name.c_str(),
+            timespec_sub_to_nsec(&display.next_frame, &roundTarget), groupName.c_str());
+    }
+  }
+
+  auto SyncGroup::contentFrame(unsigned int frames) const -> unsigned int {
+    if (contentPeriodNsec <= 0) {
+      return 0;
+    }
+    return (timespec_to_nsec(&roundTarget) / contentPeriodNsec) % frames;
+  }
+
+  void SyncGroup::frameCompleted(const Display &display, const struct timespec &completion) {
+    /* Every member's commit went out in one request, so painting is over. */
+    roundOpen = false;
+    if (display.syncSlot >= completions.size() || !timespec_is_zero(&completions[display.syncSlot])) {
+      return;
+    }
+    completions[display.syncSlot] = completion;
+    if (++completed < completions.size()) {
+      return;
+    }
+
+    auto [earliest, latest] = std::minmax_element(completions.begin(), completions.end(),
+      [](const struct timespec &lhs, const struct timespec &rhs) {
+        return timespec_sub_to_nsec(&lhs, &rhs) < 0;
+      });
+    drift.add(timespec_sub_to_nsec(&*latest, &*earliest));
+  }
+
+  void SyncGroup::report() const {
+    drift.report(groupName.c_str(), "sync group drift");
+    if (misaligned > 0) {
+      fprintf(stderr, "[%s] sync group: %" PRIu64 " frames missed the group's vblank\n",
+              groupName.c_str(), misaligned);
+    }
+  }
+
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstdint>
+#include <ctime>
+#include <string>
+#include <vector>
+
+#include "Display.hpp"
+#include "LatencyStats.hpp"
+
+namespace glplay::kms {
+
+  /*
+  * Displays which show one picture together, as in a video wall.
+  *
+  * Each display normally keeps its own animation frame and its own
+  * target vblank, so side by side they show different frames at the same
+  * moment. A sync group's members are repainted together, only once none
+  * of them has a commit in flight, and go out in one atomic request. The
+  * first member painted picks the target time for the round, and the
+  * others aim for their own vblank nearest to it; the animation frame
+  * comes from that shared target time, so every member draws the same
+  * one. How far apart the members' completions land is the group's drift.
+  *
+  * For a tiled wall, each member draws only its own tile of the picture,
+  * from the same geometry, so the tiles meet exactly without rendering the
+  * whole wall once and copying parts of it around on the GPU.
+  *
+  * GLPLAY_SYNC_GROUP lists the members, or "all"; several groups are
+  * separated by semicolons. GLPLAY_SYNC_TILES gives the wall's layout as
+  * COLUMNSxROWS, filled by the members in the order listed.
+  */
+  class SyncGroup {
+    public:
+      /* Groups from the environment; sets up the members' sync fields. */
+      static auto fromEnvironment(std::vector<Display> &displays) -> std::vector<SyncGroup>;
+
+      SyncGroup(std::string name, std::vector<size_t> members);
+
+      [[nodiscard]] auto name() const -> const std::string & { return groupName; }
+
+      /* Whether no member has a commit in flight, so the group can be painted. */
+      [[nodiscard]] auto ready(const std::vector<Display> &displays) const -> bool;
+
+      /*
+      * If any member is due for a repaint, flags them all, and starts a
+      * new round if the group is ready. Call after the scheduler's
+      * dispatch().
+      */
+      void coalesce(std::vector<Display> &displays);
+
+      /*
+      * Moves a member's next_frame, just predicted, to its vblank closest
+      * to the round's target, or makes it the target if it is the first.
+      */
+      void shareTarget(Display &display);
+      /* The animation frame for the round, out of 'frames'. */
+      [[nodiscard]] auto contentFrame(unsigned int frames) const -> unsigned int;
+
+      /* Records a member's completion, and the drift once all are in. */
+      void frameCompleted(const Display &display, const struct timespec &completion);
+
+      /* Prints the group's drift and misalignments when we exit. */
+      void report() const;
+
+    private:
+      std::string groupName;
+      std::vector<size_t> members;
+      /* Tick of the shared content clock: the first member's refresh interval. */
+      int64_t contentPeriodNsec = 0;
+
+      bool roundOpen = false;
+      struct timespec roundTarget{};
+      std::vector<struct timespec> completions;
+      size_t completed = 0;
+
+      LatencyStats drift;
+      uint64_t misaligned = 0;
+  };
+
+}
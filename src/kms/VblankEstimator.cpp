@@ -0,0 +1,81 @@
+#include "VblankEstimator.hpp"
+
+#include <cmath>
+
+namespace glplay::kms {
+
+  void VblankEstimator::reset() {
+    samples.clear();
+    fitted = false;
+  }
+
+  void VblankEstimator::addSample(uint32_t sequence, int64_t nsec) {
+    if (samples.empty()) {
+      extendedSequence = sequence;
+    } else {
+      /* Several completions can report the same vblank; keep the first. */
+      if (sequence == lastRawSequence) {
+        return;
+      }
+      extendedSequence += static_cast<uint32_t>(sequence - lastRawSequence);
+    }
+    lastRawSequence = sequence;
+
+    if (fitted && std::fabs(static_cast<double>(nsec - timeOf(extendedSequence))) > period / 4) {
+      auto restart = extendedSequence;
+      reset();
+      extendedSequence = restart;
+    }
+
+    samples.push_back({ extendedSequence, nsec });
+    if (samples.size() > WINDOW) {
+      samples.pop_front();
+    }
+    fit();
+  }
+
+  void VblankEstimator::fit() {
+    if (samples.size() < MIN_SAMPLES) {
+      fitted = false;
+      return;
+    }
+
+    /* Work relative to the oldest sample to keep doubles precise. */
+    const auto &origin = samples.front();
+    double sumX = 0;
+    double sumY = 0;
+    double sumXX = 0;
+    double sumXY = 0;
+    auto count = static_cast<double>(samples.size());
+    for (const auto &sample : samples) {
+      auto x = static_cast<double>(sample.sequence - origin.sequence);
+      auto y = static_cast<double>(sample.nsec - origin.nsec);
+      sumX += x;
+      sumY += y;
+      sumXX += x * x;
+      sumXY += x * y;
+    }
+
+    double denominator = count * sumXX - sumX * sumX;
+    if (denominator <= 0) {
+      fitted = false;
+      return;
+    }
+    period = (count * sumXY - sumX * sumY) / denominator;
+    phase = (sumY - period * sumX) / count;
+    fitted = period > 0;
+  }
+
+  auto VblankEstimator::timeOf(uint64_t sequence) const -> int64_t {
+    const auto &origin = samples.front();
+    auto offset = static_cast<double>(static_cast<int64_t>(sequence - origin.sequence));
+    return origin.nsec + std::llround(phase + period * offset);
+  }
+
+  auto VblankEstimator::sequenceNear(int64_t nsec) const -> uint64_t {
+    const auto &origin = samples.front();
+    auto offset = std::llround((static_cast<double>(nsec - origin.nsec) - phase) / period);
+    return origin.sequence + offset;
+  }
+
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+
+namespace glplay::kms {
+
+  /*
+  * Tracks the vblank period and phase of one CRTC from the (sequence,
+  * timestamp) pairs KMS gives us with each completion.
+  *
+  * The mode timings only give the nominal refresh rate; the real dot clock
+  * is never exactly that, and adding the nominal interval to the last
+  * timestamp also carries that timestamp's jitter into every prediction.
+  * Instead we fit time = phase + period * sequence by least squares over
+  * a sliding window, and predict vblanks from the fitted line.
+  *
+  * A sample too far off the line means the timing changed under us (a
+  * modeset, or the CRTC being switched off and on), so we start over.
+  */
+  class VblankEstimator {
+    public:
+      static const size_t WINDOW = 120;
+      static const size_t MIN_SAMPLES = 8;
+
+      void addSample(uint32_t sequence, int64_t nsec);
+      void reset();
+
+      [[nodiscard]] auto valid() const -> bool { return fitted; }
+      [[nodiscard]] auto periodNsec() const -> double { return period; }
+      /* Time of the given (extended, 64-bit) vblank sequence number. */
+      [[nodiscard]] auto timeOf(uint64_t sequence) const -> int64_t;
+      /* Sequence number of the vblank closest to the given time. */
+      [[nodiscard]] auto sequenceNear(int64_t nsec) const -> uint64_t;
+
+    private:
+      void fit();
+
+      struct Sample {
+        uint64_t sequence;
+        int64_t nsec;
+      };
+      std::deque<Sample> samples;
+
+      /* The kernel's counter is 32 bits; we extend it as it wraps. */
+      uint64_t extendedSequence = 0;
+      uint32_t lastRawSequence = 0;
+
+      bool fitted = false;
+      double period = 0;
+      /* Offset of the fitted line from the oldest sample's timestamp. */
+      double phase = 0;
+  };
+
+}
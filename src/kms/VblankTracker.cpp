@@ -0,0 +1,67 @@
+#include "VblankTracker.hpp"
+
+#include <cinttypes>
+#include <cstring>
+
+namespace glplay::kms {
+
+  VblankTracker::VblankTracker(int adapterFD): adapterFD(adapterFD) {
+  }
+
+  void VblankTracker::record(Display &display, uint64_t sequence, uint64_t nsec) {
+    /* Page-flip events carry the same counter, truncated to 32 bits. */
+    if (!display.vrrEnabled) {
+      display.vblank.addSample(static_cast<uint32_t>(sequence), static_cast<int64_t>(nsec));
+    }
+    timespec_from_nsec(&display.last_vblank, static_cast<int64_t>(nsec));
+  }
+
+  auto VblankTracker::sample(Display &display) -> bool {
+    uint64_t sequence = 0;
+    uint64_t nsec = 0;
+
+    if (!supported) {
+      return false;
+    }
+
+    /* This fails with EINVAL while the CRTC is off. */
+    if (drmCrtcGetSequence(adapterFD, display.crtc->crtc_id, &sequence, &nsec) != 0) {
+      debug("[%s] could not read vblank sequence: %s\n", display.name.c_str(), strerror(errno));
+      return false;
+    }
+    record(display, sequence, nsec);
+    return true;
+  }
+
+  void VblankTracker::queueWakeup(Display &display) {
+    uint64_t queued = 0;
+
+    if (!supported || display.sequenceQueued) {
+      return;
+    }
+
+    int ret = drmCrtcQueueSequence(adapterFD, display.crtc->crtc_id,
+                                   DRM_CRTC_SEQUENCE_RELATIVE | DRM_CRTC_SEQUENCE_NEXT_ON_MISS,
+                                   1, &queued, display.crtc->crtc_id);
+    if (ret == 0) {
+      display.sequenceQueued = true;
+      return;
+    }
+
+    /* Kernels before 4.16 don't have the ioctl at all. */
+    if (errno == EINVAL || errno == ENOTTY || errno == EOPNOTSUPP) {
+      debug("CRTC sequence events not supported: %s\n", strerror(errno));
+      supported = false;
+    }
+  }
+
+  void VblankTracker::eventReceived(Display &display, uint64_t sequence, uint64_t nsec) {
+    display.sequenceQueued = false;
+    record(display, sequence, nsec);
+  }
+
+  auto VblankTracker::wantsWakeup(const Display &display) -> bool {
+    return !display.vrrEnabled && !display.vblank.valid() && display.bufferPending == nullptr;
+  }
+
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstdint>
+
+#include "Display.hpp"
+
+namespace glplay::kms {
+
+  /*
+  * Keeps each display's vblank timing known even when nothing is being
+  * committed to it: before its first commit, and while it is idle.
+  *
+  * drmCrtcGetSequence gives us a CRTC's current vblank counter and the
+  * time it ticked, on demand; drmCrtcQueueSequence asks KMS for an event
+  * at a future vblank, which arrives on the KMS FD alongside our
+  * page-flip events. Both feed the display's VblankEstimator and
+  * last_vblank, so predictions never have to start from nothing.
+  */
+  class VblankTracker {
+    public:
+      explicit VblankTracker(int adapterFD);
+
+      [[nodiscard]] auto isSupported() const -> bool { return supported; }
+
+      /* Samples the CRTC's current vblank; false if it is not running. */
+      auto sample(Display &display) -> bool;
+      /* Asks for an event at the CRTC's next vblank, unless one is queued. */
+      void queueWakeup(Display &display);
+      /* Records a queued vblank event, delivered through drmHandleEvent. */
+      static void eventReceived(Display &display, uint64_t sequence, uint64_t nsec);
+      /* Records the vblank a page flip completed on. */
+      static void record(Display &display, uint64_t sequence, uint64_t nsec);
+
+      /*
+      * Whether a display should be woken at its next vblank: while its
+      * estimator has not locked on, and nothing is in flight to give us
+      * a completion instead.
+      */
+      static auto wantsWakeup(const Display &display) -> bool;
+
+    private:
+      int adapterFD;
+      bool supported = true;
+  };
+
+}
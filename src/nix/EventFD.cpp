@@ -0,0 +1,56 @@
+#include "EventFD.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <string>
+
+namespace glplay::nix {
+
+  EventFD::EventFD(): fd(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) {
+    if (fd == -1) {
+      throw std::runtime_error(std::string("Error creating eventfd: ") + strerror(errno));
+    }
+  }
+
+  EventFD::~EventFD() {
+    if (fd != -1) {
+      close(fd);
+    }
+  }
+
+  // Move constructor
+  // Transfer ownership
+  EventFD::EventFD(EventFD&& other) noexcept : fd(other.fd) {
+    other.fd = -1;
+  }
+
+  // Move assignment
+  // Transfer ownership
+  auto EventFD::operator=(EventFD&& other) noexcept -> EventFD& {
+    if (&other == this) {
+      return *this;
+    }
+    if (fd >= 0) {
+      close(fd);
+    }
+    fd = other.fd;
+    other.fd = -1;
+    return *this;
+  }
+
+  void EventFD::signal() const {
+    uint64_t one = 1;
+    /* Can only fail if the counter would overflow, which still wakes us. */
+    (void) !write(fd, &one, sizeof(one));
+  }
+
+  auto EventFD::consume() const -> uint64_t {
+    uint64_t count = 0;
+
+    if (read(fd, &count, sizeof(count)) != sizeof(count)) {
+      return 0;
+    }
+    return count;
+  }
+
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstdint>
+#include <stdexcept>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+namespace glplay::nix {
+
+  /*
+  * An eventfd used to wake the main loop's poll from another thread.
+  */
+  class EventFD {
+    public:
+      EventFD();
+      EventFD(const EventFD& other) = delete;
+      EventFD(EventFD&& other) noexcept; //Move constructor
+      auto operator=(const EventFD& other) -> EventFD& = delete;
+      auto operator=(EventFD&& other) noexcept -> EventFD&; //Move assignment
+      ~EventFD();
+
+      [[nodiscard]] auto fileDescriptor() const -> int { return fd; }
+      /* Safe to call from any thread, and from signal handlers. */
+      void signal() const;
+      /* Drains the counter; returns how many times signal() was called. */
+      auto consume() const -> uint64_t;
+
+    private:
+      int fd = -1;
+  };
+
+}
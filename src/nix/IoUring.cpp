@@ -0,0 +1,123 @@
+#include "IoUring.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace glplay::nix {
+
+  static auto map_ring(int fd, size_t size, off_t offset) -> void * {
+    void *ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, offset);
+    if (ptr == MAP_FAILED) {
+      throw std::runtime_error(std::string("Error mapping io_uring: ") + strerror(errno));
+    }
+    return ptr;
+  }
+
+  IoUring::IoUring(unsigned entries) {
+    struct io_uring_params params = {};
+
+    fd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+    if (fd < 0) {
+      throw std::runtime_error(std::string("Error setting up io_uring: ") + strerror(errno));
+    }
+
+    try {
+      sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+      cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+      /* Newer kernels share one mapping between both rings. */
+      if ((params.features & IORING_FEAT_SINGLE_MMAP) != 0U) {
+        sqRingSize = cqRingSize = std::max(sqRingSize, cqRingSize);
+      }
+      sqRing = map_ring(fd, sqRingSize, IORING_OFF_SQ_RING);
+      if ((params.features & IORING_FEAT_SINGLE_MMAP) != 0U) {
+        cqRing = sqRing;
+      } else {
+        cqRing = map_ring(fd, cqRingSize, IORING_OFF_CQ_RING);
+      }
+      sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+      sqes = static_cast<struct io_uring_sqe *>(map_ring(fd, sqesSize, IORING_OFF_SQES));
+    } catch (const std::runtime_error &) {
+      unmap();
+      close(fd);
+      throw;
+    }
+
+    auto *sq = static_cast<char *>(sqRing);
+    sqHead = reinterpret_cast<unsigned *>(sq + params.sq_off.head);
+    sqTail = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+    sqArray = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+    sqMask = *reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+    sqEntries = params.sq_entries;
+    sqeTail = *sqTail;
+
+    auto *cq = static_cast<char *>(cqRing);
+    cqHead = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+    cqTail = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+    cqMask = *reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+    cqes = reinterpret_cast<struct io_uring_cqe *>(cq + params.cq_off.cqes);
+  }
+
+  IoUring::~IoUring() {
+    unmap();
+    if (fd != -1) {
+      close(fd);
+    }
+  }
+
+  void IoUring::unmap() {
+    if (sqes != nullptr) {
+      munmap(sqes, sqesSize);
+    }
+    if (cqRing != nullptr && cqRing != sqRing) {
+      munmap(cqRing, cqRingSize);
+    }
+    if (sqRing != nullptr) {
+      munmap(sqRing, sqRingSize);
+    }
+    sqes = nullptr;
+    cqRing = sqRing = nullptr;
+  }
+
+  auto IoUring::supports(std::initializer_list<uint8_t> opcodes) const -> bool {
+    const unsigned maxOps = 256;
+    std::vector<char> buffer(sizeof(struct io_uring_probe) + (maxOps * sizeof(struct io_uring_probe_op)));
+    auto *probe = reinterpret_cast<struct io_uring_probe *>(buffer.data());
+
+    if (syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE, probe, maxOps) < 0) {
+      return false;
+    }
+    return std::all_of(opcodes.begin(), opcodes.end(), [probe](uint8_t opcode) {
+      return opcode <= probe->last_op && (probe->ops[opcode].flags & IO_URING_OP_SUPPORTED) != 0;
+    });
+  }
+
+  auto IoUring::getSqe() -> struct io_uring_sqe * {
+    auto head = __atomic_load_n(sqHead, __ATOMIC_ACQUIRE);
+    if (sqeTail - head >= sqEntries) {
+      return nullptr;
+    }
+
+    auto index = sqeTail & sqMask;
+    auto *sqe = &sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sqArray[index] = index;
+    sqeTail++;
+    return sqe;
+  }
+
+  auto IoUring::enter(unsigned waitNr) -> int {
+    auto toSubmit = sqeTail - *sqTail;
+    __atomic_store_n(sqTail, sqeTail, __ATOMIC_RELEASE);
+
+    auto ret = syscall(__NR_io_uring_enter, fd, toSubmit, waitNr,
+                       waitNr > 0 ? IORING_ENTER_GETEVENTS : 0U, nullptr, 0);
+    return ret < 0 ? -errno : static_cast<int>(ret);
+  }
+
+}
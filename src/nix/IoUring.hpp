@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <linux/io_uring.h>
+#include <stdexcept>
+
+namespace glplay::nix {
+
+  /*
+  * A bare io_uring instance, set up with the raw syscalls so we don't need
+  * liburing. Entries are queued with getSqe() and only reach the kernel on
+  * the next enter(), which also waits for completions; so everything one
+  * loop iteration wants to wait on costs a single syscall.
+  */
+  class IoUring {
+    public:
+      explicit IoUring(unsigned entries);
+      IoUring(const IoUring& other) = delete;
+      IoUring(IoUring&& other) = delete;
+      auto operator=(const IoUring& other) -> IoUring& = delete;
+      auto operator=(IoUring&& other) -> IoUring& = delete;
+      ~IoUring();
+
+      /*
+      * Whether the kernel supports every one of the given opcodes; false
+      * on kernels too old to say (before 5.6, which added IORING_OP_READ).
+      */
+      [[nodiscard]] auto supports(std::initializer_list<uint8_t> opcodes) const -> bool;
+
+      /* How many entries can be queued before the next enter(). */
+      [[nodiscard]] auto sqSpace() const -> unsigned {
+        return sqEntries - (sqeTail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE));
+      }
+      /* A zeroed submission entry, or nullptr if the queue is full. */
+      auto getSqe() -> struct io_uring_sqe *;
+      /*
+      * Submits everything queued since the last call, and waits until at
+      * least waitNr completions are available. Returns -errno on error.
+      */
+      auto enter(unsigned waitNr) -> int;
+      /* Calls func on every completion available, and retires them. */
+      template<typename Func>
+      void reap(Func &&func) {
+        auto head = *cqHead;
+        auto tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+        for (; head != tail; head++) {
+          func(cqes[head & cqMask]);
+        }
+        __atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+      }
+
+    private:
+      void unmap();
+
+      int fd = -1;
+      void *sqRing = nullptr;
+      size_t sqRingSize = 0;
+      void *cqRing = nullptr;
+      size_t cqRingSize = 0;
+      struct io_uring_sqe *sqes = nullptr;
+      size_t sqesSize = 0;
+
+      unsigned *sqHead = nullptr;
+      unsigned *sqTail = nullptr;
+      unsigned *sqArray = nullptr;
+      unsigned sqMask = 0;
+      unsigned sqEntries = 0;
+      /* Our tail, ahead of the kernel's view until the next enter(). */
+      unsigned sqeTail = 0;
+
+      unsigned *cqHead = nullptr;
+      unsigned *cqTail = nullptr;
+      unsigned cqMask = 0;
+      struct io_uring_cqe *cqes = nullptr;
+  };
+
+}
@@ -0,0 +1,291 @@
+#include "Reactor.hpp"
+#include "log.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <poll.h>
+#include <stdexcept>
+#include <string>
+#include <unistd.h>
+
+namespace glplay::nix {
+
+  static const int64_t NSEC_PER_SEC = 1000000000;
+  /* Room for every output's waits, plus the DRM read and the signal fd. */
+  static const unsigned RING_ENTRIES = 64;
+  /*
+  * Tags the poll half of a linked read in its user_data, so it can be
+  * cancelled; Waiters are aligned, so the bit is otherwise clear.
+  */
+  static const uint64_t LINKED_POLL = 1;
+
+  Reactor::Reactor(bool useIoUring) {
+    if (!useIoUring) {
+      return;
+    }
+    try {
+      ring = std::make_unique<IoUring>(RING_ENTRIES);
+    } catch (const std::runtime_error &err) {
+      error("%s; falling back to ppoll\n", err.what());
+      return;
+    }
+
+    /*
+    * Kernels from 5.1 set rings up, but only 5.6 can read through one,
+    * and take absolute timeouts from 5.5; check for everything we submit.
+    */
+    if (!ring->supports({ IORING_OP_POLL_ADD, IORING_OP_POLL_REMOVE, IORING_OP_READ,
+                          IORING_OP_TIMEOUT, IORING_OP_TIMEOUT_REMOVE, IORING_OP_ASYNC_CANCEL })) {
+      error("io_uring lacks operations we need; falling back to ppoll\n");
+      ring.reset();
+    }
+  }
+
+  auto Reactor::now() -> int64_t {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t) now.tv_sec * NSEC_PER_SEC + now.tv_nsec;
+  }
+
+  auto Reactor::until(const struct timespec &deadline) -> TimerAwaiter {
+    return {*this, (int64_t) deadline.tv_sec * NSEC_PER_SEC + deadline.tv_nsec};
+  }
+
+  auto Reactor::ReadAwaiter::await_resume() -> ssize_t {
+    if (reactor.usingIoUring()) {
+      return waiter.result;
+    }
+    auto len = ::read(fd, buffer, size);
+    return len < 0 ? -errno : len;
+  }
+
+  /* Submits what we have queued so far if the ring is out of space. */
+  auto Reactor::ringSqe() -> struct io_uring_sqe * {
+    auto *sqe = ring->getSqe();
+    if (sqe == nullptr) {
+      ring->enter(0);
+      sqe = ring->getSqe();
+    }
+    if (sqe == nullptr) {
+      throw std::runtime_error("io_uring submission queue full");
+    }
+    return sqe;
+  }
+
+  void Reactor::watchReadable(int fd, Waiter *waiter) {
+    if (!ring) {
+      readers.emplace_back(fd, waiter);
+      return;
+    }
+    auto *sqe = ringSqe();
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->poll32_events = POLLIN;
+    sqe->user_data = reinterpret_cast<uintptr_t>(waiter);
+    ringWaits.emplace_back(waiter, IORING_OP_POLL_ADD);
+  }
+
+  void Reactor::watchRead(int fd, void *buffer, size_t size, Waiter *waiter) {
+    if (!ring) {
+      readers.emplace_back(fd, waiter);
+      return;
+    }
+
+    /*
+    * Link the read to a poll, so it waits for data rather than failing
+    * with EAGAIN on a non-blocking fd. Only the read reports back.
+    */
+    if (ring->sqSpace() < 2) {
+      ring->enter(0);
+    }
+    auto *poll = ringSqe();
+    poll->opcode = IORING_OP_POLL_ADD;
+    poll->fd = fd;
+    poll->poll32_events = POLLIN;
+    poll->flags = IOSQE_IO_LINK;
+    poll->user_data = reinterpret_cast<uintptr_t>(waiter) | LINKED_POLL;
+
+    auto *read = ringSqe();
+    read->opcode = IORING_OP_READ;
+    read->fd = fd;
+    read->addr = reinterpret_cast<uintptr_t>(buffer);
+    read->len = static_cast<uint32_t>(size);
+    read->user_data = reinterpret_cast<uintptr_t>(waiter);
+    ringWaits.emplace_back(waiter, IORING_OP_READ);
+  }
+
+  void Reactor::watchDeadline(int64_t deadlineNsec, Waiter *waiter) {
+    if (!ring) {
+      timers.emplace(deadlineNsec, waiter);
+      return;
+    }
+    waiter->timeout.tv_sec = deadlineNsec / NSEC_PER_SEC;
+    waiter->timeout.tv_nsec = deadlineNsec % NSEC_PER_SEC;
+
+    auto *sqe = ringSqe();
+    sqe->opcode = IORING_OP_TIMEOUT;
+    sqe->fd = -1;
+    sqe->addr = reinterpret_cast<uintptr_t>(&waiter->timeout);
+    sqe->len = 1;
+    sqe->timeout_flags = IORING_TIMEOUT_ABS;
+    sqe->user_data = reinterpret_cast<uintptr_t>(waiter);
+    ringWaits.emplace_back(waiter, IORING_OP_TIMEOUT);
+  }
+
+  auto Reactor::runOnce() -> bool {
+    if (ready.empty() && readers.empty() && timers.empty() && ringWaits.empty()) {
+      return false;
+    }
+
+    if (ring) {
+      ringOnce();
+    } else {
+      pollOnce();
+    }
+
+    auto resuming = std::move(ready);
+    ready.clear();
+    for (auto handle : resuming) {
+      handle.resume();
+    }
+    return true;
+  }
+
+  void Reactor::pollOnce() {
+    std::vector<struct pollfd> poll_fds;
+    poll_fds.reserve(readers.size());
+    for (auto &reader : readers) {
+      poll_fds.push_back({ .fd = reader.first, .events = POLLIN, .revents = 0 });
+    }
+
+    /* Don't sleep past the earliest deadline, or at all with work queued. */
+    struct timespec timeout = {};
+    struct timespec *timeout_ptr = &timeout;
+    if (ready.empty()) {
+      if (timers.empty()) {
+        timeout_ptr = nullptr;
+      } else {
+        auto delta = timers.begin()->first - now();
+        if (delta > 0) {
+          timeout.tv_sec = delta / NSEC_PER_SEC;
+          timeout.tv_nsec = delta % NSEC_PER_SEC;
+        }
+      }
+    }
+
+    waitCount++;
+    if (ppoll(poll_fds.data(), poll_fds.size(), timeout_ptr, nullptr) == -1 && errno != EINTR) {
+      throw std::runtime_error(std::string("Error polling reactor: ") + strerror(errno));
+    }
+    clock_gettime(CLOCK_MONOTONIC, &woken_at);
+
+    /*
+    * Collect everyone who is ready before resuming anyone, as resuming a
+    * coroutine usually has it wait on something again.
+    */
+    for (size_t idx = poll_fds.size(); idx-- > 0;) {
+      if (poll_fds[idx].revents == 0) {
+        continue;
+      }
+      ready.push_back(readers[idx].second->handle);
+      readers.erase(readers.begin() + (long) idx);
+    }
+    auto woken_nsec = (int64_t) woken_at.tv_sec * NSEC_PER_SEC + woken_at.tv_nsec;
+    while (!timers.empty() && timers.begin()->first <= woken_nsec) {
+      ready.push_back(timers.begin()->second->handle);
+      timers.erase(timers.begin());
+    }
+  }
+
+  void Reactor::ringOnce() {
+    waitCount++;
+    auto ret = ring->enter(ready.empty() ? 1 : 0);
+    if (ret < 0 && ret != -EINTR && ret != -EAGAIN && ret != -EBUSY) {
+      throw std::runtime_error(std::string("Error entering io_uring: ") + strerror(-ret));
+    }
+    clock_gettime(CLOCK_MONOTONIC, &woken_at);
+
+    ring->reap([this](const struct io_uring_cqe &cqe) {
+      auto *waiter = ringCompleted(cqe);
+      if (waiter != nullptr) {
+        waiter->result = cqe.res;
+        ready.push_back(waiter->handle);
+      }
+    });
+  }
+
+  /*
+  * Retires the wait a completion is for, and returns its Waiter; nullptr
+  * for the poll half of a linked read, and for cancellations.
+  */
+  auto Reactor::ringCompleted(const struct io_uring_cqe &cqe) -> Waiter * {
+    if (cqe.user_data == 0 || (cqe.user_data & LINKED_POLL) != 0) {
+      return nullptr;
+    }
+    auto *waiter = reinterpret_cast<Waiter *>(static_cast<uintptr_t>(cqe.user_data));
+    auto wait = std::find_if(ringWaits.begin(), ringWaits.end(),
+                             [waiter](const auto &pending) { return pending.first == waiter; });
+    if (wait != ringWaits.end()) {
+      ringWaits.erase(wait);
+    }
+    return waiter;
+  }
+
+  void Reactor::cancelAll() {
+    if (!ring) {
+      readers.clear();
+      timers.clear();
+      ready.clear();
+      return;
+    }
+
+    /*
+    * Polls and timeouts have removal ops going back to the first io_uring
+    * kernels. A read waits on its linked poll, and removing the poll
+    * fails the read with ECANCELED; if the read has already started, it
+    * is cancelled itself.
+    */
+    for (const auto &[waiter, opcode] : ringWaits) {
+      auto target = reinterpret_cast<uintptr_t>(waiter);
+      auto *sqe = ringSqe();
+      switch (opcode) {
+        case IORING_OP_TIMEOUT:
+          sqe->opcode = IORING_OP_TIMEOUT_REMOVE;
+          break;
+        case IORING_OP_READ:
+          sqe->opcode = IORING_OP_POLL_REMOVE;
+          sqe->fd = -1;
+          sqe->addr = target | LINKED_POLL;
+          sqe = ringSqe();
+          sqe->opcode = IORING_OP_ASYNC_CANCEL;
+          break;
+        default:
+          sqe->opcode = IORING_OP_POLL_REMOVE;
+          break;
+      }
+      sqe->fd = -1;
+      sqe->addr = target;
+    }
+
+    while (!ringWaits.empty()) {
+      auto ret = ring->enter(1);
+      if (ret < 0 && ret != -EINTR && ret != -EAGAIN && ret != -EBUSY) {
+        error("error cancelling io_uring waits: %s\n", strerror(-ret));
+        break;
+      }
+      ring->reap([this](const struct io_uring_cqe &cqe) { ringCompleted(cqe); });
+    }
+    ready.clear();
+  }
+
+  void AsyncEvent::set() {
+    signalled = true;
+    if (waiter) {
+      reactor.post(waiter);
+      waiter = nullptr;
+    }
+  }
+
+}
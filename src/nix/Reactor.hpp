@@ -0,0 +1,180 @@
+#pragma once
+
+#include <coroutine>
+#include <cstdint>
+#include <ctime>
+#include <deque>
+#include <linux/time_types.h>
+#include <map>
+#include <memory>
+#include <sys/types.h>
+#include <utility>
+#include <vector>
+
+#include "IoUring.hpp"
+
+namespace glplay::nix {
+
+  /*
+  * A single-threaded event loop for coroutines: they co_await an fd becoming
+  * readable (a sync_file fence signalling), a read from an fd (the DRM fd)
+  * or a deadline on CLOCK_MONOTONIC, and are resumed from runOnce() once it
+  * arrives.
+  *
+  * By default each runOnce() is a ppoll. With io_uring, every wait queued
+  * since the last iteration is submitted and slept on in one io_uring_enter,
+  * and reads complete inside the ring, so the data is there on wakeup.
+  */
+  class Reactor {
+    public:
+      /* What a suspended coroutine waits on; lives in its frame. */
+      struct Waiter {
+        std::coroutine_handle<> handle;
+        int32_t result = 0;
+        struct __kernel_timespec timeout = {};
+      };
+
+      class ReadableAwaiter {
+        public:
+          ReadableAwaiter(Reactor &reactor, int fd): reactor(reactor), fd(fd) {}
+          [[nodiscard]] auto await_ready() const noexcept -> bool { return false; }
+          void await_suspend(std::coroutine_handle<> handle) {
+            waiter.handle = handle;
+            reactor.watchReadable(fd, &waiter);
+          }
+          void await_resume() const noexcept {}
+
+        private:
+          Reactor &reactor;
+          int fd;
+          Waiter waiter;
+      };
+
+      /* Resumes with the number of bytes read, or -errno. */
+      class ReadAwaiter {
+        public:
+          ReadAwaiter(Reactor &reactor, int fd, void *buffer, size_t size):
+            reactor(reactor), fd(fd), buffer(buffer), size(size) {}
+          [[nodiscard]] auto await_ready() const noexcept -> bool { return false; }
+          void await_suspend(std::coroutine_handle<> handle) {
+            waiter.handle = handle;
+            reactor.watchRead(fd, buffer, size, &waiter);
+          }
+          auto await_resume() -> ssize_t;
+
+        private:
+          Reactor &reactor;
+          int fd;
+          void *buffer;
+          size_t size;
+          Waiter waiter;
+      };
+
+      class TimerAwaiter {
+        public:
+          TimerAwaiter(Reactor &reactor, int64_t deadlineNsec): reactor(reactor), deadlineNsec(deadlineNsec) {}
+          [[nodiscard]] auto await_ready() const noexcept -> bool { return deadlineNsec <= Reactor::now(); }
+          void await_suspend(std::coroutine_handle<> handle) {
+            waiter.handle = handle;
+            reactor.watchDeadline(deadlineNsec, &waiter);
+          }
+          void await_resume() const noexcept {}
+
+        private:
+          Reactor &reactor;
+          int64_t deadlineNsec;
+          Waiter waiter;
+      };
+
+      /*
+      * Uses io_uring if asked to and the kernel lets us, and ppoll
+      * otherwise.
+      */
+      explicit Reactor(bool useIoUring = false);
+      Reactor(const Reactor& other) = delete;
+      auto operator=(const Reactor& other) -> Reactor& = delete;
+
+      [[nodiscard]] auto usingIoUring() const -> bool { return ring != nullptr; }
+
+      /* Suspends until fd polls readable. Each await watches it once. */
+      auto readable(int fd) -> ReadableAwaiter { return {*this, fd}; }
+      /* Suspends until fd is readable, and reads from it. */
+      auto read(int fd, void *buffer, size_t size) -> ReadAwaiter { return {*this, fd, buffer, size}; }
+      /* Suspends until the given CLOCK_MONOTONIC time. */
+      auto until(const struct timespec &deadline) -> TimerAwaiter;
+      /* Resumes the coroutine from runOnce(), rather than from within the caller. */
+      void post(std::coroutine_handle<> handle) { ready.push_back(handle); }
+
+      /*
+      * Sleeps until a wait completes, then resumes every coroutine that is
+      * ready. Returns false, without sleeping, if there is nothing left to
+      * wait for.
+      */
+      auto runOnce() -> bool;
+      /* When runOnce() last woke up. */
+      [[nodiscard]] auto wokenAt() const -> const struct timespec & { return woken_at; }
+      /* How many times runOnce() has slept, in ppoll or io_uring_enter. */
+      [[nodiscard]] auto waits() const -> uint64_t { return waitCount; }
+
+      /*
+      * Cancels every wait still submitted to the ring, and waits for the
+      * kernel to let go of them, without resuming anyone. Call before
+      * destroying the coroutines waiting, as their frames hold the buffers
+      * and timeouts the kernel would otherwise still write to.
+      */
+      void cancelAll();
+
+      static auto now() -> int64_t;
+
+    private:
+      void watchReadable(int fd, Waiter *waiter);
+      void watchRead(int fd, void *buffer, size_t size, Waiter *waiter);
+      void watchDeadline(int64_t deadlineNsec, Waiter *waiter);
+      auto ringSqe() -> struct io_uring_sqe *;
+      void pollOnce();
+      void ringOnce();
+      auto ringCompleted(const struct io_uring_cqe &cqe) -> Waiter *;
+
+      std::unique_ptr<IoUring> ring;
+      /* Waits submitted to the ring and not yet completed, with their opcode. */
+      std::vector<std::pair<Waiter *, uint8_t>> ringWaits;
+
+      std::vector<std::pair<int, Waiter *>> readers;
+      std::multimap<int64_t, Waiter *> timers;
+      std::deque<std::coroutine_handle<>> ready;
+      struct timespec woken_at = {};
+      uint64_t waitCount = 0;
+  };
+
+  /*
+  * Wakes one waiting coroutine through a Reactor. Setting it with nobody
+  * waiting leaves it set, so the next co_await returns straight away; each
+  * wakeup resets it.
+  */
+  class AsyncEvent {
+    public:
+      class Awaiter {
+        public:
+          explicit Awaiter(AsyncEvent &event): event(event) {}
+          [[nodiscard]] auto await_ready() const noexcept -> bool { return event.signalled; }
+          void await_suspend(std::coroutine_handle<> handle) noexcept { event.waiter = handle; }
+          void await_resume() const noexcept { event.signalled = false; }
+
+        private:
+          AsyncEvent &event;
+      };
+
+      explicit AsyncEvent(Reactor &reactor): reactor(reactor) {}
+      AsyncEvent(const AsyncEvent& other) = delete;
+      auto operator=(const AsyncEvent& other) -> AsyncEvent& = delete;
+
+      void set();
+      auto operator co_await() -> Awaiter { return Awaiter(*this); }
+
+    private:
+      Reactor &reactor;
+      bool signalled = false;
+      std::coroutine_handle<> waiter;
+  };
+
+}
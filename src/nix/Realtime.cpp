@@ -0,0 +1,129 @@
+#include "Realtime.hpp"
+#include "log.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace glplay::nix {
+
+  /* How much stack to touch up front; well beyond anything we use. */
+  static const size_t PREFAULT_STACK_SIZE = 512 * 1024;
+
+  auto realtimeConfig() -> const RealtimeConfig & {
+    static const RealtimeConfig config = [] {
+      RealtimeConfig config;
+
+      const char *env = getenv("GLPLAY_RT_PRIORITY");
+      if (env != nullptr) {
+        config.priority = std::clamp(atoi(env), 0, sched_get_priority_max(SCHED_FIFO));
+      }
+
+      env = getenv("GLPLAY_RT_CPUS");
+      if (env != nullptr) {
+        std::istringstream cpus(env);
+        std::string cpu;
+        while (std::getline(cpus, cpu, ',')) {
+          config.cpus.push_back(std::stoi(cpu));
+        }
+      }
+      return config;
+    }();
+    return config;
+  }
+
+  void enterRealtime(const char *who, int priorityOffset) {
+    const auto &config = realtimeConfig();
+    struct sched_param param{};
+
+    if (!config.enabled()) {
+      return;
+    }
+
+    param.sched_priority = std::max(config.priority - priorityOffset, sched_get_priority_min(SCHED_FIFO));
+    int ret = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+    if (ret != 0) {
+      error("%s: could not switch to SCHED_FIFO: %s\n", who, strerror(ret));
+    } else {
+      debug("%s: running SCHED_FIFO at priority %d\n", who, param.sched_priority);
+    }
+
+    if (config.cpus.empty()) {
+      return;
+    }
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : config.cpus) {
+      CPU_SET(cpu, &set);
+    }
+    ret = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (ret != 0) {
+      error("%s: could not set CPU affinity: %s\n", who, strerror(ret));
+    }
+  }
+
+  void lockMemory() {
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+      error("could not lock memory: %s\n", strerror(errno));
+      return;
+    }
+
+    /*
+    * Locking covers the stack pages already mapped; touch the rest now
+    * rather than faulting them in the middle of a repaint.
+    */
+    volatile char stack[PREFAULT_STACK_SIZE];
+    for (size_t idx = 0; idx < sizeof(stack); idx += sysconf(_SC_PAGESIZE)) {
+      stack[idx] = 0;
+    }
+  }
+
+  CpuDmaLatency::CpuDmaLatency(int32_t maxLatencyUsec): fd(open("/dev/cpu_dma_latency", O_WRONLY | O_CLOEXEC)) {
+    if (fd == -1) {
+      throw std::runtime_error(std::string("Error opening /dev/cpu_dma_latency: ") + strerror(errno));
+    }
+    /* The request stays in force until the file is closed. */
+    if (write(fd, &maxLatencyUsec, sizeof(maxLatencyUsec)) != sizeof(maxLatencyUsec)) {
+      close(fd);
+      throw std::runtime_error(std::string("Error writing /dev/cpu_dma_latency: ") + strerror(errno));
+    }
+  }
+
+  CpuDmaLatency::~CpuDmaLatency() {
+    if (fd != -1) {
+      close(fd);
+    }
+  }
+
+  // Move constructor
+  // Transfer ownership
+  CpuDmaLatency::CpuDmaLatency(CpuDmaLatency&& other) noexcept : fd(other.fd) {
+    other.fd = -1;
+  }
+
+  // Move assignment
+  // Transfer ownership
+  auto CpuDmaLatency::operator=(CpuDmaLatency&& other) noexcept -> CpuDmaLatency& {
+    if (&other == this) {
+      return *this;
+    }
+    if (fd >= 0) {
+      close(fd);
+    }
+    fd = other.fd;
+    other.fd = -1;
+    return *this;
+  }
+
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+namespace glplay::nix {
+
+  /*
+  * Real-time execution settings: GLPLAY_RT_PRIORITY is the SCHED_FIFO
+  * priority (1-99) for our latency-critical threads, and leaving it unset
+  * keeps everything on the normal scheduler; GLPLAY_RT_CPUS is an optional
+  * comma-separated list of CPUs to pin those threads to.
+  */
+  struct RealtimeConfig {
+    int priority = 0;
+    std::vector<int> cpus;
+
+    [[nodiscard]] auto enabled() const -> bool { return priority > 0; }
+  };
+
+  /* The process-wide settings, read from the environment on first use. */
+  auto realtimeConfig() -> const RealtimeConfig &;
+
+  /*
+  * Moves the calling thread to SCHED_FIFO at the configured priority less
+  * priorityOffset, and pins it to the configured CPUs. Does nothing unless
+  * real-time mode is enabled; failures (usually for lack of CAP_SYS_NICE)
+  * are logged and otherwise ignored.
+  */
+  void enterRealtime(const char *who, int priorityOffset = 0);
+
+  /*
+  * Locks all current and future mappings into memory and pre-faults some
+  * stack, so the repaint loop never stalls on a page fault.
+  */
+  void lockMemory();
+
+  /*
+  * A PM QoS request on /dev/cpu_dma_latency, held for as long as this
+  * object lives. It keeps CPUs out of idle states which take longer than
+  * the given time to leave, whose exit latency would otherwise show up as
+  * jitter in our wakeups.
+  */
+  class CpuDmaLatency {
+    public:
+      explicit CpuDmaLatency(int32_t maxLatencyUsec = 0);
+      CpuDmaLatency(const CpuDmaLatency& other) = delete;
+      CpuDmaLatency(CpuDmaLatency&& other) noexcept; //Move constructor
+      auto operator=(const CpuDmaLatency& other) -> CpuDmaLatency& = delete;
+      auto operator=(CpuDmaLatency&& other) noexcept -> CpuDmaLatency&; //Move assignment
+      ~CpuDmaLatency();
+
+    private:
+      int fd = -1;
+  };
+
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <coroutine>
+#include <exception>
+
+namespace glplay::nix {
+
+  /*
+  * A coroutine which runs until it finishes or is destroyed, driven by
+  * whatever it co_awaits; usually a Reactor. It does not start until
+  * start() is called, and an exception escaping it is kept for rethrow().
+  */
+  class Task {
+    public:
+      struct promise_type {
+        std::exception_ptr exception;
+
+        auto get_return_object() -> Task {
+          return Task(std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+        auto initial_suspend() noexcept -> std::suspend_always { return {}; }
+        auto final_suspend() noexcept -> std::suspend_always { return {}; }
+        void return_void() {}
+        void unhandled_exception() { exception = std::current_exception(); }
+      };
+
+      Task(const Task& other) = delete;
+      Task(Task&& other) noexcept : handle(other.handle) { //Move constructor
+        other.handle = nullptr;
+      }
+      auto operator=(const Task& other) -> Task& = delete;
+      auto operator=(Task&& other) noexcept -> Task& { //Move assignment
+        if (&other != this) {
+          if (handle) {
+            handle.destroy();
+          }
+          handle = other.handle;
+          other.handle = nullptr;
+        }
+        return *this;
+      }
+      ~Task() {
+        if (handle) {
+          handle.destroy();
+        }
+      }
+
+      /* Runs the coroutine up to its first suspension point. */
+      void start() { handle.resume(); }
+      [[nodiscard]] auto done() const -> bool { return !handle || handle.done(); }
+      void rethrow() const {
+        if (handle && handle.promise().exception) {
+          std::rethrow_exception(handle.promise().exception);
+        }
+      }
+
+    private:
+      explicit Task(std::coroutine_handle<promise_type> handle): handle(handle) {}
+
+      std::coroutine_handle<promise_type> handle;
+  };
+
+}
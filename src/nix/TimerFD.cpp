@@ -0,0 +1,86 @@
+#include "TimerFD.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <string>
+
+namespace glplay::nix {
+
+  TimerFD::TimerFD(clockid_t clock): fd(timerfd_create(clock, TFD_NONBLOCK | TFD_CLOEXEC)) {
+    if (fd == -1) {
+      throw std::runtime_error(std::string("Error creating timerfd: ") + strerror(errno));
+    }
+  }
+
+  TimerFD::~TimerFD() {
+    if (fd != -1) {
+      close(fd);
+    }
+  }
+
+  // Move constructor
+  // Transfer ownership
+  TimerFD::TimerFD(TimerFD&& other) noexcept : fd(other.fd), isArmed(other.isArmed) {
+    other.fd = -1;
+    other.isArmed = false;
+  }
+
+  // Move assignment
+  // Transfer ownership
+  auto TimerFD::operator=(TimerFD&& other) noexcept -> TimerFD& {
+    if (&other == this) {
+      return *this;
+    }
+    if (fd >= 0) {
+      close(fd);
+    }
+    fd = other.fd;
+    isArmed = other.isArmed;
+    other.fd = -1;
+    other.isArmed = false;
+    return *this;
+  }
+
+  void TimerFD::armAt(const struct timespec &deadline) {
+    struct itimerspec spec{};
+    spec.it_value = deadline;
+
+    /*
+    * An all-zero it_value disarms the timer, so nudge a zero deadline
+    * to the first representable instant instead; it has already passed,
+    * so the timer fires immediately.
+    */
+    if (spec.it_value.tv_sec == 0 && spec.it_value.tv_nsec == 0) {
+      spec.it_value.tv_nsec = 1;
+    }
+
+    if (timerfd_settime(fd, TFD_TIMER_ABSTIME, &spec, nullptr) != 0) {
+      throw std::runtime_error(std::string("Error arming timerfd: ") + strerror(errno));
+    }
+    isArmed = true;
+  }
+
+  void TimerFD::disarm() {
+    struct itimerspec spec{};
+
+    if (!isArmed) {
+      return;
+    }
+    if (timerfd_settime(fd, 0, &spec, nullptr) != 0) {
+      throw std::runtime_error(std::string("Error disarming timerfd: ") + strerror(errno));
+    }
+    isArmed = false;
+  }
+
+  auto TimerFD::consume() -> uint64_t {
+    uint64_t expirations = 0;
+
+    if (read(fd, &expirations, sizeof(expirations)) != sizeof(expirations)) {
+      /* EAGAIN: the timer was rearmed or disarmed after poll woke us. */
+      return 0;
+    }
+    isArmed = false;
+    return expirations;
+  }
+
+}
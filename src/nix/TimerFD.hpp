@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstdint>
+#include <ctime>
+#include <stdexcept>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+namespace glplay::nix {
+
+  /*
+  * A timerfd armed with absolute CLOCK_MONOTONIC deadlines, so it can be
+  * polled alongside the KMS FD: both the DRM completion timestamps and
+  * the deadlines we derive from them live on the same clock.
+  */
+  class TimerFD {
+    public:
+      explicit TimerFD(clockid_t clock = CLOCK_MONOTONIC);
+      TimerFD(const TimerFD& other) = delete;
+      TimerFD(TimerFD&& other) noexcept; //Move constructor
+      auto operator=(const TimerFD& other) -> TimerFD& = delete;
+      auto operator=(TimerFD&& other) noexcept -> TimerFD&; //Move assignment
+      ~TimerFD();
+
+      [[nodiscard]] auto fileDescriptor() const -> int { return fd; }
+      [[nodiscard]] auto armed() const -> bool { return isArmed; }
+      void armAt(const struct timespec &deadline);
+      void disarm();
+      /* Drains the expiration counter; returns the number of expirations. */
+      auto consume() -> uint64_t;
+
+    private:
+      int fd = -1;
+      bool isArmed = false;
+  };
+
+}
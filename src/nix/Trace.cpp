@@ -0,0 +1,224 @@
+#include "Trace.hpp"
+#include "log.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <thread>
+#include <unistd.h>
+
+namespace glplay::nix {
+
+  bool traceEnabled = false;
+
+  namespace {
+
+    /* Events each thread keeps unless GLPLAY_TRACE_EVENTS says otherwise. */
+    const size_t DEFAULT_EVENTS = 65536;
+
+    std::string tracePath;
+    size_t traceCapacity = DEFAULT_EVENTS;
+
+    /* Every ring ever created; they outlive their threads, for the writer. */
+    std::mutex buffersMutex;
+    std::vector<std::unique_ptr<TraceBuffer>> buffers;
+
+    auto createBuffer(std::string name) -> TraceBuffer * {
+      std::lock_guard<std::mutex> guard(buffersMutex);
+      buffers.push_back(std::make_unique<TraceBuffer>(traceCapacity, std::move(name)));
+      traceBuffer = buffers.back().get();
+      return traceBuffer;
+    }
+
+    auto chromePhase(TracePhase phase) -> char {
+      switch (phase) {
+        case TracePhase::Begin: return 'B';
+        case TracePhase::End: return 'E';
+        case TracePhase::AsyncBegin: return 'b';
+        case TracePhase::AsyncEnd: return 'e';
+        case TracePhase::Counter: return 'C';
+        case TracePhase::Instant: return 'i';
+      }
+      return 'i';
+    }
+
+  }
+
+  TraceBuffer::TraceBuffer(size_t capacity, std::string threadName):
+    threadName(std::move(threadName)), threadId(static_cast<int>(syscall(SYS_gettid))),
+    events(capacity), mask(capacity - 1) {
+  }
+
+  auto TraceBuffer::snapshot() const -> std::vector<TraceEvent> {
+    uint64_t capacity = events.size();
+    auto end = head.load(std::memory_order_acquire);
+    auto start = end > capacity ? end - capacity : 0;
+
+    std::vector<TraceEvent> copy;
+    copy.reserve(end - start);
+    for (auto idx = start; idx < end; idx++) {
+      copy.push_back(events[idx & mask]);
+    }
+
+    /*
+    * The thread may have carried on recording while we copied, over the
+    * oldest events; the one it is writing now is torn too. As in a seqlock
+    * reader, the fence keeps our copy from being read after head is.
+    */
+    std::atomic_thread_fence(std::memory_order_acquire);
+    auto after = head.load(std::memory_order_relaxed) + 1;
+    auto intact = after > capacity ? after - capacity : 0;
+    if (intact > start) {
+      copy.erase(copy.begin(), copy.begin() + static_cast<ptrdiff_t>(std::min(intact - start, copy.size())));
+    }
+    return copy;
+  }
+
+  void traceSetup() {
+    const char *env = getenv("GLPLAY_TRACE");
+    if (env == nullptr || *env == '\0') {
+      return;
+    }
+    tracePath = env;
+
+    env = getenv("GLPLAY_TRACE_EVENTS");
+    if (env != nullptr) {
+      traceCapacity = std::max(1UL, strtoul(env, nullptr, 10));
+    }
+    size_t capacity = 1;
+    while (capacity < traceCapacity) {
+      capacity <<= 1;
+    }
+    traceCapacity = capacity;
+    traceEnabled = true;
+    debug("tracing %zu events per thread to %s\n", traceCapacity, tracePath.c_str());
+  }
+
+  void traceNameThread(const char *name) {
+    if (!traceEnabled) {
+      return;
+    }
+    if (traceBuffer != nullptr) {
+      std::lock_guard<std::mutex> guard(buffersMutex);
+      traceBuffer->threadName = name;
+      return;
+    }
+    createBuffer(name);
+  }
+
+  auto traceThreadBuffer() -> TraceBuffer * {
+    return createBuffer("thread " + std::to_string(syscall(SYS_gettid)));
+  }
+
+  namespace {
+
+    struct ThreadSnapshot {
+      std::string name;
+      int threadId;
+      std::vector<TraceEvent> events;
+    };
+
+    /* The background writer, and whether it is still busy. */
+    std::thread writer;
+    std::atomic<bool> writing = false;
+
+    auto snapshotAll() -> std::vector<ThreadSnapshot> {
+      std::lock_guard<std::mutex> guard(buffersMutex);
+      std::vector<ThreadSnapshot> snapshots;
+      snapshots.reserve(buffers.size());
+      for (auto &buffer : buffers) {
+        snapshots.push_back({ buffer->threadName, buffer->threadId, buffer->snapshot() });
+      }
+      return snapshots;
+    }
+
+    auto writeJson(const std::vector<ThreadSnapshot> &snapshots) -> bool {
+      auto *file = fopen(tracePath.c_str(), "w");
+      if (file == nullptr) {
+        error("couldn't write trace to %s: %s\n", tracePath.c_str(), strerror(errno));
+        return false;
+      }
+
+      auto pid = getpid();
+      size_t written = 0;
+      fprintf(file, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+      for (const auto &snapshot : snapshots) {
+        fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,"
+                "\"args\":{\"name\":\"%s\"}}",
+                written++ > 0 ? ",\n" : "", pid, snapshot.threadId, snapshot.name.c_str());
+
+        for (const auto &event : snapshot.events) {
+          auto phase = chromePhase(event.phase);
+          /* Chrome's timestamps are in microseconds. */
+          fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%" PRIi64 ".%03" PRIi64 ",\"pid\":%d,\"tid\":%d",
+                  event.name, phase, event.nsec / 1000, event.nsec % 1000, pid, snapshot.threadId);
+          switch (event.phase) {
+            case TracePhase::Instant:
+              fprintf(file, ",\"s\":\"t\",\"args\":{\"value\":%" PRIi64 "}}", event.value);
+              break;
+            case TracePhase::AsyncBegin:
+            case TracePhase::AsyncEnd:
+              fprintf(file, ",\"cat\":\"glplay\",\"id\":%" PRIi64 "}", event.value);
+              break;
+            case TracePhase::Begin:
+            case TracePhase::Counter:
+              fprintf(file, ",\"args\":{\"value\":%" PRIi64 "}}", event.value);
+              break;
+            case TracePhase::End:
+              fprintf(file, "}");
+              break;
+          }
+        }
+      }
+      fprintf(file, "\n]}\n");
+      fclose(file);
+      debug("trace written to %s\n", tracePath.c_str());
+      return true;
+    }
+
+  }
+
+  auto traceWrite() -> bool {
+    if (!traceEnabled) {
+      return false;
+    }
+    if (writer.joinable()) {
+      writer.join();
+    }
+    return writeJson(snapshotAll());
+  }
+
+  void traceWriteInBackground() {
+    if (!traceEnabled) {
+      return;
+    }
+    if (writing.exchange(true)) {
+      debug("trace still being written; not writing another\n");
+      return;
+    }
+    if (writer.joinable()) {
+      writer.join();
+    }
+
+    /*
+    * Copying the rings is quick; formatting them is not, so that happens
+    * on a thread of its own, at idle priority, rather than in the middle
+    * of the timing being traced.
+    */
+    writer = std::thread([snapshots = snapshotAll()]() {
+      struct sched_param param = {};
+      pthread_setschedparam(pthread_self(), SCHED_IDLE, &param);
+      writeJson(snapshots);
+      writing = false;
+    });
+  }
+
+}
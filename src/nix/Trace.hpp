@@ -0,0 +1,132 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <ctime>
+#include <string>
+#include <vector>
+
+namespace glplay::nix {
+
+  /*
+  * A low-overhead trace of what each thread is doing, for when debug()'s
+  * synchronous fprintf would change the very timing being looked at.
+  *
+  * Each thread records into a ring of fixed-size binary events of its own,
+  * with no locks and no formatting: a timestamp, a pointer to a static
+  * name, and a value. Recording one costs a clock_gettime and a few
+  * stores. Nothing is written out until traceWrite(), which turns whatever
+  * the rings hold into the Chrome JSON trace format, for chrome://tracing
+  * or ui.perfetto.dev.
+  *
+  * GLPLAY_TRACE names the file to write, and turns tracing on;
+  * GLPLAY_TRACE_EVENTS is how many events each thread keeps, rounded up to
+  * a power of two.
+  */
+  enum class TracePhase : uint8_t {
+    /* A span on this thread, from Begin to the next End. */
+    Begin,
+    End,
+    /* A span which may overlap others on the thread, matched by value. */
+    AsyncBegin,
+    AsyncEnd,
+    Counter,
+    Instant,
+  };
+
+  struct TraceEvent {
+    int64_t nsec;
+    /* A string literal, or anything else which lives until we exit. */
+    const char *name;
+    int64_t value;
+    TracePhase phase;
+  };
+
+  /* One thread's ring; only that thread records into it. */
+  class TraceBuffer {
+    public:
+      TraceBuffer(size_t capacity, std::string threadName);
+
+      void record(TracePhase phase, const char *name, int64_t value) {
+        struct timespec now{};
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        auto idx = head.load(std::memory_order_relaxed);
+        events[idx & mask] = { (now.tv_sec * 1000000000LL) + now.tv_nsec, name, value, phase };
+        head.store(idx + 1, std::memory_order_release);
+      }
+
+      /*
+      * The events still in the ring, oldest first. May be called from
+      * another thread while this one records; events it might have
+      * overwritten during the copy are left out.
+      */
+      [[nodiscard]] auto snapshot() const -> std::vector<TraceEvent>;
+
+      std::string threadName;
+      int threadId;
+
+    private:
+      std::vector<TraceEvent> events;
+      size_t mask;
+      std::atomic<uint64_t> head = 0;
+  };
+
+  /* Set by traceSetup, before any other thread starts. */
+  extern bool traceEnabled;
+
+  /* Reads the settings from the environment. */
+  void traceSetup();
+
+  /* Names the calling thread in the trace; call before it records anything. */
+  void traceNameThread(const char *name);
+
+  /* The calling thread's ring, created on first use. */
+  auto traceThreadBuffer() -> TraceBuffer *;
+  inline thread_local TraceBuffer *traceBuffer = nullptr;
+
+  inline void traceEvent(TracePhase phase, const char *name, int64_t value = 0) {
+    if (!traceEnabled) {
+      return;
+    }
+    auto *buffer = traceBuffer != nullptr ? traceBuffer : traceThreadBuffer();
+    buffer->record(phase, name, value);
+  }
+
+  inline void traceCounter(const char *name, int64_t value) {
+    traceEvent(TracePhase::Counter, name, value);
+  }
+
+  inline void traceInstant(const char *name, int64_t value = 0) {
+    traceEvent(TracePhase::Instant, name, value);
+  }
+
+  /* Records a span for as long as it is in scope; value is shown as an argument. */
+  class TraceSpan {
+    public:
+      explicit TraceSpan(const char *name, int64_t value = 0): name(name) {
+        traceEvent(TracePhase::Begin, name, value);
+      }
+      TraceSpan(const TraceSpan &other) = delete;
+      auto operator=(const TraceSpan &other) -> TraceSpan & = delete;
+      ~TraceSpan() {
+        traceEvent(TracePhase::End, name);
+      }
+
+    private:
+      const char *name;
+  };
+
+  /*
+  * Writes every thread's events to the GLPLAY_TRACE file, replacing what
+  * was there. Returns false if tracing is off or the file can't be written.
+  */
+  auto traceWrite() -> bool;
+
+  /*
+  * Takes a copy of every thread's events, and writes them out as
+  * traceWrite() does, but on a background thread, so the caller doesn't
+  * stall. Does nothing if the last one is still being written.
+  */
+  void traceWriteInBackground();
+
+}
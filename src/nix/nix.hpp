@@ -2,4 +2,10 @@
 
 #include "FileDescriptor.hpp"
 #include "log.hpp"
-#include "terminal.hpp"
\ No newline at end of file
+#include "terminal.hpp"
+#include "TimerFD.hpp"
+#include "EventFD.hpp"
+#include "Realtime.hpp"
+#include "Trace.hpp"
+#include "Reactor.hpp"
+#include "Task.hpp"
\ No newline at end of file
@@ -0,0 +1,173 @@
+/*
+ * Microbenchmark for reading KMS events: libdrm's drmHandleEvent, finding
+ * each event's display by searching the list of CRTCs, against our
+ * EventReader draining everything in one read and finding the display
+ * through a table indexed by CRTC ID.
+ *
+ * No DRM device is needed: synthetic page-flip events are written into a
+ * pipe, which both read from as they would from the DRM FD.
+ *
+ * Usage: glplay-eventbench [displays] [total events]
+ */
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <unistd.h>
+#include <vector>
+
+#include <xf86drm.h>
+
+#include "../drm/Events.hpp"
+
+namespace {
+
+  /* The displays' CRTCs, and how many events each received. */
+  struct Displays {
+    std::vector<uint32_t> crtcIds;
+    std::vector<int> byCrtc;
+    std::vector<uint64_t> events;
+
+    explicit Displays(unsigned int count) : events(count) {
+      /* CRTC IDs are spread out among the other KMS object IDs. */
+      for (unsigned int idx = 0; idx < count; idx++) {
+        crtcIds.push_back(40 + idx * 17);
+      }
+      byCrtc.assign(crtcIds.back() + 1, -1);
+      for (unsigned int idx = 0; idx < count; idx++) {
+        byCrtc[crtcIds[idx]] = static_cast<int>(idx);
+      }
+    }
+
+    void searched(uint32_t crtcId) {
+      for (size_t idx = 0; idx < crtcIds.size(); idx++) {
+        if (crtcIds[idx] == crtcId) {
+          events[idx]++;
+          return;
+        }
+      }
+    }
+
+    void indexed(uint32_t crtcId) {
+      auto idx = crtcId < byCrtc.size() ? byCrtc[crtcId] : -1;
+      if (idx >= 0) {
+        events[idx]++;
+      }
+    }
+  };
+
+  void libdrmFlipHandler(int fd, unsigned int sequence, unsigned int tvSec, unsigned int tvUsec,
+                         unsigned int crtcId, void *userData) {
+    static_cast<Displays *>(userData)->searched(crtcId);
+  }
+
+  struct ReaderHandler {
+    Displays *displays;
+
+    void flipComplete(uint32_t crtcId, uint32_t sequence, const struct timespec &time, uint64_t userData) {
+      displays->indexed(crtcId);
+    }
+    void vblank(uint32_t crtcId, uint32_t sequence, const struct timespec &time, uint64_t userData) {
+      displays->indexed(crtcId);
+    }
+    void crtcSequence(uint64_t userData, uint64_t sequence, int64_t nsec) {
+      displays->indexed(static_cast<uint32_t>(userData));
+    }
+  };
+
+  /* Queues one wakeup's worth of flip completions, round-robin over the displays. */
+  void writeBatch(int fd, Displays &displays, unsigned int batch, uint32_t &sequence) {
+    std::vector<struct drm_event_vblank> events(batch);
+    for (unsigned int idx = 0; idx < batch; idx++) {
+      auto &event = events[idx];
+      event.base.type = DRM_EVENT_FLIP_COMPLETE;
+      event.base.length = sizeof(event);
+      /* What drmHandleEvent passes on to its handler as user data. */
+      event.user_data = reinterpret_cast<uintptr_t>(&displays);
+      event.tv_sec = sequence / 60;
+      event.tv_usec = (sequence % 60) * 16666;
+      event.sequence = sequence++;
+      event.crtc_id = displays.crtcIds[idx % displays.crtcIds.size()];
+    }
+    auto len = write(fd, events.data(), events.size() * sizeof(events[0]));
+    if (len != static_cast<ssize_t>(events.size() * sizeof(events[0]))) {
+      if (len < 0) {
+        perror("write");
+      } else {
+        fprintf(stderr, "short write to event pipe: %zd bytes\n", len);
+      }
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  template<typename Drain>
+  auto run(const char *name, unsigned int displayCount, unsigned int batch, uint64_t total, Drain drain) -> double {
+    std::array<int, 2> pipeFds{};
+    if (pipe(pipeFds.data()) != 0) {
+      perror("pipe");
+      exit(EXIT_FAILURE);
+    }
+
+    Displays displays(displayCount);
+    uint32_t sequence = 0;
+    std::chrono::nanoseconds elapsed{0};
+    uint64_t seen = 0;
+
+    while (seen < total) {
+      writeBatch(pipeFds[1], displays, batch, sequence);
+      auto start = std::chrono::steady_clock::now();
+      uint64_t batchSeen = 0;
+      uint64_t before = 0;
+      for (auto count : displays.events) {
+        before += count;
+      }
+      while (batchSeen < batch) {
+        drain(pipeFds[0], displays);
+        batchSeen = 0;
+        for (auto count : displays.events) {
+          batchSeen += count;
+        }
+        batchSeen -= before;
+      }
+      elapsed += std::chrono::steady_clock::now() - start;
+      seen += batch;
+    }
+
+    close(pipeFds[0]);
+    close(pipeFds[1]);
+    auto perEvent = static_cast<double>(elapsed.count()) / static_cast<double>(seen);
+    printf("%-10s %3u displays, %4u events/wakeup: %8.1f ns/event\n", name, displayCount, batch, perEvent);
+    return perEvent;
+  }
+
+}
+
+auto main(int argc, char *argv[]) -> int {
+  unsigned int displayCount = argc > 1 ? static_cast<unsigned int>(strtoul(argv[1], nullptr, 10)) : 16;
+  uint64_t total = argc > 2 ? strtoull(argv[2], nullptr, 10) : 1000000;
+  if (displayCount == 0) {
+    fprintf(stderr, "usage: %s [displays] [total events]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  drmEventContext context = {};
+  context.version = 4;
+  context.page_flip_handler2 = libdrmFlipHandler;
+
+  glplay::drm::EventReader reader;
+
+  /* A pipe holds 64KiB by default, so 512 vblank events at a time fit. */
+  for (unsigned int batch : { 1U, 4U, 16U, 64U, 256U, 512U }) {
+    auto libdrm = run("libdrm", displayCount, batch, total, [&context](int fd, Displays &) {
+      drmHandleEvent(fd, &context);
+    });
+    auto batched = run("batched", displayCount, batch, total, [&reader](int fd, Displays &displays) {
+      ReaderHandler handler = { &displays };
+      reader.drain(fd, handler);
+    });
+    printf("%-10s %3u displays, %4u events/wakeup: %8.2fx\n", "speedup", displayCount, batch, libdrm / batched);
+  }
+  return EXIT_SUCCESS;
+}
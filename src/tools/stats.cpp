@@ -0,0 +1,117 @@
+/*
+ * Prints the frame pacing statistics a running glplay publishes in shared
+ * memory. Reading them never blocks glplay or makes it do any work.
+ *
+ * Usage: glplay-stats [-w seconds] [-H] [shm name]
+ *   -w  keep printing every so many seconds
+ *   -H  also print each display's presentation interval histogram
+ */
+#include <algorithm>
+#include <cerrno>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "../kms/SharedStats.hpp"
+
+namespace {
+
+  void printHistogram(const glplay::kms::SharedDisplayStats &stats, uint32_t bucketNsec) {
+    uint64_t most = *std::max_element(std::begin(stats.histogram), std::end(stats.histogram));
+    if (most == 0) {
+      return;
+    }
+    for (size_t idx = 0; idx < glplay::kms::SHARED_STATS_BUCKETS; idx++) {
+      if (stats.histogram[idx] == 0) {
+        continue;
+      }
+      auto width = static_cast<int>(stats.histogram[idx] * 50 / most);
+      printf("    %6.1fms%s %10" PRIu64 " %.*s\n",
+             static_cast<double>(idx * bucketNsec) / 1e6,
+             idx == glplay::kms::SHARED_STATS_BUCKETS - 1 ? "+" : " ",
+             stats.histogram[idx], std::max(width, 1),
+             "##################################################");
+    }
+  }
+
+  void printStats(const glplay::kms::SharedStats &shared, bool histogram) {
+    printf("%-16s %10s %8s %8s %10s %8s %8s %8s\n",
+           "display", "frames", "fps", "refresh", "missed", "early", "late", "gpu ms");
+    auto count = std::min<size_t>(shared.displayCount, glplay::kms::SHARED_STATS_MAX_DISPLAYS);
+    for (size_t idx = 0; idx < count; idx++) {
+      glplay::kms::SharedDisplayStats stats;
+      if (!glplay::kms::shared_stats_read(shared.displays[idx], stats)) {
+        printf("%-16s (busy)\n", "?");
+        continue;
+      }
+      stats.name[sizeof(stats.name) - 1] = '\0';
+      printf("%-16s %10" PRIu64 " %8.2f %8.2f %10" PRIu64 " %8" PRIu64 " %8" PRIu64,
+             stats.name, stats.frames, stats.fps,
+             stats.refreshNsec > 0 ? 1e9 / static_cast<double>(stats.refreshNsec) : 0.0,
+             stats.missedVblanks, stats.early, stats.late);
+      /* The mean, over every frame the GPU was timed on. */
+      if (stats.gpuFrames > 0) {
+        printf(" %8.2f\n", static_cast<double>(stats.gpuTotalNsec) / static_cast<double>(stats.gpuFrames) / 1e6);
+      } else {
+        printf(" %8s\n", "-");
+      }
+      if (histogram) {
+        printHistogram(stats, shared.bucketNsec);
+      }
+    }
+  }
+
+}
+
+auto main(int argc, char *argv[]) -> int {
+  unsigned int watch = 0;
+  bool histogram = false;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "w:H")) != -1) {
+    switch (opt) {
+    case 'w':
+      watch = static_cast<unsigned int>(strtoul(optarg, nullptr, 10));
+      break;
+    case 'H':
+      histogram = true;
+      break;
+    default:
+      fprintf(stderr, "usage: %s [-w seconds] [-H] [shm name]\n", argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+  const char *name = optind < argc ? argv[optind] : "/glplay-stats";
+
+  int fd = shm_open(name, O_RDONLY | O_CLOEXEC, 0);
+  if (fd < 0) {
+    fprintf(stderr, "could not open %s: %s; is glplay running?\n", name, strerror(errno));
+    return EXIT_FAILURE;
+  }
+  auto *mem = mmap(nullptr, sizeof(glplay::kms::SharedStats), PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (mem == MAP_FAILED) {
+    fprintf(stderr, "could not map %s: %s\n", name, strerror(errno));
+    return EXIT_FAILURE;
+  }
+
+  const auto *shared = static_cast<const glplay::kms::SharedStats *>(mem);
+  if (shared->magic != glplay::kms::SHARED_STATS_MAGIC ||
+      shared->version != glplay::kms::SHARED_STATS_VERSION) {
+    fprintf(stderr, "%s does not hold glplay statistics we understand\n", name);
+    return EXIT_FAILURE;
+  }
+
+  printf("glplay pid %d\n", shared->pid);
+  printStats(*shared, histogram);
+  while (watch > 0) {
+    sleep(watch);
+    printf("\n");
+    printStats(*shared, histogram);
+  }
+  return EXIT_SUCCESS;
+}
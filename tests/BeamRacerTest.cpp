@@ -0,0 +1,138 @@
+#include "../src/kms/BeamRacer.hpp"
+
+#include "../src/kms/time.hpp"
+#include "check.hpp"
+
+using glplay::kms::BeamRacer;
+using glplay::kms::timespec_add_nsec;
+using glplay::kms::timespec_to_nsec;
+
+namespace {
+
+  /* 1080p60: 1125 lines a frame, 1080 of them visible. */
+  const int64_t PERIOD_NSEC = 16666666;
+  const unsigned int VDISPLAY = 1080;
+  const unsigned int VTOTAL = 1125;
+  const struct timespec VBLANK = { 1000, 0 };
+
+  auto mode1080p() -> drmModeModeInfo {
+    drmModeModeInfo mode{};
+    mode.vdisplay = VDISPLAY;
+    mode.vtotal = VTOTAL;
+    return mode;
+  }
+
+  auto after(const struct timespec &base, int64_t nsec) -> struct timespec {
+    struct timespec result{};
+    timespec_add_nsec(&result, &base, nsec);
+    return result;
+  }
+
+  /* When the beam reaches the given line, from the start of its frame. */
+  auto lineNsec(unsigned int line) -> int64_t {
+    return static_cast<int64_t>(line * (static_cast<double>(PERIOD_NSEC) / VTOTAL));
+  }
+
+  auto sinceVblank(const struct timespec &when) -> int64_t {
+    return timespec_to_nsec(&when) - timespec_to_nsec(&VBLANK);
+  }
+
+  void testSetup() {
+    BeamRacer racer;
+    CHECK(!racer.enabled());
+    racer.setup(mode1080p(), 4, false);
+    CHECK(racer.enabled());
+    CHECK_EQ(racer.strips(), 4U);
+    racer.disable();
+    CHECK(!racer.enabled());
+
+    /* Never more strips than lines. */
+    auto tiny = mode1080p();
+    tiny.vdisplay = 3;
+    racer.setup(tiny, 8, true);
+    CHECK_EQ(racer.strips(), 3U);
+    CHECK(racer.testMode());
+  }
+
+  /*
+  * Until a strip has been measured, it is assumed to take half a strip's
+  * scanout; a strip the beam reaches sooner than that is passed over.
+  */
+  void testNextStrip() {
+    BeamRacer racer;
+    racer.setup(mode1080p(), 4, false);
+
+    auto now = after(VBLANK, 1000000);
+    auto strip = racer.next(VBLANK, PERIOD_NSEC, now);
+    CHECK_EQ(strip.index, 1U);
+    CHECK_EQ(strip.firstLine, 270U);
+    CHECK_EQ(strip.lines, 270U);
+    CHECK_EQ(sinceVblank(strip.frameStart), 0);
+    CHECK_EQ(sinceVblank(strip.scanout), lineNsec(270));
+    /* Rendering starts a strip's scanout ahead of it. */
+    CHECK_EQ(sinceVblank(strip.renderAt), 0);
+
+    /* Having rendered it, the next one is the strip below. */
+    racer.rendered(strip, now, -1);
+    CHECK(racer.pending.empty());
+    strip = racer.next(VBLANK, PERIOD_NSEC, now);
+    CHECK_EQ(strip.index, 2U);
+    CHECK_EQ(sinceVblank(strip.scanout), lineNsec(540));
+
+    racer.rendered(strip, now, 42);
+    CHECK_EQ(racer.pending.size(), 1U);
+    CHECK_EQ(racer.pending.front().index, 2U);
+    CHECK_EQ(racer.pending.front().fenceFd, 42);
+  }
+
+  /* Late in a frame, the next strip we can make is in the frame after. */
+  void testNextFrame() {
+    BeamRacer racer;
+    racer.setup(mode1080p(), 4, false);
+
+    auto strip = racer.next(VBLANK, PERIOD_NSEC, after(VBLANK, 15000000));
+    CHECK_EQ(strip.index, 1U);
+    CHECK_EQ(sinceVblank(strip.frameStart), PERIOD_NSEC);
+    CHECK_EQ(sinceVblank(strip.scanout), PERIOD_NSEC + lineNsec(270));
+
+    /* Our latest vblank timestamp may be a few frames old. */
+    racer.setup(mode1080p(), 4, false);
+    strip = racer.next(VBLANK, PERIOD_NSEC, after(VBLANK, 3 * PERIOD_NSEC + 1000000));
+    CHECK_EQ(strip.index, 1U);
+    CHECK_EQ(sinceVblank(strip.frameStart), 3 * PERIOD_NSEC);
+  }
+
+  /* The last strip takes the lines left over from an uneven split. */
+  void testUnevenStrips() {
+    BeamRacer racer;
+    racer.setup(mode1080p(), 7, false);
+    auto strip = racer.next(VBLANK, PERIOD_NSEC, after(VBLANK, 12000000));
+    CHECK_EQ(strip.index, 6U);
+    CHECK_EQ(strip.firstLine, 924U);
+    CHECK_EQ(strip.lines, 156U);
+  }
+
+  /* Once strips have been measured, their cost sets how far ahead we render. */
+  void testMeasuredCost() {
+    BeamRacer racer;
+    racer.setup(mode1080p(), 4, false);
+
+    const int64_t cost = 3500000;
+    auto started = after(VBLANK, -10000000);
+    racer.landed({ 0, VBLANK, started, -1 }, timespec_to_nsec(&started) + cost, "test");
+
+    auto strip = racer.next(VBLANK, PERIOD_NSEC, after(VBLANK, 1000000));
+    CHECK_EQ(strip.index, 2U);
+    CHECK_EQ(sinceVblank(strip.renderAt), lineNsec(540) - (cost + cost / 2));
+  }
+
+}
+
+auto main() -> int {
+  testSetup();
+  testNextStrip();
+  testNextFrame();
+  testUnevenStrips();
+  testMeasuredCost();
+  return glplay::test::finish();
+}
@@ -0,0 +1,110 @@
+#include "../src/kms/PacingGovernor.hpp"
+
+#include "check.hpp"
+
+using glplay::kms::PacingGovernor;
+
+namespace {
+
+  const int64_t REFRESH_NSEC = 16666667;
+  const int64_t CHEAP_NSEC = 2000000;
+
+  /* Records the given number of frames which all hit or all missed. */
+  auto run(PacingGovernor &governor, unsigned int frames, bool missed, int64_t budgetNsec) -> unsigned int {
+    unsigned int changes = 0;
+    for (unsigned int idx = 0; idx < frames; idx++) {
+      if (governor.frameCompleted(missed, budgetNsec, REFRESH_NSEC)) {
+        changes++;
+      }
+    }
+    return changes;
+  }
+
+  void testSlowsDownOnRepeatedMisses() {
+    PacingGovernor governor;
+    CHECK_EQ(governor.divisor(), 1U);
+    CHECK(!governor.frameCompleted(true, CHEAP_NSEC, REFRESH_NSEC));
+    run(governor, 5, false, CHEAP_NSEC);
+    CHECK(!governor.frameCompleted(true, CHEAP_NSEC, REFRESH_NSEC));
+    CHECK(governor.frameCompleted(true, CHEAP_NSEC, REFRESH_NSEC));
+    CHECK_EQ(governor.divisor(), 2U);
+
+    /* The history starts over at the new rate. */
+    CHECK(!governor.frameCompleted(true, CHEAP_NSEC, REFRESH_NSEC));
+    CHECK(!governor.frameCompleted(true, CHEAP_NSEC, REFRESH_NSEC));
+    CHECK(governor.frameCompleted(true, CHEAP_NSEC, REFRESH_NSEC));
+    CHECK_EQ(governor.divisor(), 3U);
+
+    /* Never below the slowest rate. */
+    CHECK_EQ(run(governor, 10, true, CHEAP_NSEC), 0U);
+    CHECK_EQ(governor.divisor(), 3U);
+  }
+
+  /* Misses further apart than the window don't add up. */
+  void testSparseMissesAreTolerated() {
+    PacingGovernor governor;
+    for (int round = 0; round < 10; round++) {
+      CHECK(!governor.frameCompleted(true, CHEAP_NSEC, REFRESH_NSEC));
+      CHECK_EQ(run(governor, PacingGovernor::MISS_WINDOW, false, CHEAP_NSEC), 0U);
+    }
+    CHECK_EQ(governor.divisor(), 1U);
+  }
+
+  void testRecovery() {
+    PacingGovernor governor;
+    CHECK(governor.slowDown());
+    CHECK_EQ(governor.divisor(), 2U);
+
+    CHECK_EQ(run(governor, PacingGovernor::RECOVERY_FRAMES - 1, false, CHEAP_NSEC), 0U);
+    CHECK(governor.frameCompleted(false, CHEAP_NSEC, REFRESH_NSEC));
+    CHECK_EQ(governor.divisor(), 1U);
+  }
+
+  /* A repaint cost which wouldn't fit the faster rate keeps us where we are. */
+  void testNoRecoveryWhenTooSlow() {
+    PacingGovernor governor;
+    CHECK(governor.slowDown());
+    auto tooSlow = static_cast<int64_t>(PacingGovernor::RECOVERY_HEADROOM * REFRESH_NSEC) + 1;
+    CHECK_EQ(run(governor, PacingGovernor::RECOVERY_FRAMES * 2, false, tooSlow), 0U);
+    CHECK_EQ(governor.divisor(), 2U);
+
+    /* A miss resets the streak. */
+    CHECK(!governor.frameCompleted(true, CHEAP_NSEC, REFRESH_NSEC));
+    run(governor, PacingGovernor::RECOVERY_FRAMES - 1, false, CHEAP_NSEC);
+    CHECK(!governor.frameCompleted(true, CHEAP_NSEC, REFRESH_NSEC));
+    CHECK(!governor.frameCompleted(false, CHEAP_NSEC, REFRESH_NSEC));
+    CHECK_EQ(governor.divisor(), 2U);
+  }
+
+  void testMaxDivisor() {
+    PacingGovernor governor;
+    CHECK(governor.slowDown());
+    CHECK(governor.slowDown());
+    CHECK(!governor.slowDown());
+    CHECK_EQ(governor.divisor(), 3U);
+
+    governor.setMaxDivisor(2);
+    CHECK_EQ(governor.divisor(), 2U);
+    CHECK(!governor.slowDown());
+
+    governor.setMaxDivisor(0);
+    CHECK_EQ(governor.divisor(), 1U);
+    CHECK_EQ(run(governor, 10, true, CHEAP_NSEC), 0U);
+  }
+
+  void testHoldGuard() {
+    CHECK_EQ(PacingGovernor::holdGuardNsec(REFRESH_NSEC), 1000000);
+    CHECK_EQ(PacingGovernor::holdGuardNsec(2000000), 500000);
+  }
+
+}
+
+auto main() -> int {
+  testSlowsDownOnRepeatedMisses();
+  testSparseMissesAreTolerated();
+  testRecovery();
+  testNoRecoveryWhenTooSlow();
+  testMaxDivisor();
+  testHoldGuard();
+  return glplay::test::finish();
+}
@@ -0,0 +1,50 @@
+#include "../src/kms/RepaintBudget.hpp"
+
+#include "check.hpp"
+
+using glplay::kms::DEFAULT_REPAINT_BUDGET_NSEC;
+using glplay::kms::RepaintBudget;
+
+namespace {
+
+  void testDefault() {
+    const RepaintBudget budget;
+    CHECK_EQ(budget.sampleCount(), 0U);
+    CHECK_EQ(budget.estimate(), DEFAULT_REPAINT_BUDGET_NSEC);
+    CHECK_EQ(budget.last(), 0);
+  }
+
+  /* The estimate is the worst recent repaint, not the average. */
+  void testWorstSample() {
+    RepaintBudget budget;
+    budget.addSample(2000000);
+    budget.addSample(7000000);
+    budget.addSample(3000000);
+    CHECK_EQ(budget.sampleCount(), 3U);
+    CHECK_EQ(budget.estimate(), 7000000);
+    CHECK_EQ(budget.last(), 3000000);
+  }
+
+  /* A slow repaint stops counting once WINDOW newer ones have come in. */
+  void testWindow() {
+    RepaintBudget budget;
+    budget.addSample(9000000);
+    for (size_t idx = 0; idx < RepaintBudget::WINDOW - 1; idx++) {
+      budget.addSample(1000000);
+    }
+    CHECK_EQ(budget.estimate(), 9000000);
+
+    budget.addSample(1500000);
+    CHECK_EQ(budget.sampleCount(), RepaintBudget::WINDOW);
+    CHECK_EQ(budget.estimate(), 1500000);
+    CHECK_EQ(budget.last(), 1500000);
+  }
+
+}
+
+auto main() -> int {
+  testDefault();
+  testWorstSample();
+  testWindow();
+  return glplay::test::finish();
+}
@@ -0,0 +1,112 @@
+#include "../src/kms/ResolutionGovernor.hpp"
+
+#include "check.hpp"
+
+using glplay::kms::ResolutionGovernor;
+
+namespace {
+
+  const int64_t INTERVAL_NSEC = 16666667;
+  /* TARGET_LOAD of the interval. */
+  const int64_t TARGET_NSEC = 13333333;
+
+  auto run(ResolutionGovernor &governor, unsigned int frames, int64_t renderNsec) -> unsigned int {
+    unsigned int changes = 0;
+    for (unsigned int idx = 0; idx < frames; idx++) {
+      if (governor.frameCompleted(renderNsec, INTERVAL_NSEC)) {
+        changes++;
+      }
+    }
+    return changes;
+  }
+
+  void testDisabledByDefault() {
+    ResolutionGovernor governor;
+    CHECK(!governor.enabled());
+    CHECK_EQ(run(governor, 10, 4 * INTERVAL_NSEC), 0U);
+    CHECK_EQ(governor.scale(), 1.0);
+    CHECK_EQ(governor.scaled(1920), 1920U);
+  }
+
+  /* Frames twice over target scale each side by about 1/sqrt(2). */
+  void testScalesDownByArea() {
+    ResolutionGovernor governor;
+    governor.setMinScale(0.5);
+    CHECK(governor.enabled());
+
+    CHECK(!governor.frameCompleted(2 * TARGET_NSEC, INTERVAL_NSEC));
+    CHECK(!governor.frameCompleted(2 * TARGET_NSEC, INTERVAL_NSEC));
+    CHECK(governor.frameCompleted(2 * TARGET_NSEC, INTERVAL_NSEC));
+    CHECK_EQ(governor.scale(), 11.0 / 16);
+    CHECK_EQ(governor.scaled(1920), 1320U);
+    CHECK_EQ(governor.scaled(1080), 742U);
+  }
+
+  /* One frame under target in between and we don't scale. */
+  void testNeedsConsecutiveFrames() {
+    ResolutionGovernor governor;
+    governor.setMinScale(0.5);
+    for (int round = 0; round < 10; round++) {
+      run(governor, ResolutionGovernor::OVER_FRAMES - 1, 2 * TARGET_NSEC);
+      run(governor, 1, TARGET_NSEC / 2);
+    }
+    CHECK_EQ(governor.scale(), 1.0);
+  }
+
+  void testMinScale() {
+    ResolutionGovernor governor;
+    governor.setMinScale(0.5);
+    CHECK_EQ(run(governor, 30, 10 * TARGET_NSEC), 1U);
+    CHECK_EQ(governor.scale(), 0.5);
+
+    governor.setMinScale(0);
+    CHECK(governor.enabled());
+    CHECK_EQ(governor.scale(), 1.0);
+    run(governor, ResolutionGovernor::OVER_FRAMES, 1000 * TARGET_NSEC);
+    CHECK_EQ(governor.scale(), 1.0 / 16);
+    CHECK_EQ(governor.scaled(20), 2U);
+
+    governor.setMinScale(1.5);
+    CHECK(!governor.enabled());
+  }
+
+  /* Back up one step at a time, once the next step up would fit. */
+  void testRecovery() {
+    ResolutionGovernor governor;
+    governor.setMinScale(0.5);
+    run(governor, ResolutionGovernor::OVER_FRAMES, 2 * TARGET_NSEC);
+    CHECK_EQ(governor.scale(), 11.0 / 16);
+
+    /* (12/11)^2 of this is just over RECOVERY_HEADROOM of the target. */
+    const int64_t tight = TARGET_NSEC * 76 / 100;
+    CHECK_EQ(run(governor, 2 * ResolutionGovernor::RECOVERY_FRAMES, tight), 0U);
+
+    const int64_t cheap = TARGET_NSEC / 2;
+    CHECK_EQ(run(governor, ResolutionGovernor::RECOVERY_FRAMES - 1, cheap), 0U);
+    CHECK(governor.frameCompleted(cheap, INTERVAL_NSEC));
+    CHECK_EQ(governor.scale(), 12.0 / 16);
+
+    CHECK_EQ(run(governor, 5 * ResolutionGovernor::RECOVERY_FRAMES, cheap), 4U);
+    CHECK_EQ(governor.scale(), 1.0);
+    CHECK_EQ(run(governor, ResolutionGovernor::RECOVERY_FRAMES, cheap), 0U);
+  }
+
+  void testIgnoresUnknownTimes() {
+    ResolutionGovernor governor;
+    governor.setMinScale(0.5);
+    CHECK_EQ(run(governor, 10, 0), 0U);
+    CHECK(!governor.frameCompleted(2 * TARGET_NSEC, 0));
+    CHECK_EQ(governor.scale(), 1.0);
+  }
+
+}
+
+auto main() -> int {
+  testDisabledByDefault();
+  testScalesDownByArea();
+  testNeedsConsecutiveFrames();
+  testMinScale();
+  testRecovery();
+  testIgnoresUnknownTimes();
+  return glplay::test::finish();
+}
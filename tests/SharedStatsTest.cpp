@@ -0,0 +1,113 @@
+#include "../src/kms/SharedStats.hpp"
+
+#include <atomic>
+#include <thread>
+
+#include "check.hpp"
+
+using glplay::kms::SHARED_STATS_BUCKETS;
+using glplay::kms::SharedDisplayBlock;
+using glplay::kms::SharedDisplayStats;
+using glplay::kms::shared_stats_read;
+using glplay::kms::shared_stats_write;
+
+namespace {
+
+  /* Stats with every counter set to 'value', so a torn copy shows. */
+  auto uniform(uint64_t value) -> SharedDisplayStats {
+    SharedDisplayStats stats{};
+    stats.frames = value;
+    stats.missedVblanks = value;
+    stats.early = value;
+    stats.late = value;
+    stats.lastSequence = value;
+    for (auto &bucket : stats.histogram) {
+      bucket = value;
+    }
+    return stats;
+  }
+
+  auto consistent(const SharedDisplayStats &stats) -> bool {
+    if (stats.missedVblanks != stats.frames || stats.early != stats.frames ||
+        stats.late != stats.frames || stats.lastSequence != stats.frames) {
+      return false;
+    }
+    for (auto bucket : stats.histogram) {
+      if (bucket != stats.frames) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  void testWriteThenRead() {
+    SharedDisplayBlock block{};
+    auto written = uniform(7);
+    written.fps = 59.5;
+    shared_stats_write(block, written);
+    CHECK_EQ(block.sequence.load(), 2U);
+
+    SharedDisplayStats read{};
+    CHECK(shared_stats_read(block, read));
+    CHECK_EQ(read.frames, 7U);
+    CHECK_EQ(read.fps, 59.5);
+    CHECK_EQ(read.histogram[SHARED_STATS_BUCKETS - 1], 7U);
+  }
+
+  /* A reader never takes a copy while the writer is part way through. */
+  void testWriterInProgress() {
+    SharedDisplayBlock block{};
+    shared_stats_write(block, uniform(1));
+    block.sequence.store(3);
+
+    auto read = uniform(99);
+    CHECK(!shared_stats_read(block, read));
+  }
+
+  /* A reader racing a writer only ever sees whole updates, in order. */
+  void testConcurrent() {
+    static SharedDisplayBlock block{};
+    const uint64_t updates = 200000;
+    std::atomic<bool> done = false;
+
+    std::thread writer([&done, updates] {
+      for (uint64_t value = 1; value <= updates; value++) {
+        shared_stats_write(block, uniform(value));
+      }
+      done = true;
+    });
+
+    uint64_t torn = 0;
+    uint64_t backwards = 0;
+    uint64_t last = 0;
+    do {
+      SharedDisplayStats stats{};
+      if (!shared_stats_read(block, stats)) {
+        continue;
+      }
+      if (!consistent(stats)) {
+        torn++;
+      }
+      if (stats.frames < last) {
+        backwards++;
+      }
+      last = stats.frames;
+    } while (!done);
+    writer.join();
+
+    CHECK_EQ(torn, 0U);
+    CHECK_EQ(backwards, 0U);
+
+    SharedDisplayStats stats{};
+    CHECK(shared_stats_read(block, stats));
+    CHECK_EQ(stats.frames, updates);
+  }
+
+}
+
+auto main() -> int {
+  testWriteThenRead();
+  testWriterInProgress();
+  testConcurrent();
+  return glplay::test::finish();
+}
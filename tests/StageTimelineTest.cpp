@@ -0,0 +1,167 @@
+#include "../src/kms/StageTimeline.hpp"
+
+#include "check.hpp"
+
+using glplay::kms::FrameRecord;
+using glplay::kms::FrameStage;
+using glplay::kms::StageTimeline;
+
+namespace {
+
+  const int64_t MSEC = 1000000;
+
+  /* How long a frame spent in each stretch; 0 leaves the GPU untimed. */
+  struct Costs {
+    int64_t cpu = 2 * MSEC;
+    int64_t gpuFence = 5 * MSEC;
+    int64_t gpuTimed = 0;
+    int64_t display = 10 * MSEC;
+  };
+
+  auto frameAt(int64_t start, const Costs &costs, bool late) -> FrameRecord {
+    FrameRecord frame;
+    auto flush = start + costs.cpu;
+    auto renderDone = flush + costs.gpuFence;
+    auto commit = renderDone + MSEC / 10;
+    frame.set(FrameStage::RenderStart, start);
+    frame.set(FrameStage::Flush, flush);
+    if (costs.gpuTimed != 0) {
+      frame.set(FrameStage::GpuStart, flush);
+      frame.set(FrameStage::GpuEnd, flush + costs.gpuTimed);
+    }
+    frame.set(FrameStage::RenderDone, renderDone);
+    frame.set(FrameStage::Commit, commit);
+    frame.set(FrameStage::Flip, commit + costs.display);
+    frame.late = late;
+    return frame;
+  }
+
+  void testPercentiles() {
+    StageTimeline timeline;
+    CHECK_EQ(timeline.percentile(FrameStage::RenderStart, FrameStage::Flush, 50), 0);
+
+    /* CPU times of 1ms to 100ms, in no particular order. */
+    for (int64_t idx = 0; idx < 100; idx++) {
+      Costs costs;
+      costs.cpu = ((idx * 37) % 100 + 1) * MSEC;
+      timeline.record(frameAt((idx + 1) * 100 * MSEC, costs, false));
+    }
+    CHECK_EQ(timeline.percentile(FrameStage::RenderStart, FrameStage::Flush, 50), 50 * MSEC);
+    CHECK_EQ(timeline.percentile(FrameStage::RenderStart, FrameStage::Flush, 90), 90 * MSEC);
+    CHECK_EQ(timeline.percentile(FrameStage::RenderStart, FrameStage::Flush, 100), 100 * MSEC);
+    CHECK_EQ(timeline.percentile(FrameStage::RenderStart, FrameStage::Flush, 0), 1 * MSEC);
+
+    /* Frames without a stage don't count towards intervals using it. */
+    FrameRecord partial = frameAt(20000 * MSEC, Costs{}, false);
+    partial.set(FrameStage::KmsFence, partial.at(FrameStage::Commit) + 3 * MSEC);
+    timeline.record(partial);
+    CHECK_EQ(timeline.percentile(FrameStage::Commit, FrameStage::KmsFence, 100), 3 * MSEC);
+    CHECK_EQ(timeline.percentile(FrameStage::Flush, FrameStage::GpuEnd, 50), 0);
+  }
+
+  /* Only the last CAPACITY frames count. */
+  void testRing() {
+    StageTimeline timeline;
+    int64_t start = MSEC;
+    Costs slow;
+    slow.cpu = 50 * MSEC;
+    for (int idx = 0; idx < 10; idx++, start += 100 * MSEC) {
+      timeline.record(frameAt(start, slow, false));
+    }
+    CHECK_EQ(timeline.percentile(FrameStage::RenderStart, FrameStage::Flush, 100), 50 * MSEC);
+
+    for (size_t idx = 0; idx < StageTimeline::CAPACITY; idx++, start += 100 * MSEC) {
+      timeline.record(frameAt(start, Costs{}, false));
+    }
+    CHECK_EQ(timeline.percentile(FrameStage::RenderStart, FrameStage::Flush, 100), 2 * MSEC);
+  }
+
+  /* GPU times arrive later, for a frame we find by when it started. */
+  void testGpuTimed() {
+    StageTimeline timeline;
+    int64_t start = MSEC;
+    for (size_t idx = 0; idx < StageTimeline::CAPACITY + 5; idx++, start += 100 * MSEC) {
+      timeline.record(frameAt(start, Costs{}, false));
+    }
+    auto newest = start - 100 * MSEC;
+    auto older = start - 300 * MSEC;
+    CHECK(timeline.gpuTimed(older, older + 3 * MSEC, older + 7 * MSEC));
+    CHECK(timeline.gpuTimed(newest, newest + 3 * MSEC, newest + 5 * MSEC));
+    CHECK_EQ(timeline.percentile(FrameStage::GpuStart, FrameStage::GpuEnd, 100), 4 * MSEC);
+    CHECK_EQ(timeline.percentile(FrameStage::GpuStart, FrameStage::GpuEnd, 0), 2 * MSEC);
+
+    /* The first frames have left the ring. */
+    CHECK(!timeline.gpuTimed(MSEC, 2 * MSEC, 3 * MSEC));
+  }
+
+  /* Each late frame goes down to the stretch furthest over its median. */
+  void testBlame() {
+    StageTimeline timeline;
+    int64_t start = MSEC;
+    auto add = [&timeline, &start](const Costs &costs, bool late) {
+      timeline.record(frameAt(start, costs, late));
+      start += 100 * MSEC;
+    };
+    for (int idx = 0; idx < 100; idx++) {
+      add(Costs{}, false);
+    }
+
+    Costs cpuBound;
+    cpuBound.cpu = 8 * MSEC;
+    add(cpuBound, true);
+    Costs gpuBound;
+    gpuBound.gpuFence = 12 * MSEC;
+    add(gpuBound, true);
+    add(gpuBound, true);
+    Costs displayBound;
+    displayBound.display = 20 * MSEC;
+    add(displayBound, true);
+    /* Late with nothing over its median: ties go to the CPU. */
+    add(Costs{}, true);
+
+    auto counts = timeline.blame();
+    CHECK_EQ(counts[static_cast<size_t>(StageTimeline::Bound::Cpu)], 2U);
+    CHECK_EQ(counts[static_cast<size_t>(StageTimeline::Bound::Gpu)], 2U);
+    CHECK_EQ(counts[static_cast<size_t>(StageTimeline::Bound::Display)], 1U);
+  }
+
+  /*
+  * With timer queries, a frame whose fence came late only because it was
+  * queued behind other work isn't blamed on the GPU.
+  */
+  void testBlameGpuTimed() {
+    StageTimeline timeline;
+    int64_t start = MSEC;
+    Costs timed;
+    timed.gpuTimed = 4 * MSEC;
+    for (int idx = 0; idx < 100; idx++, start += 100 * MSEC) {
+      timeline.record(frameAt(start, timed, false));
+    }
+
+    Costs queued = timed;
+    queued.cpu = 3 * MSEC;
+    queued.gpuFence = 15 * MSEC;
+    timeline.record(frameAt(start, queued, true));
+    start += 100 * MSEC;
+
+    Costs busy = timed;
+    busy.gpuFence = 15 * MSEC;
+    busy.gpuTimed = 12 * MSEC;
+    timeline.record(frameAt(start, busy, true));
+
+    auto counts = timeline.blame();
+    CHECK_EQ(counts[static_cast<size_t>(StageTimeline::Bound::Cpu)], 1U);
+    CHECK_EQ(counts[static_cast<size_t>(StageTimeline::Bound::Gpu)], 1U);
+    CHECK_EQ(counts[static_cast<size_t>(StageTimeline::Bound::Display)], 0U);
+  }
+
+}
+
+auto main() -> int {
+  testPercentiles();
+  testRing();
+  testGpuTimed();
+  testBlame();
+  testBlameGpuTimed();
+  return glplay::test::finish();
+}
@@ -0,0 +1,100 @@
+#include "../src/kms/VblankEstimator.hpp"
+
+#include <cmath>
+#include <cstdlib>
+
+#include "check.hpp"
+
+using glplay::kms::VblankEstimator;
+
+namespace {
+
+  /* A display running a little slower than its nominal 60Hz. */
+  const double PERIOD_NSEC = 16683333.5;
+  const int64_t START_NSEC = 1000000000000;
+
+  auto vblankTime(uint64_t offset) -> int64_t {
+    return START_NSEC + std::llround(PERIOD_NSEC * static_cast<double>(offset));
+  }
+
+  /* Up to 50us of timestamp jitter, the same on every run. */
+  auto jitter(uint64_t offset) -> int64_t {
+    return static_cast<int64_t>((offset * 7919) % 101) * 1000 - 50000;
+  }
+
+  void testNeedsSamples() {
+    VblankEstimator estimator;
+    for (uint32_t seq = 0; seq < VblankEstimator::MIN_SAMPLES - 1; seq++) {
+      estimator.addSample(100 + seq, vblankTime(seq));
+    }
+    CHECK(!estimator.valid());
+    estimator.addSample(100 + VblankEstimator::MIN_SAMPLES - 1, vblankTime(VblankEstimator::MIN_SAMPLES - 1));
+    CHECK(estimator.valid());
+  }
+
+  /* The fit sees through the jitter, both to the period and to future vblanks. */
+  void testFitsPeriodAndPhase() {
+    VblankEstimator estimator;
+    for (uint64_t offset = 0; offset < VblankEstimator::WINDOW; offset++) {
+      estimator.addSample(static_cast<uint32_t>(500 + offset), vblankTime(offset) + jitter(offset));
+    }
+    CHECK(estimator.valid());
+    CHECK(std::fabs(estimator.periodNsec() - PERIOD_NSEC) < 1000);
+
+    auto future = VblankEstimator::WINDOW + 60;
+    CHECK(std::llabs(estimator.timeOf(500 + future) - vblankTime(future)) < 50000);
+    CHECK_EQ(estimator.sequenceNear(vblankTime(future) + 3000000), 500 + future);
+    CHECK_EQ(estimator.sequenceNear(vblankTime(future) - 3000000), 500 + future);
+  }
+
+  /* The kernel's 32-bit counter wrapping keeps counting up. */
+  void testSequenceWraps() {
+    VblankEstimator estimator;
+    const uint32_t first = 0xfffffffa;
+    for (uint32_t offset = 0; offset < 20; offset++) {
+      estimator.addSample(first + offset, vblankTime(offset));
+    }
+    CHECK(estimator.valid());
+    CHECK(std::fabs(estimator.periodNsec() - PERIOD_NSEC) < 1);
+    auto wrapped = static_cast<uint64_t>(first) + 20;
+    CHECK(wrapped > 0xffffffff);
+    CHECK(std::llabs(estimator.timeOf(wrapped) - vblankTime(20)) <= 1);
+  }
+
+  /* Several completions reporting one vblank count once. */
+  void testDuplicateSequence() {
+    VblankEstimator estimator;
+    for (uint32_t offset = 0; offset < 10; offset++) {
+      estimator.addSample(offset, vblankTime(offset));
+      estimator.addSample(offset, vblankTime(offset) + 2000000);
+    }
+    CHECK(std::fabs(estimator.periodNsec() - PERIOD_NSEC) < 1);
+  }
+
+  /* A sample far off the line, as after a modeset, starts the fit over. */
+  void testRestartsOnJump() {
+    VblankEstimator estimator;
+    for (uint32_t offset = 0; offset < 20; offset++) {
+      estimator.addSample(offset, vblankTime(offset));
+    }
+    CHECK(estimator.valid());
+
+    const double newPeriod = 8333333;
+    auto base = vblankTime(20) + 5000000;
+    for (uint32_t offset = 0; offset < VblankEstimator::MIN_SAMPLES; offset++) {
+      estimator.addSample(20 + offset, base + std::llround(newPeriod * offset));
+      CHECK(estimator.valid() == (offset + 1 >= VblankEstimator::MIN_SAMPLES));
+    }
+    CHECK(std::fabs(estimator.periodNsec() - newPeriod) < 1);
+  }
+
+}
+
+auto main() -> int {
+  testNeedsSamples();
+  testFitsPeriodAndPhase();
+  testSequenceWraps();
+  testDuplicateSequence();
+  testRestartsOnJump();
+  return glplay::test::finish();
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <type_traits>
+
+namespace glplay::test {
+
+  /*
+  * Just enough of a test framework for the unit tests: a failed check is
+  * printed with where it was, and the test keeps going so one run shows
+  * every failure. main() returns finish(), which fails if any check did.
+  */
+  inline int failures = 0;
+
+  inline void check(bool passed, const char *what, const char *file, int line) {
+    if (!passed) {
+      fprintf(stderr, "%s:%d: check failed: %s\n", file, line, what);
+      failures++;
+    }
+  }
+
+  template <typename T, typename U>
+  void checkEqual(const T &actual, const U &expected, const char *what, const char *file, int line) {
+    if (actual == expected) {
+      return;
+    }
+    if constexpr (std::is_arithmetic_v<T> && std::is_arithmetic_v<U>) {
+      fprintf(stderr, "%s:%d: check failed: %s (%s, expected %s)\n", file, line, what,
+              std::to_string(actual).c_str(), std::to_string(expected).c_str());
+    } else {
+      fprintf(stderr, "%s:%d: check failed: %s\n", file, line, what);
+    }
+    failures++;
+  }
+
+  inline auto finish() -> int {
+    if (failures > 0) {
+      fprintf(stderr, "%d checks failed\n", failures);
+      return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+  }
+
+}
+
+#define CHECK(cond) glplay::test::check((cond), #cond, __FILE__, __LINE__)
+#define CHECK_EQ(actual, expected) \
+  glplay::test::checkEqual((actual), (expected), #actual " == " #expected, __FILE__, __LINE__)